@@ -0,0 +1,333 @@
+#include "data_columns.hpp"
+#include "parser.hpp"
+#include "parse_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+//a variable swept over [from,to] in count evenly spaced samples
+struct GridAxis{
+	ID var;
+	long double from=0,to=0;
+	long count=1;
+
+	long double at(long n) const {
+		return count>1 ? from+(to-from)*n/(count-1) : from;
+	}
+};
+
+struct Options{
+	vector<string> files;
+	vector<GridAxis> grid;
+	//imported columns, substituted wherever a definition uses their names
+	vector<DataColumn> data;
+	bool quiet=false;
+	bool stats=false;
+	bool cache=false;
+	unsigned jobs=1;
+};
+
+struct Timings{
+	vector<double> parse_us;
+	vector<double> eval_us;
+	uint64_t definitions=0;
+	uint64_t evaluations=0;
+	uint64_t errors=0;
+
+	void merge(const Timings& b){
+		parse_us.insert(parse_us.end(),b.parse_us.begin(),b.parse_us.end());
+		eval_us.insert(eval_us.end(),b.eval_us.begin(),b.eval_us.end());
+		definitions+=b.definitions;
+		evaluations+=b.evaluations;
+		errors+=b.errors;
+	}
+};
+
+void usage(){
+	std::cerr<<
+		"usage: mathvis-cli [options] [file...]\n"
+		"reads one definition per line from each file (or stdin), evaluates it and prints the result\n"
+		"  -g var=from:to:count  evaluate over count samples of var; repeat for a grid over several variables\n"
+		"  -d file               import the columns of a CSV file, or a file of raw doubles (.f32: floats), by name\n"
+		"  -c                    cache parses and pure values by text\n"
+		"  -j n                  evaluate on n threads (results stay in input order)\n"
+		"  -q                    don't print results\n"
+		"  -s                    report throughput and latency on stderr\n";
+}
+
+GridAxis parse_axis(const string& arg){
+	size_t eq=arg.find('=');
+	size_t c1=arg.find(':',eq);
+	size_t c2=arg.find(':',c1+1);
+	if(eq==string::npos || c1==string::npos || c2==string::npos){
+		throw std::invalid_argument("bad grid axis: "+arg);
+	}
+	GridAxis axis;
+	axis.var=ID(arg.substr(0,eq));
+	axis.from=std::stold(arg.substr(eq+1,c1-eq-1));
+	axis.to=std::stold(arg.substr(c1+1,c2-c1-1));
+	axis.count=std::max(1L,std::stol(arg.substr(c2+1)));
+	return axis;
+}
+
+//ex with the imported columns it uses substituted; a column imported later doesn't replace one of the same name
+Expr bind_data(const Expr& ex, const Options& opts){
+	set<ID> vars=ex.find_vars();
+	SymbolTable symbols;
+	for(const DataColumn& column : opts.data){
+		if(vars.count(column.name)){
+			symbols.add(column.name);
+		}
+	}
+	if(symbols.size()==0){
+		return ex;
+	}
+	Bindings values(symbols);
+	for(const DataColumn& column : opts.data){
+		long slot=symbols.find(column.name);
+		if(slot>=0 && slot<(long)values.values.size() && !values[slot].defined()){
+			values[slot]=column.values;
+		}
+	}
+	return ex.substitute(values);
+}
+
+double micros_since(Clock::time_point start){
+	return std::chrono::duration<double,std::micro>(Clock::now()-start).count();
+}
+
+//appends the value or error to out; returns false on error
+//the value is also moved into value, if given, for caching
+bool evaluate_one(const Expr& ex, const string& prefix, const Options& opts, Timings& timings, string& out, Expr* value=nullptr){
+	Clock::time_point start=Clock::now();
+	string result;
+	bool ok=true;
+	try{
+		Expr evaluated=ex.evaluate();
+		result=evaluated.to_string(true);
+		if(value){
+			*value=std::move(evaluated);
+		}
+	}catch(ExprError err){
+		result="error: "+err.what;
+		ok=false;
+	}
+	timings.eval_us.push_back(micros_since(start));
+	timings.evaluations++;
+	if(!opts.quiet){
+		out+=prefix+result+"\n";
+	}
+	return ok;
+}
+
+//evaluates over every point of the grid, from axis 'axis' onward
+//ex must be bound to the table that point's slots come from
+void evaluate_grid(const Expr& ex, size_t axis, const vector<uint32_t>& slots, Bindings& point, string prefix, const Options& opts, Timings& timings, string& out){
+	if(axis==opts.grid.size()){
+		if(!evaluate_one(ex.substitute(point),prefix,opts,timings,out)){
+			timings.errors++;
+		}
+		return;
+	}
+	const GridAxis& ga=opts.grid[axis];
+	for(long n=0;n<ga.count;n++){
+		number_t value=ga.at(n);
+		point[slots[axis]]=Expr(value);
+		evaluate_grid(ex,axis+1,slots,point,prefix+string(ga.var)+"="+string(value)+"\t",opts,timings,out);
+	}
+}
+
+void process_line(const string& line, long lineno, const Options& opts, Timings& timings, string& out){
+	if(line.find_first_not_of(" \t\r")==string::npos){
+		return;
+	}
+	timings.definitions++;
+	string prefix=std::to_string(lineno)+"\t";
+
+	Clock::time_point start=Clock::now();
+	Expr parsed;
+	ParseCache::Result cached;
+	bool hit=opts.cache && parse_cache.find(line,cached);
+	try{
+		//a copy either way, since binding data and slots changes it
+		if(hit){
+			parsed=*cached.parsed;
+		}else{
+			parsed=parse(line);
+			if(opts.cache){
+				parse_cache.store(line,std::make_shared<const Expr>(parsed));
+			}
+		}
+	}catch(ParseFail pf){
+		timings.parse_us.push_back(micros_since(start));
+		timings.errors++;
+		if(!opts.quiet){
+			out+=prefix+"error: "+pf.reason+"\n";
+		}
+		return;
+	}
+	timings.parse_us.push_back(micros_since(start));
+	if(!opts.data.empty()){
+		parsed=bind_data(parsed,opts);
+	}
+
+	if(!opts.grid.empty()){
+		SymbolTable symbols;
+		vector<uint32_t> slots;
+		for(const GridAxis& ga : opts.grid){
+			slots.push_back(symbols.add(ga.var));
+		}
+		symbols.bind(parsed);
+		Bindings point(symbols);
+		evaluate_grid(parsed,0,slots,point,prefix,opts,timings,out);
+		return;
+	}
+
+	if(hit && cached.has_value){
+		timings.eval_us.push_back(0);
+		timings.evaluations++;
+		if(!opts.quiet){
+			out+=prefix+cached.value.to_string(true)+"\n";
+		}
+		return;
+	}
+	Expr value;
+	bool cacheable=opts.cache && expr_is_pure(parsed);
+	if(!evaluate_one(parsed,prefix,opts,timings,out,cacheable ? &value : nullptr)){
+		timings.errors++;
+	}
+	else if(cacheable){
+		parse_cache.store_value(line,std::move(value));
+	}
+}
+
+//lines are read in batches, each batch split into contiguous runs over the threads
+void process_stream(std::istream& in, const Options& opts, Timings& timings){
+	static constexpr size_t BATCH=1<<14;
+	vector<string> lines;
+	long lineno=0;
+	while(in){
+		lines.clear();
+		string line;
+		while(lines.size()<BATCH && std::getline(in,line)){
+			lines.push_back(std::move(line));
+		}
+		if(lines.empty()){
+			break;
+		}
+
+		unsigned jobs=std::min<size_t>(opts.jobs,lines.size());
+		vector<string> outs(jobs);
+		vector<Timings> job_timings(jobs);
+		auto run=[&](unsigned job){
+			size_t from=lines.size()*job/jobs;
+			size_t to=lines.size()*(job+1)/jobs;
+			for(size_t n=from;n<to;n++){
+				process_line(lines[n],lineno+n+1,opts,job_timings[job],outs[job]);
+			}
+		};
+		vector<std::thread> threads;
+		for(unsigned job=1;job<jobs;job++){
+			threads.emplace_back(run,job);
+		}
+		run(0);
+		for(std::thread& thread : threads){
+			thread.join();
+		}
+
+		for(unsigned job=0;job<jobs;job++){
+			fwrite(outs[job].data(),1,outs[job].size(),stdout);
+			timings.merge(job_timings[job]);
+		}
+		lineno+=lines.size();
+	}
+}
+
+double percentile(vector<double>& samples, double p){
+	if(samples.empty()){
+		return 0;
+	}
+	size_t n=std::min(samples.size()-1,(size_t)(p*samples.size()));
+	std::nth_element(samples.begin(),samples.begin()+n,samples.end());
+	return samples[n];
+}
+
+void report(Timings& timings, double wall_s){
+	fprintf(stderr,"%lu definitions, %lu evaluations, %lu errors in %.3f s\n",
+		(unsigned long)timings.definitions,(unsigned long)timings.evaluations,(unsigned long)timings.errors,wall_s);
+	if(wall_s>0){
+		fprintf(stderr,"throughput: %.0f definitions/s, %.0f evaluations/s\n",
+			timings.definitions/wall_s,timings.evaluations/wall_s);
+	}
+	fprintf(stderr,"parse latency us:    p50 %.1f  p99 %.1f  max %.1f\n",
+		percentile(timings.parse_us,0.5),percentile(timings.parse_us,0.99),percentile(timings.parse_us,1));
+	fprintf(stderr,"evaluate latency us: p50 %.1f  p99 %.1f  max %.1f\n",
+		percentile(timings.eval_us,0.5),percentile(timings.eval_us,0.99),percentile(timings.eval_us,1));
+	ID::Stats names=ID::stats();
+	fprintf(stderr,"interned names: %lu (%lu unreferenced), %.1f KiB reserved, %.1f KiB in use\n",
+		(unsigned long)names.entries,(unsigned long)names.unreferenced,names.reserved_bytes/1024.0,names.live_bytes/1024.0);
+}
+
+int main(int argc, char** argv){
+	Options opts;
+	try{
+		for(int n=1;n<argc;n++){
+			string arg=argv[n];
+			if(arg=="-g" && n+1<argc){
+				opts.grid.push_back(parse_axis(argv[++n]));
+			}else if(arg=="-d" && n+1<argc){
+				for(DataColumn& column : import_file(argv[++n])){
+					opts.data.push_back(std::move(column));
+				}
+			}else if(arg=="-c"){
+				opts.cache=true;
+			}else if(arg=="-j" && n+1<argc){
+				opts.jobs=std::max(1,std::stoi(argv[++n]));
+			}else if(arg=="-q"){
+				opts.quiet=true;
+			}else if(arg=="-s"){
+				opts.stats=true;
+			}else if(arg=="-h" || arg=="--help" || (arg.size()>1 && arg[0]=='-')){
+				usage();
+				return arg[1]=='h' || arg=="--help" ? 0 : 2;
+			}else{
+				opts.files.push_back(arg);
+			}
+		}
+	}catch(std::exception& e){
+		std::cerr<<e.what()<<"\n";
+		usage();
+		return 2;
+	}catch(DataError& e){
+		std::cerr<<e.what<<"\n";
+		return 1;
+	}
+
+	static char out_buf[1<<16];
+	setvbuf(stdout,out_buf,_IOFBF,sizeof(out_buf));
+
+	Timings timings;
+	Clock::time_point start=Clock::now();
+	if(opts.files.empty()){
+		process_stream(std::cin,opts,timings);
+	}
+	for(const string& file : opts.files){
+		std::ifstream in(file);
+		if(!in){
+			std::cerr<<"can't open "<<file<<"\n";
+			return 1;
+		}
+		process_stream(in,opts,timings);
+	}
+	fflush(stdout);
+
+	if(opts.stats){
+		report(timings,micros_since(start)/1e6);
+	}
+	return timings.errors ? 1 : 0;
+}
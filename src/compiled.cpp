@@ -0,0 +1,927 @@
+#include "compiled.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+CompiledExpr::CompiledExpr(const Expr& ex, const vector<ID>& inputs):input_names(inputs){
+	symbols=std::make_unique<SymbolTable>();
+	for(ID name : inputs){
+		bool repeated=symbols->find(name)>=0;
+		input_slots.push_back(repeated ? -1 : (long)symbols->add(name));
+	}
+	uint32_t height=0;
+	if(ex.type()==Tuple::type){
+		output_count=ex.node->subexprs.size();
+		compiled=true;
+		for(const Expr& element : ex.node->subexprs){
+			compiled=compiled && compile(element,height);
+		}
+	}else{
+		compiled=compile(ex,height);
+	}
+	compiled=compiled && height==output_count;
+	if(!compiled){
+		code.clear();
+		body=ex;
+		symbols->bind(body);
+		find_antiderivative(ex);
+	}
+}
+
+//integral # (t, a, x, term) for a constant a, the one input x, and a term of t alone
+void CompiledExpr::find_antiderivative(const Expr& ex){
+	if(ex.type()!=DefiniteIntegral::type || input_names.size()!=1){
+		return;
+	}
+	const DefiniteIntegral* integral=dynamic_cast<const DefiniteIntegral*>(ex.node.get());
+	if(!integral->variable){
+		return;
+	}
+	const deque<Expr>& range=integral->subexprs.front().node->subexprs;
+	if(range[2].type()!=Variable::type || dynamic_cast<const Variable*>(range[2].node.get())->name!=input_names[0]){
+		return;
+	}
+	set<ID> vars=range[3].find_vars();
+	vars.erase(integral->variable);
+	if(!vars.empty() || !range[1].find_vars().empty()){
+		return;
+	}
+	try{
+		Expr from=range[1].evaluate();
+		if(from.type()!=Number::type){
+			return;
+		}
+		integral_from=dynamic_cast<const Number*>(from.node.get())->value;
+	}catch(ExprError){
+		return;
+	}
+	integrand=std::make_shared<const CompiledExpr>(range[3],vector<ID>{integral->variable});
+	if(integrand->outputs()!=1){
+		integrand.reset();
+	}
+}
+
+std::shared_ptr<const CompiledExpr> CompiledExpr::load(const vector<ID>& inputs, vector<Instr> program, size_t outputs){
+	std::shared_ptr<CompiledExpr> ret(new CompiledExpr());
+	uint32_t height=0;
+	for(const Instr& instr : program){
+		switch(instr.op){
+			case PUSH_INPUT:
+				if(instr.input>=inputs.size()){
+					return nullptr;
+				}
+				[[fallthrough]];
+			case PUSH_CONST:
+				height++;
+				break;
+			case NEG: case POWI: case SQRT:
+				if(height<1){
+					return nullptr;
+				}
+				break;
+			case ADD: case SUB: case MUL: case DIV: case POW:
+				if(height<2){
+					return nullptr;
+				}
+				height--;
+				break;
+			default:
+				return nullptr;
+		}
+		ret->depth=std::max(ret->depth,height);
+	}
+	if(program.empty() || outputs==0 || height!=outputs){
+		return nullptr;
+	}
+	ret->input_names=inputs;
+	ret->code=std::move(program);
+	ret->output_count=outputs;
+	ret->compiled=true;
+	return ret;
+}
+
+void CompiledExpr::emit(Op op, uint32_t& height, int change, double value, uint32_t input){
+	Instr instr;
+	instr.op=op;
+	instr.value=value;
+	instr.input=input;
+	code.push_back(instr);
+	height+=change;
+	depth=std::max(depth,height);
+}
+
+//follows the evaluation order of the operators: + - * / fold from the left, ^ from the right
+bool CompiledExpr::compile(const Expr& ex, uint32_t& height){
+	if(!ex.defined()){
+		return false;
+	}
+	ID type=ex.type();
+	const deque<Expr>& subs=ex.node->subexprs;
+
+	if(type==Number::type){
+		emit(PUSH_CONST,height,1,dynamic_cast<const Number*>(ex.node.get())->value);
+		return true;
+	}
+	if(type==Variable::type){
+		long slot=symbols->find(dynamic_cast<const Variable*>(ex.node.get())->name);
+		if(slot<0){
+			return false;
+		}
+		emit(PUSH_INPUT,height,1,0,std::find(input_slots.begin(),input_slots.end(),slot)-input_slots.begin());
+		return true;
+	}
+	if(type==Parenthetical::type){
+		return subs.size()==1 && compile(subs.front(),height);
+	}
+
+	//a constant power is a few multiplies, or a square root, rather than a call to pow
+	if(type==Exponent::type && subs.size()==2 && subs.back().type()==Number::type){
+		double power=dynamic_cast<const Number*>(subs.back().node.get())->value;
+		if(power==0.5 || (power==std::round(power) && std::abs(power)<=64)){
+			if(!compile(subs.front(),height)){
+				return false;
+			}
+			emit(power==0.5 ? SQRT : POWI,height,0,power);
+			return true;
+		}
+	}
+
+	Op op;
+	if(type==Add::type){
+		op=ADD;
+	}else if(type==Sub::type){
+		op=SUB;
+	}else if(type==Mul::type){
+		op=MUL;
+	}else if(type==Div::type){
+		op=DIV;
+	}else if(type==Exponent::type){
+		op=POW;
+	}else{
+		return false;
+	}
+	if(subs.empty()){
+		return false;
+	}
+
+	auto it=subs.begin();
+	//a leading nothing only means something to -, as a negation
+	if(op==SUB && !it->defined()){
+		if(subs.size()<2 || !compile(*++it,height)){
+			return false;
+		}
+		emit(NEG,height,0);
+	}else if(!compile(*it,height)){
+		return false;
+	}
+	for(it++;it!=subs.end();it++){
+		if(!compile(*it,height)){
+			return false;
+		}
+		if(op!=POW){
+			emit(op,height,-1);
+		}
+	}
+	if(op==POW){
+		for(size_t n=1;n<subs.size();n++){
+			emit(POW,height,-1);
+		}
+	}
+	return true;
+}
+
+void CompiledExpr::evaluate_tree(const double* at, double* out) const {
+	std::fill(out,out+output_count,NAN);
+	try{
+		Bindings values(*symbols);
+		for(size_t n=0;n<input_names.size();n++){
+			if(input_slots[n]>=0){
+				values[input_slots[n]]=Expr(number_t(at[n]));
+			}
+		}
+		Expr ret=body.substitute(values).evaluate();
+		if(output_count==1){
+			if(ret.type()==Number::type){
+				out[0]=dynamic_cast<const Number*>(ret.node.get())->value;
+			}
+		}else if(ret.type()==Tuple::type && ret.node->subexprs.size()==output_count){
+			for(size_t k=0;k<output_count;k++){
+				const Expr& element=ret.node->subexprs[k];
+				if(element.type()==Number::type){
+					out[k]=dynamic_cast<const Number*>(element.node.get())->value;
+				}
+			}
+		}
+	}catch(ExprError){}
+}
+
+//by squaring, as pow would for a whole power
+static double powi(double base, long power){
+	unsigned long bits=std::abs(power);
+	double ret=1;
+	while(bits){
+		if(bits&1){
+			ret*=base;
+		}
+		base*=base;
+		bits>>=1;
+	}
+	return power<0 ? 1/ret : ret;
+}
+
+//one instruction on constants, as evaluate runs it
+static double fold(CompiledExpr::Op op, double a, double b, double value){
+	switch(op){
+		case CompiledExpr::NEG: return -a;
+		case CompiledExpr::ADD: return a+b;
+		case CompiledExpr::SUB: return a-b;
+		case CompiledExpr::MUL: return a*b;
+		case CompiledExpr::DIV: return a/b;
+		case CompiledExpr::POW: return pow(a,b);
+		case CompiledExpr::POWI: return powi(a,value);
+		case CompiledExpr::SQRT: return sqrt(a);
+		default: return NAN;
+	}
+}
+
+std::shared_ptr<const CompiledExpr> CompiledExpr::bind(size_t first, const double* values) const {
+	vector<ID> kept(input_names.begin(),input_names.begin()+first);
+	if(!compiled){
+		Bindings fixed(*symbols);
+		for(size_t n=first;n<input_names.size();n++){
+			if(input_slots[n]>=0){
+				fixed[input_slots[n]]=Expr(number_t(values[n-first]));
+			}
+		}
+		Expr ex=body.substitute(fixed);
+		try{
+			ex=ex.evaluate();
+		}catch(ExprError){}
+		return std::make_shared<CompiledExpr>(ex,kept);
+	}
+	std::shared_ptr<CompiledExpr> ret(new CompiledExpr());
+	ret->input_names=std::move(kept);
+	ret->output_count=output_count;
+	ret->compiled=true;
+	//whether each entry on the stack is a constant; a constant's code is always the one PUSH_CONST last emitted for it,
+	//so folding an instruction into it only rewrites or drops the end of the program
+	vector<bool> constant;
+	uint32_t height=0;
+	for(const Instr& instr : code){
+		switch(instr.op){
+			case PUSH_CONST:
+				ret->emit(PUSH_CONST,height,1,instr.value);
+				constant.push_back(true);
+				break;
+			case PUSH_INPUT:
+				if(instr.input>=first){
+					ret->emit(PUSH_CONST,height,1,values[instr.input-first]);
+				}else{
+					ret->emit(PUSH_INPUT,height,1,0,instr.input);
+				}
+				constant.push_back(instr.input>=first);
+				break;
+			case NEG: case POWI: case SQRT:
+				if(constant.back()){
+					ret->code.back().value=fold(instr.op,ret->code.back().value,0,instr.value);
+				}else{
+					ret->emit(instr.op,height,0,instr.value);
+				}
+				break;
+			default:{
+				bool both=constant.back() && constant[constant.size()-2];
+				constant.pop_back();
+				if(both){
+					double b=ret->code.back().value;
+					ret->code.pop_back();
+					height--;
+					ret->code.back().value=fold(instr.op,ret->code.back().value,b,0);
+				}else{
+					constant.back()=false;
+					ret->emit(instr.op,height,-1,instr.value);
+				}
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
+double CompiledExpr::evaluate(const double* at) const {
+	if(integrand){
+		return integral_between(integral_from,at[0]);
+	}
+	if(!compiled){
+		vector<double> out(output_count);
+		evaluate_tree(at,out.data());
+		return out[0];
+	}
+	double small[32];
+	vector<double> big;
+	double* stack=small;
+	if(depth>32){
+		big.resize(depth);
+		stack=big.data();
+	}
+	size_t top=0;
+	for(const Instr& instr : code){
+		switch(instr.op){
+			case PUSH_CONST: stack[top++]=instr.value; break;
+			case PUSH_INPUT: stack[top++]=at[instr.input]; break;
+			case NEG: stack[top-1]=-stack[top-1]; break;
+			case ADD: top--; stack[top-1]+=stack[top]; break;
+			case SUB: top--; stack[top-1]-=stack[top]; break;
+			case MUL: top--; stack[top-1]*=stack[top]; break;
+			case DIV: top--; stack[top-1]/=stack[top]; break;
+			case POW: top--; stack[top-1]=pow(stack[top-1],stack[top]); break;
+			case POWI: stack[top-1]=powi(stack[top-1],instr.value); break;
+			case SQRT: stack[top-1]=sqrt(stack[top-1]); break;
+		}
+	}
+	return stack[0];
+}
+
+void CompiledExpr::evaluate_batch(const double* const* columns, double* out, size_t count) const {
+	if(output_count==1){
+		evaluate_batch(columns,&out,count);
+		return;
+	}
+	//the other outputs are computed anyway, so they need somewhere to go
+	vector<double> rest((output_count-1)*count);
+	vector<double*> outs{out};
+	for(size_t k=1;k<output_count;k++){
+		outs.push_back(rest.data()+(k-1)*count);
+	}
+	evaluate_batch(columns,outs.data(),count);
+}
+
+//runs the program over blocks of points at a time, so every instruction is a simple loop over a block
+void CompiledExpr::evaluate_batch(const double* const* columns, double* const* outs, size_t count) const {
+	static constexpr size_t BLOCK=256;
+	if(integrand){
+		evaluate_antiderivative(columns[0],outs[0],count);
+		return;
+	}
+	if(!compiled){
+		vector<double> at(input_names.size()),values(output_count);
+		for(size_t n=0;n<count;n++){
+			for(size_t i=0;i<at.size();i++){
+				at[i]=columns[i][n];
+			}
+			evaluate_tree(at.data(),values.data());
+			for(size_t k=0;k<output_count;k++){
+				outs[k][n]=values[k];
+			}
+		}
+		return;
+	}
+	vector<double> stack(depth*BLOCK),power(BLOCK);
+	for(size_t from=0;from<count;from+=BLOCK){
+		size_t len=std::min(BLOCK,count-from);
+		size_t height=0;
+		auto level=[&](size_t h){ return stack.data()+h*BLOCK; };
+		for(const Instr& instr : code){
+			double* a=height>=2 ? level(height-2) : nullptr;
+			double* b=height>=1 ? level(height-1) : nullptr;
+			switch(instr.op){
+				case PUSH_CONST:
+					std::fill(level(height),level(height)+len,instr.value);
+					height++;
+					break;
+				case PUSH_INPUT:
+					std::copy(columns[instr.input]+from,columns[instr.input]+from+len,level(height));
+					height++;
+					break;
+				case NEG:
+					for(size_t n=0;n<len;n++) b[n]=-b[n];
+					break;
+				case ADD:
+					for(size_t n=0;n<len;n++) a[n]+=b[n];
+					height--;
+					break;
+				case SUB:
+					for(size_t n=0;n<len;n++) a[n]-=b[n];
+					height--;
+					break;
+				case MUL:
+					for(size_t n=0;n<len;n++) a[n]*=b[n];
+					height--;
+					break;
+				case DIV:
+					for(size_t n=0;n<len;n++) a[n]/=b[n];
+					height--;
+					break;
+				case POW:
+					for(size_t n=0;n<len;n++) a[n]=pow(a[n],b[n]);
+					height--;
+					break;
+				case POWI:{
+					//squaring the whole block at once, so each step is still a simple loop
+					unsigned long bits=std::abs((long)instr.value);
+					std::fill(power.begin(),power.begin()+len,1.0);
+					while(bits){
+						if(bits&1){
+							for(size_t n=0;n<len;n++) power[n]*=b[n];
+						}
+						bits>>=1;
+						if(bits){
+							for(size_t n=0;n<len;n++) b[n]*=b[n];
+						}
+					}
+					if(instr.value<0){
+						for(size_t n=0;n<len;n++) b[n]=1/power[n];
+					}else{
+						std::copy(power.begin(),power.begin()+len,b);
+					}
+					break;
+				}
+				case SQRT:
+					for(size_t n=0;n<len;n++) b[n]=sqrt(b[n]);
+					break;
+			}
+		}
+		for(size_t k=0;k<output_count;k++){
+			std::copy(level(k),level(k)+len,outs[k]+from);
+		}
+	}
+}
+
+namespace{
+
+//anything NaN means the bounds are lost, as for inf-inf or 0*inf
+Interval checked(double lo, double hi){
+	if(std::isnan(lo) || std::isnan(hi)){
+		return Interval();
+	}
+	return Interval{lo,hi};
+}
+
+Interval interval_mul(Interval a, Interval b){
+	double p[4]={a.lo*b.lo,a.lo*b.hi,a.hi*b.lo,a.hi*b.hi};
+	for(double v : p){
+		if(std::isnan(v)){
+			return Interval();
+		}
+	}
+	return Interval{std::min({p[0],p[1],p[2],p[3]}),std::max({p[0],p[1],p[2],p[3]})};
+}
+
+Interval interval_div(Interval a, Interval b){
+	if(b.contains(0)){
+		return Interval();
+	}
+	return interval_mul(a,Interval{1/b.hi,1/b.lo});
+}
+
+Interval interval_pow(Interval a, Interval b){
+	if(b.lo==b.hi && b.lo==std::round(b.lo) && std::abs(b.lo)<=1<<20){
+		double n=b.lo;
+		if(n==0){
+			return Interval{1,1};
+		}
+		if(n<0 && a.contains(0)){
+			return Interval();
+		}
+		double lo=pow(a.lo,n),hi=pow(a.hi,n);
+		//even powers fold the negatives over, bottoming out at 0 if it's inside
+		if(std::fmod(n,2)==0 && a.contains(0)){
+			return checked(0,std::max(lo,hi));
+		}
+		return checked(std::min(lo,hi),std::max(lo,hi));
+	}
+	//otherwise only defined for non-negative bases, where it's monotonic in each argument
+	if(a.lo<0){
+		return Interval();
+	}
+	double p[4]={pow(a.lo,b.lo),pow(a.lo,b.hi),pow(a.hi,b.lo),pow(a.hi,b.hi)};
+	for(double v : p){
+		if(std::isnan(v)){
+			return Interval();
+		}
+	}
+	return Interval{std::min({p[0],p[1],p[2],p[3]}),std::max({p[0],p[1],p[2],p[3]})};
+}
+
+}
+
+Interval CompiledExpr::evaluate_interval(const Interval* at) const {
+	if(!compiled){
+		return Interval();
+	}
+	vector<Interval> stack(depth);
+	size_t top=0;
+	for(const Instr& instr : code){
+		switch(instr.op){
+			case PUSH_CONST: stack[top++]=Interval{instr.value,instr.value}; break;
+			case PUSH_INPUT: stack[top++]=at[instr.input]; break;
+			case NEG: stack[top-1]=Interval{-stack[top-1].hi,-stack[top-1].lo}; break;
+			case ADD: top--; stack[top-1]=checked(stack[top-1].lo+stack[top].lo,stack[top-1].hi+stack[top].hi); break;
+			case SUB: top--; stack[top-1]=checked(stack[top-1].lo-stack[top].hi,stack[top-1].hi-stack[top].lo); break;
+			case MUL: top--; stack[top-1]=interval_mul(stack[top-1],stack[top]); break;
+			case DIV: top--; stack[top-1]=interval_div(stack[top-1],stack[top]); break;
+			case POW: top--; stack[top-1]=interval_pow(stack[top-1],stack[top]); break;
+			case POWI: stack[top-1]=interval_pow(stack[top-1],Interval{instr.value,instr.value}); break;
+			case SQRT: stack[top-1]=stack[top-1].lo>=0 ? Interval{sqrt(stack[top-1].lo),sqrt(stack[top-1].hi)} : Interval(); break;
+		}
+	}
+	return stack[0];
+}
+
+namespace{
+
+//terms made and reduced at a time, and the most pieces a reduction is split into over the pool
+constexpr size_t REDUCE_CHUNK=size_t(1)<<12;
+constexpr size_t REDUCE_STRIPES=64;
+
+template<bool PRODUCT>
+double combine(double a, double b){
+	return PRODUCT ? a*b : a+b;
+}
+
+//halves down to short runs, which keep eight running totals so the loop has independent lanes to vectorize
+template<bool PRODUCT>
+double pairwise(const double* values, size_t count){
+	static constexpr size_t LANES=8;
+	if(count>16*LANES){
+		size_t half=count/2/LANES*LANES;
+		return combine<PRODUCT>(pairwise<PRODUCT>(values,half),pairwise<PRODUCT>(values+half,count-half));
+	}
+	double lanes[LANES];
+	std::fill(lanes,lanes+LANES,PRODUCT ? 1.0 : 0.0);
+	size_t n=0;
+	for(;n+LANES<=count;n+=LANES){
+		for(size_t lane=0;lane<LANES;lane++){
+			lanes[lane]=combine<PRODUCT>(lanes[lane],values[n+lane]);
+		}
+	}
+	for(;n<count;n++){
+		lanes[n%LANES]=combine<PRODUCT>(lanes[n%LANES],values[n]);
+	}
+	for(size_t width=LANES/2;width>0;width/=2){
+		for(size_t lane=0;lane<width;lane++){
+			lanes[lane]=combine<PRODUCT>(lanes[lane],lanes[lane+width]);
+		}
+	}
+	return lanes[0];
+}
+
+//chunk totals combined as they come in, like carries in a binary counter, so they're reduced pairwise too
+//while holding at most one pending total per power of two
+template<bool PRODUCT>
+struct Cascade{
+	double pending[64];
+	uint64_t filled=0;
+
+	void add(double total){
+		int level=0;
+		for(;filled>>level&1;level++){
+			total=combine<PRODUCT>(pending[level],total);
+		}
+		pending[level]=total;
+		filled++;
+	}
+	double total() const {
+		double ret=PRODUCT ? 1.0 : 0.0;
+		for(int level=0;level<64;level++){
+			if(filled>>level&1){
+				ret=combine<PRODUCT>(pending[level],ret);
+			}
+		}
+		return ret;
+	}
+};
+
+//terms(begin,len,buffer) gives terms [begin,begin+len), made in buffer if they aren't already somewhere
+//stripes of whole chunks go to the pool, and their totals are reduced pairwise at the end
+template<bool PRODUCT, typename F>
+double reduce_chunks(size_t count, ThreadPool& pool, F&& terms){
+	size_t chunks=(count+REDUCE_CHUNK-1)/REDUCE_CHUNK;
+	size_t stripes=std::min(chunks,REDUCE_STRIPES);
+	vector<double> totals(stripes);
+	//the pool's threads answer to the caller's cancel flag
+	const std::atomic<bool>* cancel=eval_cancel;
+	pool.parallel_for(stripes,[&](size_t stripe){
+		vector<double> buffer(std::min(count,REDUCE_CHUNK));
+		Cascade<PRODUCT> cascade;
+		for(size_t chunk=chunks*stripe/stripes;chunk<chunks*(stripe+1)/stripes;chunk++){
+			if(cancel && cancel->load(std::memory_order_relaxed)){
+				throw EvalCancelled();
+			}
+			size_t begin=chunk*REDUCE_CHUNK;
+			size_t len=std::min(REDUCE_CHUNK,count-begin);
+			cascade.add(pairwise<PRODUCT>(terms(begin,len,buffer.data()),len));
+		}
+		totals[stripe]=cascade.total();
+	});
+	return pairwise<PRODUCT>(totals.data(),stripes);
+}
+
+template<bool PRODUCT>
+double reduce_range(const CompiledExpr& fn, int64_t lo, int64_t hi, ThreadPool& pool){
+	if(lo>hi){
+		return PRODUCT ? 1.0 : 0.0;
+	}
+	return reduce_chunks<PRODUCT>(uint64_t(hi)-uint64_t(lo)+1,pool,[&](size_t begin, size_t len, double* out){
+		vector<double> at(len);
+		for(size_t n=0;n<len;n++){
+			at[n]=double(lo+int64_t(begin+n));
+		}
+		const double* column=at.data();
+		fn.evaluate_batch(&column,out,len);
+		return (const double*)out;
+	});
+}
+
+}
+
+double reduce_range(const CompiledExpr& fn, bool product, int64_t lo, int64_t hi, ThreadPool& pool){
+	return product ? reduce_range<true>(fn,lo,hi,pool) : reduce_range<false>(fn,lo,hi,pool);
+}
+
+double reduce_values(const double* values, size_t count, bool product, ThreadPool& pool){
+	auto terms=[&](size_t begin, size_t len, double*){ return values+begin; };
+	return product ? reduce_chunks<true>(count,pool,terms) : reduce_chunks<false>(count,pool,terms);
+}
+
+namespace{
+
+//nodes of the 15-point Kronrod rule on [-1,1], from the outermost in to the center, with their weights; every other
+//one is also a node of the 7-point Gauss rule, so one set of evaluations gives both estimates
+constexpr double KRONROD_NODES[8]={
+	0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+	0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+	0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+	0.207784955007898467600689403773245, 0.0
+};
+constexpr double KRONROD_WEIGHTS[8]={
+	0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+	0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+	0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+	0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+//for nodes 1, 3, 5 and the center
+constexpr double GAUSS_WEIGHTS[4]={
+	0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+	0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+constexpr size_t KRONROD_POINTS=15;
+//most subintervals an integral is split into before giving up on the tolerance
+constexpr size_t MAX_SUBINTERVALS=size_t(1)<<14;
+
+//an infinite bound is brought in by a change of variable, so the integral is over a finite range of t
+struct IntegralMap{
+	enum Kind{FINITE, ABOVE, BELOW, BOTH};
+	Kind kind;
+	double a,b;
+	//the range of t
+	double lo,hi;
+
+	IntegralMap(double a, double b):a(a),b(b){
+		if(std::isinf(a) && std::isinf(b)){
+			kind=BOTH; lo=-1; hi=1;
+		}else if(std::isinf(b)){
+			kind=ABOVE; lo=0; hi=1;
+		}else if(std::isinf(a)){
+			kind=BELOW; lo=-1; hi=0;
+		}else{
+			kind=FINITE; lo=a; hi=b;
+		}
+	}
+	double x(double t) const {
+		switch(kind){
+			case ABOVE: return a+t/(1-t);
+			case BELOW: return b+t/(1+t);
+			case BOTH: return t/(1-t*t);
+			default: return t;
+		}
+	}
+	double slope(double t) const {
+		switch(kind){
+			case ABOVE: return 1/((1-t)*(1-t));
+			case BELOW: return 1/((1+t)*(1+t));
+			case BOTH: return (1+t*t)/((1-t*t)*(1-t*t));
+			default: return 1;
+		}
+	}
+};
+
+struct Subinterval{
+	double lo,hi;
+	double value=0,error=0;
+	//the integral of the absolute value, which the tolerance is relative to
+	double absolute=0;
+};
+
+//both estimates over piece from the integrand at its points: the center, then each node's pair either side
+void gauss_kronrod(Subinterval& piece, const double* f){
+	double half=(piece.hi-piece.lo)/2;
+	double kronrod=KRONROD_WEIGHTS[7]*f[0];
+	double gauss=GAUSS_WEIGHTS[3]*f[0];
+	double absolute=KRONROD_WEIGHTS[7]*std::abs(f[0]);
+	for(int j=0;j<7;j++){
+		double pair=f[1+2*j]+f[2+2*j];
+		kronrod+=KRONROD_WEIGHTS[j]*pair;
+		absolute+=KRONROD_WEIGHTS[j]*(std::abs(f[1+2*j])+std::abs(f[2+2*j]));
+		if(j%2==1){
+			gauss+=GAUSS_WEIGHTS[j/2]*pair;
+		}
+	}
+	double mean=kronrod/2;
+	double spread=KRONROD_WEIGHTS[7]*std::abs(f[0]-mean);
+	for(int j=0;j<7;j++){
+		spread+=KRONROD_WEIGHTS[j]*(std::abs(f[1+2*j]-mean)+std::abs(f[2+2*j]-mean));
+	}
+	//scaled as QUADPACK does, as the Kronrod estimate is far better than its difference from the Gauss one suggests
+	double error=std::abs((kronrod-gauss)*half);
+	spread*=std::abs(half);
+	absolute*=std::abs(half);
+	if(spread!=0 && error!=0){
+		error=spread*std::min(1.0,std::pow(200*error/spread,1.5));
+	}
+	if(absolute>DBL_MIN/(50*DBL_EPSILON)){
+		error=std::max(50*DBL_EPSILON*absolute,error);
+	}
+	piece.value=kronrod*half;
+	piece.error=error;
+	piece.absolute=absolute;
+}
+
+}
+
+Quadrature integrate(const CompiledExpr& fn, double a, double b, double tolerance, ThreadPool& pool){
+	Quadrature ret;
+	if(std::isnan(a) || std::isnan(b)){
+		ret.value=ret.error=NAN;
+		ret.converged=false;
+		return ret;
+	}
+	if(a==b){
+		return ret;
+	}
+	if(a>b){
+		ret=integrate(fn,b,a,tolerance,pool);
+		ret.value=-ret.value;
+		return ret;
+	}
+	IntegralMap map(a,b);
+	double width=map.hi-map.lo;
+	vector<Subinterval> pending{Subinterval{map.lo,map.hi}};
+	//the subintervals already within their share of the tolerance
+	Subinterval done{map.lo,map.hi};
+	size_t done_count=0;
+	//the pool's threads answer to the caller's cancel flag
+	const std::atomic<bool>* cancel=eval_cancel;
+	while(!pending.empty()){
+		size_t stripes=std::min<size_t>(pending.size(),(pool.worker_count()+1)*4);
+		pool.parallel_for(stripes,[&](size_t stripe){
+			if(cancel && cancel->load(std::memory_order_relaxed)){
+				throw EvalCancelled();
+			}
+			size_t from=pending.size()*stripe/stripes;
+			size_t to=pending.size()*(stripe+1)/stripes;
+			vector<double> xs((to-from)*KRONROD_POINTS),f(xs.size()),slopes(xs.size());
+			for(size_t n=from;n<to;n++){
+				double center=(pending[n].lo+pending[n].hi)/2;
+				double half=(pending[n].hi-pending[n].lo)/2;
+				double* t=xs.data()+(n-from)*KRONROD_POINTS;
+				t[0]=center;
+				for(int j=0;j<7;j++){
+					t[1+2*j]=center-half*KRONROD_NODES[j];
+					t[2+2*j]=center+half*KRONROD_NODES[j];
+				}
+			}
+			if(map.kind!=IntegralMap::FINITE){
+				for(size_t k=0;k<xs.size();k++){
+					slopes[k]=map.slope(xs[k]);
+					xs[k]=map.x(xs[k]);
+				}
+			}
+			const double* column=xs.data();
+			fn.evaluate_batch(&column,f.data(),xs.size());
+			if(map.kind!=IntegralMap::FINITE){
+				for(size_t k=0;k<xs.size();k++){
+					f[k]*=slopes[k];
+				}
+			}
+			for(size_t n=from;n<to;n++){
+				gauss_kronrod(pending[n],f.data()+(n-from)*KRONROD_POINTS);
+			}
+		});
+
+		Subinterval total=done;
+		for(const Subinterval& piece : pending){
+			total.value+=piece.value;
+			total.error+=piece.error;
+			total.absolute+=piece.absolute;
+		}
+		double target=tolerance*total.absolute;
+		ret.value=total.value;
+		ret.error=total.error;
+		ret.absolute=total.absolute;
+		ret.intervals=done_count+pending.size();
+		if(!std::isfinite(total.value) || !std::isfinite(total.error)){
+			ret.converged=false;
+			return ret;
+		}
+		if(total.error<=target){
+			return ret;
+		}
+		if(done_count+2*pending.size()>MAX_SUBINTERVALS){
+			ret.converged=false;
+			return ret;
+		}
+		//what's within its share of the target is kept; the rest is halved for the next round
+		vector<Subinterval> next;
+		for(const Subinterval& piece : pending){
+			double mid=(piece.lo+piece.hi)/2;
+			if(piece.error<=target*(piece.hi-piece.lo)/width || mid<=piece.lo || mid>=piece.hi){
+				done.value+=piece.value;
+				done.error+=piece.error;
+				done.absolute+=piece.absolute;
+				done_count++;
+			}else{
+				next.push_back(Subinterval{piece.lo,mid});
+				next.push_back(Subinterval{mid,piece.hi});
+			}
+		}
+		pending=std::move(next);
+	}
+	ret.value=done.value;
+	ret.error=done.error;
+	ret.absolute=done.absolute;
+	ret.intervals=done_count;
+	ret.converged=done.error<=tolerance*done.absolute;
+	return ret;
+}
+
+double CompiledExpr::integral_between(double from, double to) const {
+	Quadrature result=integrate(*integrand,from,to);
+	return result.diverged() ? NAN : result.value;
+}
+
+//outward from where the integral starts, each point integrated to from the one before it, so a batch of nearby
+//points costs about one integral across their span; past a point the integral doesn't exist, neither does the rest
+void CompiledExpr::evaluate_antiderivative(const double* xs, double* out, size_t count) const {
+	vector<size_t> above,below;
+	for(size_t n=0;n<count;n++){
+		if(std::isnan(xs[n])){
+			out[n]=NAN;
+		}else if(xs[n]>=integral_from){
+			above.push_back(n);
+		}else{
+			below.push_back(n);
+		}
+	}
+	std::sort(above.begin(),above.end(),[&](size_t i, size_t j){ return xs[i]<xs[j]; });
+	std::sort(below.begin(),below.end(),[&](size_t i, size_t j){ return xs[i]>xs[j]; });
+	for(const vector<size_t>* order : {&above,&below}){
+		double x=integral_from;
+		double total=0;
+		for(size_t n : *order){
+			total+=integral_between(x,xs[n]);
+			x=xs[n];
+			out[n]=total;
+		}
+	}
+}
+
+std::shared_ptr<const CompiledExpr> CompileCache::find(const string& key, const Expr& ex, const vector<ID>& inputs) const {
+	auto found=entries.find(key);
+	if(found==entries.end()){
+		return nullptr;
+	}
+	for(const Entry& entry : found->second){
+		if(entry.inputs==inputs && entry.ex.same_as(ex)){
+			return entry.fn;
+		}
+	}
+	return nullptr;
+}
+
+std::shared_ptr<const CompiledExpr> CompileCache::get(const Expr& ex, const vector<ID>& inputs){
+	string key=ex.to_string(true);
+	{
+		std::lock_guard lock(mutex);
+		std::shared_ptr<const CompiledExpr> fn=find(key,ex,inputs);
+		if(fn){
+			counters.hits++;
+			return fn;
+		}
+	}
+	//compiled unlocked; if another thread got there first, theirs is kept
+	std::shared_ptr<const CompiledExpr> compiled=std::make_shared<CompiledExpr>(ex,inputs);
+	std::lock_guard lock(mutex);
+	std::shared_ptr<const CompiledExpr> fn=find(key,ex,inputs);
+	if(fn){
+		counters.hits++;
+		return fn;
+	}
+	counters.misses++;
+	entries[key].push_back(Entry{ex,inputs,compiled});
+	return compiled;
+}
+
+CompileCache::Stats CompileCache::stats(){
+	std::lock_guard lock(mutex);
+	return counters;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "expression.hpp"
+#include "thread_pool.hpp"
+
+//all the values an expression may take over a box of inputs; infinite both ways when nothing is known
+struct Interval{
+	double lo=-INFINITY,hi=INFINITY;
+
+	bool contains(double value) const { return lo<=value && value<=hi; }
+};
+
+//a scalar expression of some named inputs, flattened into a stack program over doubles so it can be
+//evaluated at many points cheaply; a tuple of scalars has one output per element, left on the stack together
+//expressions it can't flatten are evaluated through the tree instead; anything that isn't a number comes out NaN
+class CompiledExpr{
+public:
+	enum Op : uint8_t{
+		PUSH_CONST, PUSH_INPUT, NEG, ADD, SUB, MUL, DIV, POW,
+		//the top to the power of value, a whole number, or 1/2
+		POWI, SQRT
+	};
+	struct Instr{
+		Op op;
+		uint32_t input=0;
+		double value=0;
+	};
+
+	CompiledExpr(const Expr& ex, const vector<ID>& inputs);
+	CompiledExpr(const CompiledExpr&)=delete;
+	//a program compiled earlier, as saved; null if it isn't a whole program leaving outputs values on the stack
+	static std::shared_ptr<const CompiledExpr> load(const vector<ID>& inputs, vector<Instr> program, size_t outputs);
+
+	//this with its inputs from first on fixed at values, over the inputs before first; everything that depends only on
+	//constants and fixed inputs is folded into a constant here, once, so only what varies with the rest is left to run
+	//at every point; falls back to substituting into the tree and compiling again if this isn't compiled
+	std::shared_ptr<const CompiledExpr> bind(size_t first, const double* values) const;
+
+	const vector<ID>& inputs() const { return input_names; }
+	size_t outputs() const { return output_count; }
+	//false if this falls back to the tree
+	bool is_compiled() const { return compiled; }
+	const vector<Instr>& program() const { return code; }
+
+	//at holds one value per input; the first output
+	double evaluate(const double* at) const;
+	//out[n] is the first output at (columns[0][n], columns[1][n], ...)
+	void evaluate_batch(const double* const* columns, double* out, size_t count) const;
+	//as above, with outs[k][n] the kth output
+	void evaluate_batch(const double* const* columns, double* const* outs, size_t count) const;
+	//bounds the first output over the box with one interval per input; conservative, and unbounded if not compiled
+	Interval evaluate_interval(const Interval* at) const;
+
+	//whether this is an integral from a constant up to its one input, of a term of the integration variable alone,
+	//as integral # (t, 0, x, f) is; that doesn't compile, but its value anywhere follows from its value at any other
+	//point by integrating in between, so a batch is integrated from each point to the next rather than from the start
+	bool is_antiderivative() const { return integrand!=nullptr; }
+	//for an antiderivative, its value at to less its value at from
+	double integral_between(double from, double to) const;
+
+private:
+	vector<ID> input_names;
+	//the slot each input's value goes in, or -1 where an earlier input has the same name and so the value
+	vector<long> input_slots;
+	vector<Instr> code;
+	uint32_t depth=0;
+	size_t output_count=1;
+	bool compiled=false;
+
+	Expr body;
+	unique<SymbolTable> symbols;
+
+	//for an antiderivative: the term, over the integration variable, and where the integral starts
+	std::shared_ptr<const CompiledExpr> integrand;
+	double integral_from=0;
+
+	CompiledExpr(){}
+	bool compile(const Expr& ex, uint32_t& height);
+	void emit(Op op, uint32_t& height, int change, double value=0, uint32_t input=0);
+	void evaluate_tree(const double* at, double* out) const;
+	void find_antiderivative(const Expr& ex);
+	void evaluate_antiderivative(const double* xs, double* out, size_t count) const;
+};
+
+//fn's first output over its one input taking every whole number in [lo,hi], added up (or multiplied, for product);
+//the terms are made a chunk at a time and reduced pairwise, so none are kept and the rounding error grows with the log
+//of the count; long ranges are split over the pool in a way that depends only on the count, so the result doesn't
+//depend on the number of threads; answers to the calling thread's cancel flag
+double reduce_range(const CompiledExpr& fn, bool product, int64_t lo, int64_t hi, ThreadPool& pool=thread_pool);
+//as above, over count packed values
+double reduce_values(const double* values, size_t count, bool product, ThreadPool& pool=thread_pool);
+
+//a definite integral, and how far off it may be
+struct Quadrature{
+	double value=0;
+	//estimated absolute error, summed over the subintervals it ended with
+	double error=0;
+	size_t intervals=0;
+	//false if it gave up subdividing before the error was within the tolerance, or the integrand wasn't finite
+	bool converged=true;
+	//the integral of the absolute value, which the tolerance is relative to
+	double absolute=0;
+
+	//giving up this far from the tolerance, the integral most likely doesn't exist, as across a pole
+	bool diverged() const {
+		static constexpr double DIVERGED_ERROR=1e-5;
+		return !std::isfinite(value) || (!converged && !(error<=DIVERGED_ERROR*absolute));
+	}
+};
+
+//relative to the integral of the absolute value, so a term that cancels itself out still has a tolerance
+inline constexpr double INTEGRAL_TOLERANCE=1e-10;
+
+//fn's first output integrated over its one input from a to b, which may be infinite, by adaptive 15-point
+//Gauss-Kronrod quadrature: every subinterval whose error estimate is too large for its share of the tolerance is
+//halved, and each round's subintervals are evaluated together, a batch per stripe over the pool
+Quadrature integrate(const CompiledExpr& fn, double a, double b, double tolerance=INTEGRAL_TOLERANCE, ThreadPool& pool=thread_pool);
+
+//compiled expressions shared between everything compiling the same expression over the same inputs
+//entries live as long as the cache; safe to use from several threads
+class CompileCache{
+public:
+	struct Stats{
+		uint64_t hits=0;
+		uint64_t misses=0;
+	};
+
+	//the compiled form of ex over inputs, compiling it only if no equal expression has been
+	std::shared_ptr<const CompiledExpr> get(const Expr& ex, const vector<ID>& inputs);
+	Stats stats();
+
+private:
+	struct Entry{
+		Expr ex;
+		vector<ID> inputs;
+		std::shared_ptr<const CompiledExpr> fn;
+	};
+
+	std::mutex mutex;
+	//by printed form, then compared structurally, since printing rounds numbers
+	std::unordered_map<string,vector<Entry>> entries;
+	Stats counters;
+
+	std::shared_ptr<const CompiledExpr> find(const string& key, const Expr& ex, const vector<ID>& inputs) const;
+};
@@ -0,0 +1,274 @@
+#include "data_columns.hpp"
+#include "thread_pool.hpp"
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//a whole file mapped read-only, unmapped with the last reference
+struct Mapping{
+	const char* data=nullptr;
+	size_t size=0;
+
+	Mapping(const string& path){
+		int fd=open(path.c_str(),O_RDONLY);
+		if(fd<0){
+			throw DataError("can't open "+path+": "+strerror(errno));
+		}
+		struct stat info;
+		if(fstat(fd,&info)!=0 || info.st_size==0){
+			close(fd);
+			throw DataError(path+" is empty");
+		}
+		void* mapped=mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(mapped==MAP_FAILED){
+			throw DataError("can't map "+path+": "+strerror(errno));
+		}
+		data=(const char*)mapped;
+		size=info.st_size;
+	}
+	Mapping(const Mapping&)=delete;
+	~Mapping(){
+		munmap((void*)data,size);
+	}
+};
+
+static string file_stem(const string& path){
+	size_t slash=path.rfind('/');
+	string name=path.substr(slash==string::npos ? 0 : slash+1);
+	size_t dot=name.rfind('.');
+	return dot==string::npos || dot==0 ? name : name.substr(0,dot);
+}
+
+//a, b, ..., z, aa, ab, ... for n from 0; names can't hold digits
+static string letters(size_t n){
+	string ret;
+	do{
+		ret.insert(ret.begin(),char('a'+n%26));
+		n=n/26;
+	}while(n-- > 0);
+	return ret;
+}
+
+//what a definition can refer to: letters and underscores
+static string identifier(std::string_view text, size_t column){
+	string ret;
+	for(char c : text){
+		ret+=isalpha((unsigned char)c) ? c : '_';
+	}
+	if(ret.find_first_not_of('_')==string::npos){
+		return "col_"+letters(column);
+	}
+	return ret;
+}
+
+DataColumn import_binary(const string& path, bool single_precision){
+	std::shared_ptr<const Mapping> file=std::make_shared<Mapping>(path);
+	size_t width=single_precision ? sizeof(float) : sizeof(double);
+	if(file->size%width!=0){
+		throw DataError(path+" isn't a whole number of "+(single_precision ? "floats" : "doubles"));
+	}
+	size_t count=file->size/width;
+	DataColumn ret;
+	ret.name=ID(identifier(file_stem(path),0));
+	if(single_precision){
+		std::shared_ptr<double[]> values=std::make_shared_for_overwrite<double[]>(count);
+		const float* floats=(const float*)file->data;
+		for(size_t n=0;n<count;n++){
+			values[n]=floats[n];
+		}
+		ret.values=numeric_array(std::move(values),count);
+		return ret;
+	}
+	madvise((void*)file->data,file->size,MADV_WILLNEED);
+	NumericArray* arr=new NumericArray();
+	ret.values=Expr(arr);
+	arr->values=(const double*)file->data;
+	arr->count=count;
+	arr->owner=std::move(file);
+	return ret;
+}
+
+//CSV, split by lines into chunks that are read in parallel
+namespace{
+
+struct Row{
+	const char* begin;
+	const char* end;
+};
+
+//the next line in [at,end) with anything but whitespace on it, moving at past it
+bool next_row(const char*& at, const char* end, Row& row){
+	while(at<end){
+		const char* eol=(const char*)memchr(at,'\n',end-at);
+		const char* line_end=eol ? eol : end;
+		row={at,line_end};
+		at=eol ? eol+1 : end;
+		for(const char* c=row.begin;c<row.end;c++){
+			if(!isspace((unsigned char)*c)){
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+//the next field of a row, trimmed of spaces and quotes, moving at past its separator, or to null after the last
+std::string_view next_field(const char*& at, const char* end, char separator){
+	const char* sep=(const char*)memchr(at,separator,end-at);
+	const char* field_end=sep ? sep : end;
+	const char* begin=at;
+	at=sep ? sep+1 : nullptr;
+	while(begin<field_end && (isspace((unsigned char)*begin) || *begin=='"')){
+		begin++;
+	}
+	while(field_end>begin && (isspace((unsigned char)field_end[-1]) || field_end[-1]=='"')){
+		field_end--;
+	}
+	return std::string_view(begin,field_end-begin);
+}
+
+//false if the field isn't a number; an empty field is a missing one, NaN
+bool parse_number(std::string_view field, double& value){
+	value=NAN;
+	if(field.empty()){
+		return true;
+	}
+	const char* begin=field.data();
+	const char* end=begin+field.size();
+	if(*begin=='+'){
+		begin++;
+	}
+	auto [ptr,error]=std::from_chars(begin,end,value);
+	if(error==std::errc::result_out_of_range){
+		return true;
+	}
+	if(error!=std::errc() || ptr!=end){
+		value=NAN;
+		return false;
+	}
+	return true;
+}
+
+}
+
+vector<DataColumn> import_csv(const string& path){
+	Mapping file(path);
+	const char* at=file.data;
+	const char* end=file.data+file.size;
+
+	Row first;
+	if(!next_row(at,end,first)){
+		throw DataError(path+" has no rows");
+	}
+	char separator=',';
+	if(!memchr(first.begin,',',first.end-first.begin)){
+		if(memchr(first.begin,'\t',first.end-first.begin)){
+			separator='\t';
+		}else if(memchr(first.begin,';',first.end-first.begin)){
+			separator=';';
+		}
+	}
+	//a header is a first row with something that isn't a number in it
+	vector<std::string_view> fields;
+	bool header=false;
+	for(const char* field_at=first.begin;field_at;){
+		fields.push_back(next_field(field_at,first.end,separator));
+		double unused;
+		header=header || !parse_number(fields.back(),unused);
+	}
+	const char* body=header ? at : first.begin;
+	size_t columns=fields.size();
+
+	//each chunk starts after a newline, so rows never straddle two
+	static constexpr size_t CHUNK_BYTES=size_t(1)<<20;
+	vector<const char*> bounds{body};
+	while(end-bounds.back()>(ptrdiff_t)CHUNK_BYTES){
+		const char* eol=(const char*)memchr(bounds.back()+CHUNK_BYTES,'\n',end-bounds.back()-CHUNK_BYTES);
+		if(!eol){
+			break;
+		}
+		bounds.push_back(eol+1);
+	}
+	bounds.push_back(end);
+	size_t chunks=bounds.size()-1;
+
+	//rows per chunk first, so every chunk knows where its rows go in the columns
+	vector<size_t> first_row(chunks+1,0);
+	thread_pool.parallel_for(chunks,[&](size_t chunk){
+		const char* row_at=bounds[chunk];
+		Row row;
+		size_t rows=0;
+		while(next_row(row_at,bounds[chunk+1],row)){
+			rows++;
+		}
+		first_row[chunk+1]=rows;
+	});
+	for(size_t chunk=0;chunk<chunks;chunk++){
+		first_row[chunk+1]+=first_row[chunk];
+	}
+	size_t rows=first_row[chunks];
+
+	vector<std::shared_ptr<double[]>> values(columns);
+	for(std::shared_ptr<double[]>& column : values){
+		column=std::make_shared_for_overwrite<double[]>(rows);
+	}
+	thread_pool.parallel_for(chunks,[&](size_t chunk){
+		const char* row_at=bounds[chunk];
+		Row row;
+		for(size_t n=first_row[chunk];next_row(row_at,bounds[chunk+1],row);n++){
+			const char* field_at=row.begin;
+			for(size_t column=0;column<columns;column++){
+				if(!field_at){
+					values[column][n]=NAN;
+					continue;
+				}
+				parse_number(next_field(field_at,row.end,separator),values[column][n]);
+			}
+		}
+	});
+
+	vector<DataColumn> ret(columns);
+	std::unordered_map<string,int> used;
+	for(size_t column=0;column<columns;column++){
+		string name=header ? identifier(fields[column],column) : "col_"+letters(column);
+		//repeats are lettered, so each column can be referred to
+		if(int repeats=used[name]++){
+			name+="_"+letters(repeats);
+		}
+		ret[column].name=ID(name);
+		ret[column].values=numeric_array(std::move(values[column]),rows);
+	}
+	return ret;
+}
+
+vector<DataColumn> import_file(const string& path){
+	size_t dot=path.rfind('.');
+	string extension=dot==string::npos ? "" : path.substr(dot+1);
+	for(char& c : extension){
+		c=tolower((unsigned char)c);
+	}
+	if(extension=="csv" || extension=="tsv" || extension=="txt"){
+		return import_csv(path);
+	}
+	return {import_binary(path,extension=="f32")};
+}
+
+void DataColumns::add(ID name, Expr values){
+	std::lock_guard lock(mutex);
+	columns[name].node=std::move(values.node);
+}
+
+Expr DataColumns::find(ID name) const {
+	std::lock_guard lock(mutex);
+	auto found=columns.find(name);
+	return found==columns.end() ? Expr() : found->second;
+}
+
+bool DataColumns::has(ID name) const {
+	std::lock_guard lock(mutex);
+	return columns.count(name);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include "expression.hpp"
+
+struct DataError{
+	string what;
+	DataError(string what):what(what){}
+};
+
+//a column of numbers from a file, as a NumericArray
+struct DataColumn{
+	ID name;
+	Expr values;
+};
+
+//every column of a CSV file, parsed in parallel chunks straight into packed buffers
+//named by the header row if there is one (made into identifiers), or col_a, col_b, ... if not;
+//fields that aren't numbers, and missing ones, are NaN; throws DataError
+vector<DataColumn> import_csv(const string& path);
+//a file of raw native-endian numbers, named after the file: doubles are mapped and used in place,
+//floats are widened into a buffer; throws DataError
+DataColumn import_binary(const string& path, bool single_precision=false);
+//by extension: .csv as CSV, .f32 as floats, anything else as doubles
+vector<DataColumn> import_file(const string& path);
+
+//imported columns by name; a name no definition defines evaluates to its column
+class DataColumns{
+public:
+	//replaces any column of the same name
+	void add(ID name, Expr values);
+	//the column's values, sharing its buffer, or undefined if there's no such column
+	Expr find(ID name) const;
+	bool has(ID name) const;
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<ID,Expr> columns;
+};
+
+inline DataColumns data_columns;
@@ -0,0 +1,487 @@
+#include "definition_graph.hpp"
+#include "data_columns.hpp"
+#include "metrics.hpp"
+#include "parameters.hpp"
+#include <algorithm>
+#include <cstdio>
+
+vector<uint64_t> DefinitionGraph::Plan::owners() const {
+	vector<uint64_t> ret;
+	for(const vector<uint64_t>& level : levels){
+		ret.insert(ret.end(),level.begin(),level.end());
+	}
+	ret.insert(ret.end(),cyclic.begin(),cyclic.end());
+	return ret;
+}
+
+//'name = expr' defines name, unless name is a coordinate; the body points into the parse rather than copying it
+static void split_definition(const std::shared_ptr<const Expr>& parsed, ID& name, std::shared_ptr<const Expr>& body){
+	body=parsed;
+	if(parsed->type()!=Equal::type || parsed->node->subexprs.size()!=2){
+		return;
+	}
+	const Expr& lhs=parsed->node->subexprs.front();
+	const Expr& rhs=parsed->node->subexprs.back();
+	if(lhs.type()!=Variable::type){
+		return;
+	}
+	ID lhs_name=dynamic_cast<const Variable*>(lhs.node.get())->name;
+	if(lhs_name.view()=="x"){
+		return;
+	}
+	if(lhs_name.view()=="y"){
+		//a curve over x, unless y is on both sides
+		if(!rhs.find_vars().count(lhs_name)){
+			body=std::shared_ptr<const Expr>(parsed,&rhs);
+		}
+		return;
+	}
+	name=lhs_name;
+	body=std::shared_ptr<const Expr>(parsed,&rhs);
+}
+
+DefinitionGraph::Plan DefinitionGraph::update(uint64_t owner, std::shared_ptr<const Expr> parsed){
+	Definition def;
+	def.parsed=std::move(parsed);
+	split_definition(def.parsed,def.name,def.body);
+	def.uses=def.body->find_vars();
+	return replace(owner,std::move(def));
+}
+
+void DefinitionGraph::restore(uint64_t owner, std::shared_ptr<const Expr> parsed, const Expr& value, const string& message,
+		std::shared_ptr<const CompiledExpr> plot_fn, PlotKind plot_kind){
+	if(defs.count(owner)){
+		unlink(owner);
+		defs.erase(owner);
+	}
+	Definition& def=defs[owner];
+	def.parsed=std::move(parsed);
+	split_definition(def.parsed,def.name,def.body);
+	def.uses=def.body->find_vars();
+	def.value=value;
+	def.failed=!value.defined();
+	def.message=message;
+	if(plot_fn){
+		def.plot_fn=std::move(plot_fn);
+		def.plot_kind=plot_kind;
+	}else{
+		finish(def);
+	}
+	dirty.erase(owner);
+	link(owner);
+}
+
+DefinitionGraph::Plan DefinitionGraph::update_failed(uint64_t owner, const string& reason){
+	Definition def;
+	def.parse_error=reason;
+	return replace(owner,std::move(def));
+}
+
+DefinitionGraph::Plan DefinitionGraph::replace(uint64_t owner, Definition def){
+	std::unordered_set<uint64_t> affected=dirty;
+	affected.insert(owner);
+	auto old=defs.find(owner);
+	if(old!=defs.end()){
+		if(old->second.name){
+			add_dependents(old->second.name,affected);
+		}
+		unlink(owner);
+	}
+	if(def.name){
+		add_dependents(def.name,affected);
+	}
+	defs[owner]=std::move(def);
+	link(owner);
+	return plan(affected);
+}
+
+DefinitionGraph::Plan DefinitionGraph::remove(uint64_t owner){
+	std::unordered_set<uint64_t> affected=dirty;
+	auto old=defs.find(owner);
+	if(old==defs.end()){
+		return plan(affected);
+	}
+	if(old->second.name){
+		add_dependents(old->second.name,affected);
+	}
+	unlink(owner);
+	defs.erase(owner);
+	dirty.erase(owner);
+	affected.erase(owner);
+	return plan(affected);
+}
+
+DefinitionGraph::Plan DefinitionGraph::touch(const vector<ID>& names){
+	std::unordered_set<uint64_t> affected=dirty;
+	for(ID name : names){
+		add_dependents(name,affected);
+	}
+	return plan(affected);
+}
+
+DefinitionGraph::Plan DefinitionGraph::everything() const {
+	std::unordered_set<uint64_t> affected;
+	for(const auto& [owner,def] : defs){
+		affected.insert(owner);
+	}
+	return plan(affected);
+}
+
+const DefinitionGraph::Definition* DefinitionGraph::find(uint64_t owner) const {
+	auto found=defs.find(owner);
+	return found==defs.end() ? nullptr : &found->second;
+}
+
+//x and y stay the plane's coordinates, whatever is imported
+static bool is_coordinate(ID name){
+	return name.view()=="x" || name.view()=="y";
+}
+
+void DefinitionGraph::unlink(uint64_t owner){
+	const Definition& def=defs.at(owner);
+	if(def.name){
+		vector<uint64_t>& owners=definers[def.name];
+		owners.erase(std::find(owners.begin(),owners.end(),owner));
+		if(owners.empty()){
+			definers.erase(def.name);
+		}
+	}
+	for(ID name : def.uses){
+		auto found=users.find(name);
+		found->second.erase(owner);
+		if(found->second.empty()){
+			users.erase(found);
+		}
+	}
+}
+
+void DefinitionGraph::link(uint64_t owner){
+	const Definition& def=defs.at(owner);
+	if(def.name){
+		definers[def.name].push_back(owner);
+	}
+	for(ID name : def.uses){
+		users[name].insert(owner);
+	}
+}
+
+//everything using name, directly or through other definitions
+void DefinitionGraph::add_dependents(ID name, std::unordered_set<uint64_t>& affected) const {
+	vector<ID> names{name};
+	while(!names.empty()){
+		ID next=names.back();
+		names.pop_back();
+		auto found=users.find(next);
+		if(found==users.end()){
+			continue;
+		}
+		for(uint64_t user : found->second){
+			if(affected.insert(user).second){
+				ID defined=defs.at(user).name;
+				if(defined){
+					names.push_back(defined);
+				}
+			}
+		}
+	}
+}
+
+//levels by Kahn's algorithm over just the affected definitions; whatever never frees up is on or behind a cycle
+DefinitionGraph::Plan DefinitionGraph::plan(const std::unordered_set<uint64_t>& affected) const {
+	std::unordered_map<uint64_t,int> waiting;
+	std::unordered_map<uint64_t,vector<uint64_t>> unblocks;
+	for(uint64_t owner : affected){
+		waiting[owner]=0;
+	}
+	for(uint64_t owner : affected){
+		for(ID name : defs.at(owner).uses){
+			auto found=definers.find(name);
+			if(found==definers.end()){
+				continue;
+			}
+			for(uint64_t definer : found->second){
+				if(affected.count(definer)){
+					waiting[owner]++;
+					unblocks[definer].push_back(owner);
+				}
+			}
+		}
+	}
+
+	Plan ret;
+	vector<uint64_t> ready;
+	for(auto [owner,count] : waiting){
+		if(count==0){
+			ready.push_back(owner);
+		}
+	}
+	while(!ready.empty()){
+		std::sort(ready.begin(),ready.end());
+		vector<uint64_t> next;
+		for(uint64_t owner : ready){
+			auto found=unblocks.find(owner);
+			if(found==unblocks.end()){
+				continue;
+			}
+			for(uint64_t user : found->second){
+				if(--waiting[user]==0){
+					next.push_back(user);
+				}
+			}
+		}
+		ret.levels.push_back(std::move(ready));
+		ready=std::move(next);
+	}
+	for(auto [owner,count] : waiting){
+		if(count>0){
+			ret.cyclic.push_back(owner);
+		}
+	}
+	std::sort(ret.cyclic.begin(),ret.cyclic.end());
+	return ret;
+}
+
+void DefinitionGraph::recompute(const Plan& plan, ThreadPool& pool, const std::function<bool(uint64_t,Definition&)>& evaluate_first){
+	//the pool's threads answer to the caller's cancel flag too
+	const std::atomic<bool>* cancel=eval_cancel;
+	vector<uint64_t> owners=plan.owners();
+	dirty.insert(owners.begin(),owners.end());
+	for(const vector<uint64_t>& level : plan.levels){
+		pool.parallel_for(level.size(),[&](size_t n){
+			const std::atomic<bool>* outer=eval_cancel;
+			double* outer_error=eval_error;
+			eval_cancel=cancel;
+			metric_entry=level[n];
+			try{
+				Definition& def=defs.at(level[n]);
+				def.error=0;
+				eval_error=&def.error;
+				if(!evaluate_first || !evaluate_first(level[n],def)){
+					resolve(def);
+				}
+				eval_error=outer_error;
+				if(def.error>0 && !def.failed){
+					char bound[32];
+					snprintf(bound,sizeof(bound)," ± %.2g",def.error);
+					def.message+=bound;
+				}
+				finish(def);
+			}catch(...){
+				eval_cancel=outer;
+				eval_error=outer_error;
+				throw;
+			}
+			eval_cancel=outer;
+		});
+		for(uint64_t owner : level){
+			dirty.erase(owner);
+		}
+	}
+
+	std::unordered_set<uint64_t> stuck(plan.cyclic.begin(),plan.cyclic.end());
+	for(uint64_t owner : plan.cyclic){
+		Definition& def=defs.at(owner);
+		def.value.node.reset();
+		def.failed=true;
+		def.message=cycle_message(owner,stuck);
+		def.plot_fn.reset();
+		def.points.reset();
+		def.params.clear();
+		dirty.erase(owner);
+	}
+}
+
+const DefinitionGraph::Definition* DefinitionGraph::definer_of(ID name, string& error) const {
+	auto found=definers.find(name);
+	if(found==definers.end()){
+		return nullptr;
+	}
+	if(found->second.size()>1){
+		error=string(name)+" is defined more than once";
+		return nullptr;
+	}
+	const Definition& def=defs.at(found->second.front());
+	if(def.failed){
+		error="depends on "+string(name)+", which has an error";
+		return nullptr;
+	}
+	return &def;
+}
+
+bool DefinitionGraph::bind_uses(Definition& def, SymbolTable& names, Bindings& values) const {
+	for(ID name : def.uses){
+		string error;
+		const Definition* dep=definer_of(name,error);
+		if(!error.empty()){
+			def.value.node.reset();
+			def.failed=true;
+			def.message=error;
+			return false;
+		}
+		if(dep){
+			uint32_t slot=names.add(name);
+			values.values.resize(names.size());
+			values[slot]=dep->value;
+		}else if(!is_coordinate(name)){
+			Expr column=data_columns.find(name);
+			if(column.defined()){
+				uint32_t slot=names.add(name);
+				values.values.resize(names.size());
+				values[slot]=std::move(column);
+			}
+		}
+	}
+	return true;
+}
+
+//substitutes the values of the definitions it uses, and of imported columns no definition names, then evaluates
+void DefinitionGraph::resolve(Definition& def) const {
+	def.value.node.reset();
+	def.failed=false;
+	if(!def.parse_error.empty()){
+		def.failed=true;
+		def.message=def.parse_error;
+		return;
+	}
+
+	SymbolTable names;
+	Bindings values(names);
+	if(!bind_uses(def,names,values)){
+		return;
+	}
+	//evaluated in place when there's nothing to substitute
+	const Expr* resolved=def.body.get();
+	Expr substituted;
+	if(names.size()){
+		substituted=def.body->substitute(values);
+		resolved=&substituted;
+	}
+
+	try{
+		{
+			StageTimer timer(STAGE_EVALUATE);
+			def.value=resolved->evaluate();
+		}
+		StageTimer timer(STAGE_TO_STRING);
+		def.message=def.value.to_string(true);
+	}catch(ExprError err){
+		def.failed=true;
+		def.message=err.what;
+	}
+}
+
+//the inputs of a function over the plane: x then y if they're all it uses, or else its two variables in order
+static bool plane_inputs(const set<ID>& vars, vector<ID>& inputs){
+	const ID& x=coordinate_x;
+	const ID& y=coordinate_y;
+	if(!vars.empty() && vars.size()<=2 && std::all_of(vars.begin(),vars.end(),[&](ID name){ return name==x || name==y; })){
+		inputs={x,y};
+		return true;
+	}
+	if(vars.size()==2){
+		inputs.assign(vars.begin(),vars.end());
+		return true;
+	}
+	return false;
+}
+
+std::shared_ptr<const CompiledExpr> DefinitionGraph::compile(const Expr& ex, const vector<ID>& inputs) const {
+	if(compiled){
+		return compiled->get(ex,inputs);
+	}
+	return std::make_shared<CompiledExpr>(ex,inputs);
+}
+
+void DefinitionGraph::finish(Definition& def) const {
+	def.plot_fn.reset();
+	def.points.reset();
+	def.params.clear();
+	def.plot_kind=PLOT_CURVE;
+	if(def.failed){
+		return;
+	}
+	set<ID> vars=def.value.find_vars();
+	//parameters are bound in by value later, so it plots as whatever the rest make it
+	for(auto it=vars.begin();it!=vars.end();){
+		if(!is_coordinate(*it) && parameters.has(*it)){
+			def.params.push_back(*it);
+			it=vars.erase(it);
+		}else{
+			it++;
+		}
+	}
+	auto compile_plot=[&](const Expr& ex, vector<ID> inputs){
+		inputs.insert(inputs.end(),def.params.begin(),def.params.end());
+		return compile(ex,inputs);
+	};
+	if(vars.empty()){
+		if(!def.params.empty()){
+			return;
+		}
+		def.points=point_set(def.value);
+		if(def.points){
+			def.plot_kind=PLOT_SCATTER;
+		}
+		return;
+	}
+	const deque<Expr>& sides=def.value.node->subexprs;
+	vector<ID> inputs;
+	if(def.value.type()==Equal::type && sides.size()==2 && sides.front().defined()){
+		//an equation is traced as the zero set of the difference of its sides
+		if(plane_inputs(vars,inputs)){
+			Sub* difference=new Sub();
+			difference->subexprs={sides.front(),sides.back()};
+			def.plot_fn=compile_plot(Expr(difference),inputs);
+			def.plot_kind=PLOT_IMPLICIT;
+		}
+	}else if(def.value.type()==Tuple::type){
+		if(vars.size()==1 && sides.size()==2){
+			def.plot_fn=compile_plot(def.value,vector<ID>(vars.begin(),vars.end()));
+			def.plot_kind=PLOT_PARAMETRIC;
+		}
+	}else if(vars.size()==1){
+		def.plot_fn=compile_plot(def.value,vector<ID>(vars.begin(),vars.end()));
+	}else if(vars.size()==2 && plane_inputs(vars,inputs)){
+		def.plot_fn=compile_plot(def.value,inputs);
+		def.plot_kind=PLOT_HEATMAP;
+	}
+}
+
+//names the cycle owner is on, or the one it depends on
+string DefinitionGraph::cycle_message(uint64_t owner, const std::unordered_set<uint64_t>& stuck) const {
+	//breadth first through stuck dependencies, looking for a way back to owner
+	std::unordered_map<uint64_t,uint64_t> came_from;
+	vector<uint64_t> frontier{owner};
+	uint64_t first_stuck=0;
+	while(!frontier.empty()){
+		vector<uint64_t> next;
+		for(uint64_t at : frontier){
+			for(ID name : defs.at(at).uses){
+				auto found=definers.find(name);
+				if(found==definers.end()){
+					continue;
+				}
+				for(uint64_t dep : found->second){
+					if(!stuck.count(dep)){
+						continue;
+					}
+					if(!first_stuck){
+						first_stuck=dep;
+					}
+					if(dep==owner){
+						string path=string(defs.at(owner).name);
+						for(uint64_t step=at;step!=owner;step=came_from.at(step)){
+							path=string(defs.at(step).name)+" → "+path;
+						}
+						return "circular definition: "+string(defs.at(owner).name)+" → "+path;
+					}
+					if(came_from.emplace(dep,at).second){
+						next.push_back(dep);
+					}
+				}
+			}
+		}
+		frontier=std::move(next);
+	}
+	return "depends on a circular definition of "+string(defs.at(first_stuck).name);
+}
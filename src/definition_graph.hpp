@@ -0,0 +1,98 @@
+#pragma once
+#include <unordered_set>
+#include "plot.hpp"
+#include "thread_pool.hpp"
+
+//definitions linked through the names they define and use, so an edit only recomputes what depends on it
+//an entry of the form 'name = expr' defines name as expr; everything else defines nothing
+//x and y are the plane's coordinates and can't be defined: 'y = expr' is just expr, as a curve over x
+//a name no definition defines means the imported data column of that name, if there is one,
+//and a parameter stays a free variable, for its value to be bound into the plot function later
+class DefinitionGraph{
+public:
+	struct Definition{
+		//the text's parse, null if it didn't parse; shared with the parse cache and whoever gets the results
+		std::shared_ptr<const Expr> parsed;
+		//empty if it defines nothing
+		ID name;
+		//within parsed
+		std::shared_ptr<const Expr> body;
+		set<ID> uses;
+		//why it didn't parse, if it didn't
+		string parse_error;
+
+		//from the last recompute: the body with its dependencies substituted, evaluated
+		Expr value;
+		bool failed=false;
+		//the value, or what went wrong; followed by the estimated error if it took numerical integrals
+		string message;
+		//estimated absolute error of the numerical integrals it took, or 0
+		double error=0;
+		//what to plot, if anything: a curve over its one free variable, a parametric curve if it's a pair of one variable,
+		//for an equation in x and y (or two others), the difference of its sides, and otherwise a heatmap over two
+		std::shared_ptr<const CompiledExpr> plot_fn;
+		PlotKind plot_kind=PLOT_CURVE;
+		//or, for a value with no free variables that's a set of points, those points, as PLOT_SCATTER
+		std::shared_ptr<const PointSet> points;
+		//free variables that are parameters; plot_fn takes them after its usual inputs, to be bound by Parameters::bind
+		vector<ID> params;
+	};
+
+	//what to recompute after a change: levels in dependency order, each free of dependencies within itself,
+	//and the definitions stuck on or behind a cycle
+	struct Plan{
+		vector<vector<uint64_t>> levels;
+		vector<uint64_t> cyclic;
+
+		vector<uint64_t> owners() const;
+	};
+
+	//compiles plot functions through compiled, if given, so graphs sharing it share functions too
+	DefinitionGraph(CompileCache* compiled=nullptr):compiled(compiled){}
+
+	//replaces owner's definition; the plan covers it and everything depending on its old or new name
+	Plan update(uint64_t owner, std::shared_ptr<const Expr> parsed);
+	//as update, for text that didn't parse
+	Plan update_failed(uint64_t owner, const string& reason);
+	//drops owner's definition; the plan covers what depended on it
+	Plan remove(uint64_t owner);
+	//puts back a definition as computed earlier, along with everything it was computed with, without recomputing it
+	//or its dependents; plot_fn is compiled from value if not given
+	void restore(uint64_t owner, std::shared_ptr<const Expr> parsed, const Expr& value, const string& message,
+		std::shared_ptr<const CompiledExpr> plot_fn, PlotKind plot_kind);
+	//covers everything using names, as when what they mean changes outside the graph (as with imported data)
+	Plan touch(const vector<ID>& names);
+	//covers every definition, for recomputing many added at once
+	Plan everything() const;
+
+	//runs the plan, evaluating each level's definitions in parallel on the pool
+	//evaluate_first may evaluate a definition itself (setting value, failed and message) and return true,
+	//or return false to have it done here
+	//if evaluation is cancelled, whatever the plan didn't get to is added to the next one
+	void recompute(const Plan& plan, ThreadPool& pool, const std::function<bool(uint64_t,Definition&)>& evaluate_first);
+
+	const Definition* find(uint64_t owner) const;
+	//binds the names def uses to the values of the definitions defining them, or to imported columns, adding them to
+	//names as they're bound; false, with def failed and the reason in its message, if a definition it uses has an error
+	bool bind_uses(Definition& def, SymbolTable& names, Bindings& values) const;
+
+private:
+	CompileCache* compiled;
+	std::unordered_map<uint64_t,Definition> defs;
+	std::unordered_map<ID,vector<uint64_t>> definers;
+	std::unordered_map<ID,std::unordered_set<uint64_t>> users;
+	//left over from a cancelled recompute
+	std::unordered_set<uint64_t> dirty;
+
+	Plan replace(uint64_t owner, Definition def);
+	void unlink(uint64_t owner);
+	void link(uint64_t owner);
+	void add_dependents(ID name, std::unordered_set<uint64_t>& affected) const;
+	Plan plan(const std::unordered_set<uint64_t>& affected) const;
+	//the single definer of name, or null with the reason in error
+	const Definition* definer_of(ID name, string& error) const;
+	void resolve(Definition& def) const;
+	void finish(Definition& def) const;
+	std::shared_ptr<const CompiledExpr> compile(const Expr& ex, const vector<ID>& inputs) const;
+	string cycle_message(uint64_t owner, const std::unordered_set<uint64_t>& stuck) const;
+};
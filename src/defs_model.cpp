@@ -0,0 +1,107 @@
+#include "defs_model.hpp"
+#include <bit>
+
+const PlotStyle& palette_style(size_t n){
+	static const PlotStyle palette[]={
+		{0.15,0.35,0.85}, {0.85,0.2,0.15}, {0.1,0.6,0.25},
+		{0.55,0.25,0.75}, {0.9,0.55,0.1}, {0.1,0.6,0.7},
+	};
+	return palette[n%(sizeof(palette)/sizeof(palette[0]))];
+}
+
+size_t DefsModel::count_before(size_t slot) const {
+	size_t ret=0;
+	for(size_t i=slot;i>0;i-=i&-i){
+		ret+=tree[i];
+	}
+	return ret;
+}
+
+DefsModel::Definition& DefsModel::append(const string& text){
+	if(tree.empty()){
+		tree.push_back(0);
+	}
+	size_t slot=slots.size();
+	slots.push_back(std::make_unique<Definition>(++next_id));
+	Definition& def=*slots.back();
+	def.text=text;
+	def.style=palette_style(colors++);
+	slot_of[def.id]=slot;
+
+	//the new node covers itself and the nodes it's the parent of, all just before it
+	size_t i=slot+1;
+	tree.push_back(1+count_before(i-1)-count_before(i-(i&-i)));
+	live++;
+	return def;
+}
+
+bool DefsModel::remove(uint64_t id, size_t& position){
+	auto found=slot_of.find(id);
+	if(found==slot_of.end()){
+		return false;
+	}
+	size_t slot=found->second;
+	position=count_before(slot);
+	slot_of.erase(found);
+	slots[slot].reset();
+	for(size_t i=slot+1;i<tree.size();i+=i&-i){
+		tree[i]--;
+	}
+	live--;
+	size_t dead=slots.size()-live;
+	if(dead>64 && dead>live){
+		compact();
+	}
+	return true;
+}
+
+void DefsModel::clear(){
+	slots.clear();
+	tree.clear();
+	slot_of.clear();
+	live=0;
+}
+
+//drops the removed slots and rebuilds the tree over the rest, in linear time
+void DefsModel::compact(){
+	std::erase(slots,nullptr);
+	slot_of.clear();
+	tree.assign(slots.size()+1,1);
+	tree[0]=0;
+	for(size_t slot=0;slot<slots.size();slot++){
+		slot_of[slots[slot]->id]=slot;
+		size_t i=slot+1;
+		size_t parent=i+(i&-i);
+		if(parent<tree.size()){
+			tree[parent]+=tree[i];
+		}
+	}
+}
+
+DefsModel::Definition* DefsModel::find(uint64_t id){
+	auto found=slot_of.find(id);
+	return found==slot_of.end() ? nullptr : slots[found->second].get();
+}
+
+const DefsModel::Definition* DefsModel::find(uint64_t id) const {
+	auto found=slot_of.find(id);
+	return found==slot_of.end() ? nullptr : slots[found->second].get();
+}
+
+size_t DefsModel::position_of(uint64_t id) const {
+	return count_before(slot_of.at(id));
+}
+
+//descends the tree for the slot with exactly position live slots before it
+DefsModel::Definition& DefsModel::at(size_t position){
+	size_t n=slots.size();
+	size_t i=0;
+	size_t remaining=position+1;
+	for(size_t step=std::bit_floor(n);step>0;step>>=1){
+		if(i+step<=n && tree[i+step]<remaining){
+			i+=step;
+			remaining-=tree[i];
+		}
+	}
+	return *slots.at(i);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include "plot.hpp"
+
+//the color the nth definition takes, around a fixed palette
+const PlotStyle& palette_style(size_t n);
+
+//the definitions panel's contents in order, apart from any widgets showing them
+//positions are kept in a Fenwick tree over append order, so finding, removing and numbering by position are
+//logarithmic; removed slots are compacted away once they outnumber the live ones
+class DefsModel{
+public:
+	struct Definition{
+		//names the definition to the evaluator and the tile cache; never reused
+		const uint64_t id;
+		string text;
+		//the value, or what went wrong
+		string message;
+		//of the latest text sent to the evaluator; older results are ignored
+		uint64_t generation=0;
+		//of the latest result taken; message and what follows are up to date with text when this is generation
+		uint64_t evaluated=0;
+		//the text's parse, shared with the worker, and its value; null or undefined where those failed
+		std::shared_ptr<const Expr> parse;
+		Expr value;
+		//what it plots as, if anything
+		std::shared_ptr<const CompiledExpr> plot_fn;
+		PlotKind plot_kind=PLOT_CURVE;
+		std::shared_ptr<const PointSet> points;
+		//the parameters plot_fn takes last, and plot_fn with their current values bound in, which is what's drawn
+		vector<ID> params;
+		std::shared_ptr<const CompiledExpr> bound_fn;
+		//bumps whenever what it draws changes
+		uint64_t revision=0;
+		PlotStyle style;
+		bool shown=true;
+		//for a curve: whether its zeros are marked, and the other curves its intersections with are marked, by id
+		bool mark_zeros=false;
+		set<uint64_t> crossings;
+
+		Definition(uint64_t id):id(id){}
+		bool plotted() const { return (plot_fn || points) && shown; }
+		bool current() const { return generation!=0 && evaluated==generation; }
+	};
+
+	//adds a definition at the end, with the next palette color
+	Definition& append(const string& text="");
+	//position is where it was; false if there's no such definition
+	bool remove(uint64_t id, size_t& position);
+	void clear();
+
+	Definition* find(uint64_t id);
+	const Definition* find(uint64_t id) const;
+	//position of a definition that's in the model
+	size_t position_of(uint64_t id) const;
+	Definition& at(size_t position);
+	size_t size() const { return live; }
+
+	//fn(definition) for each, in order
+	template<typename F>
+	void for_each(F&& fn) const {
+		for(const unique<Definition>& def : slots){
+			if(def){
+				fn(*def);
+			}
+		}
+	}
+	template<typename F>
+	void for_each(F&& fn){
+		for(unique<Definition>& def : slots){
+			if(def){
+				fn(*def);
+			}
+		}
+	}
+
+private:
+	//by append order, null once removed
+	vector<unique<Definition>> slots;
+	//1-based; tree[i] counts the live slots in (i-lowbit(i), i]
+	vector<uint32_t> tree;
+	std::unordered_map<uint64_t,size_t> slot_of;
+	size_t live=0;
+	uint64_t next_id=0;
+	size_t colors=0;
+
+	//live slots before slot
+	size_t count_before(size_t slot) const;
+	void compact();
+};
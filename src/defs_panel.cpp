@@ -1,7 +1,29 @@
+#include "data_columns.hpp"
+#include "metrics.hpp"
+#include "parameters.hpp"
 #include "parser.hpp"
+#include "snapshot.hpp"
 #include "ui.hpp"
 #include <string>
 
+// a definition's place in the list store; the model holds the rest
+struct DefsItem {
+	GObject parent;
+	uint64_t id;
+};
+struct DefsItemClass {
+	GObjectClass parent_class;
+};
+G_DEFINE_TYPE(DefsItem, defs_item, G_TYPE_OBJECT)
+static void defs_item_init(DefsItem *) {}
+static void defs_item_class_init(DefsItemClass *) {}
+
+static DefsItem *defs_item_new(uint64_t id) {
+	DefsItem *item = (DefsItem *)g_object_new(defs_item_get_type(), NULL);
+	item->id = id;
+	return item;
+}
+
 void DefsPanel::init() {
 	frame = GTK_FRAME(gtk_frame_new(NULL));
 	gtk_widget_set_size_request(GTK_WIDGET(frame),0,0);
@@ -15,6 +37,28 @@ void DefsPanel::init() {
 	g_signal_connect(header.add_button, "clicked",
 									 G_CALLBACK(DefsPanel::_on_add_button_press), NULL);
 	gtk_box_append(header.hbox, GTK_WIDGET(header.add_button));
+	header.open_button =
+	GTK_BUTTON(gtk_button_new_from_icon_name("document-open-symbolic"));
+	widget_set_margin(GTK_WIDGET(header.open_button), 4);
+	gtk_widget_set_tooltip_text(GTK_WIDGET(header.open_button), "Open workspace");
+	g_signal_connect(header.open_button, "clicked",
+									 G_CALLBACK(DefsPanel::_on_open_button_press), NULL);
+	gtk_box_append(header.hbox, GTK_WIDGET(header.open_button));
+	header.save_button =
+	GTK_BUTTON(gtk_button_new_from_icon_name("document-save-symbolic"));
+	widget_set_margin(GTK_WIDGET(header.save_button), 4);
+	gtk_widget_set_tooltip_text(GTK_WIDGET(header.save_button), "Save workspace");
+	g_signal_connect(header.save_button, "clicked",
+									 G_CALLBACK(DefsPanel::_on_save_button_press), NULL);
+	gtk_box_append(header.hbox, GTK_WIDGET(header.save_button));
+	header.import_button =
+	GTK_BUTTON(gtk_button_new_from_icon_name("insert-object-symbolic"));
+	widget_set_margin(GTK_WIDGET(header.import_button), 4);
+	gtk_widget_set_tooltip_text(GTK_WIDGET(header.import_button),
+															"Import data (CSV, or raw doubles or .f32 floats)");
+	g_signal_connect(header.import_button, "clicked",
+									 G_CALLBACK(DefsPanel::_on_import_button_press), NULL);
+	gtk_box_append(header.hbox, GTK_WIDGET(header.import_button));
 	gtk_box_append(vbox, GTK_WIDGET(header.hbox));
 
 	separator = GTK_SEPARATOR(gtk_separator_new(GTK_ORIENTATION_HORIZONTAL));
@@ -24,40 +68,340 @@ void DefsPanel::init() {
 	gtk_scrolled_window_set_policy(defs.scroller, GTK_POLICY_NEVER,
 																 GTK_POLICY_AUTOMATIC);
 	gtk_widget_set_vexpand(GTK_WIDGET(defs.scroller), true);
-	defs.vbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 4));
-	widget_set_margin(GTK_WIDGET(defs.vbox), 4);
-	gtk_scrolled_window_set_child(defs.scroller, GTK_WIDGET(defs.vbox));
+	defs.store = g_list_store_new(defs_item_get_type());
+	GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+	g_signal_connect(factory, "setup", G_CALLBACK(DefsPanel::_on_setup_row), this);
+	g_signal_connect(factory, "bind", G_CALLBACK(DefsPanel::_on_bind_row), this);
+	g_signal_connect(factory, "unbind", G_CALLBACK(DefsPanel::_on_unbind_row), this);
+	// the view takes the selection model and factory
+	defs.list_view = GTK_LIST_VIEW(gtk_list_view_new(
+		GTK_SELECTION_MODEL(gtk_no_selection_new(G_LIST_MODEL(g_object_ref(defs.store)))), factory));
+	widget_set_margin(GTK_WIDGET(defs.list_view), 4);
+	gtk_scrolled_window_set_child(defs.scroller, GTK_WIDGET(defs.list_view));
 	gtk_box_append(vbox, GTK_WIDGET(defs.scroller));
+
+	sliders_box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 0));
+	widget_set_margin(GTK_WIDGET(sliders_box), 4);
+	gtk_widget_set_visible(GTK_WIDGET(sliders_box), false);
+	gtk_box_append(vbox, GTK_WIDGET(sliders_box));
 }
 
 void DefsPanel::_on_add_button_press(GtkWidget *, gpointer) {
-	DefsEntry *entry = new DefsEntry();
-	entry->init();
-	main_ui.defs_panel.add_entry(entry);
+	main_ui.defs_panel.add_definitions({""});
+}
+
+void DefsPanel::add_definitions(const vector<string> &texts) {
+	vector<gpointer> items;
+	vector<DefsModel::Definition *> added;
+	for (const string &text : texts) {
+		DefsModel::Definition &def = model.append(text);
+		items.push_back(defs_item_new(def.id));
+		added.push_back(&def);
+	}
+	g_list_store_splice(defs.store, g_list_model_get_n_items(G_LIST_MODEL(defs.store)), 0,
+											items.data(), items.size());
+	for (gpointer item : items) {
+		g_object_unref(item);
+	}
+	for (DefsModel::Definition *def : added) {
+		if (!def->text.empty()) {
+			def->generation = main_ui.evaluator.submit(def->id, def->text);
+		}
+	}
+}
+
+// only the rows below it move, and only those on screen are renumbered
+void DefsPanel::remove_definition(uint64_t id) {
+	size_t position;
+	if (!model.remove(id, position)) {
+		return;
+	}
+	g_list_store_remove(defs.store, position);
+	main_ui.output_panel.tiles.forget(id);
+	main_ui.output_panel.roots.forget(id);
+	main_ui.evaluator.forget(id);
+	main_ui.output_panel.redraw();
+}
+
+// only hands the edit to the worker; bursts of edits coalesce there
+void DefsPanel::edit_text(uint64_t id, size_t pos, size_t removed, const string &inserted) {
+	DefsModel::Definition *def = model.find(id);
+	if (!def) {
+		return;
+	}
+	// the buffer counts characters, the text bytes
+	const char *text = def->text.c_str();
+	size_t begin = g_utf8_offset_to_pointer(text, pos) - text;
+	size_t end = g_utf8_offset_to_pointer(text + begin, removed) - text;
+	def->text.replace(begin, end - begin, inserted);
+	def->generation = main_ui.evaluator.edit(id, begin, end - begin, inserted);
+}
+
+void DefsPanel::save(const string &path) {
+	try {
+		save_snapshot(path, model);
+	} catch (SnapshotError &err) {
+		g_printerr("%s\n", err.what.c_str());
+	}
 }
 
-void DefsPanel::add_entry(DefsEntry *entry) {
-	gtk_box_append(defs.vbox, *entry);
-	defs.entries.push_back(entry);
-	entry->set_idx(defs.entries.size() - 1);
+// shows the whole file at once; saved results are read back on the worker, which takes the entries in order, so
+// everything restored is in the graph before the stale entries are evaluated against it
+void DefsPanel::load(const string &path) {
+	std::shared_ptr<const Snapshot> snapshot;
+	try {
+		snapshot = Snapshot::open(path);
+	} catch (SnapshotError &err) {
+		g_printerr("%s\n", err.what.c_str());
+		return;
+	}
+	model.for_each([](const DefsModel::Definition &def) {
+		main_ui.output_panel.tiles.forget(def.id);
+		main_ui.output_panel.roots.forget(def.id);
+		main_ui.evaluator.forget(def.id);
+	});
+	model.clear();
+	g_list_store_remove_all(defs.store);
+
+	const vector<Snapshot::Entry> &entries = snapshot->entries();
+	vector<gpointer> items;
+	vector<DefsModel::Definition *> added;
+	for (const Snapshot::Entry &entry : entries) {
+		DefsModel::Definition &def = model.append(string(entry.text));
+		def.message = string(entry.message);
+		def.style = entry.style;
+		def.shown = entry.shown;
+		items.push_back(defs_item_new(def.id));
+		added.push_back(&def);
+	}
+	g_list_store_splice(defs.store, 0, 0, items.data(), items.size());
+	for (gpointer item : items) {
+		g_object_unref(item);
+	}
+	for (size_t n = 0; n < added.size(); n++) {
+		if (entries[n].current) {
+			added[n]->generation = main_ui.evaluator.restore(
+				added[n]->id, added[n]->text, [snapshot, n] { return snapshot->load(n); });
+		}
+	}
+	for (size_t n = 0; n < added.size(); n++) {
+		if (!entries[n].current && !added[n]->text.empty()) {
+			added[n]->generation = main_ui.evaluator.submit(added[n]->id, added[n]->text);
+		}
+	}
+	main_ui.output_panel.redraw();
+}
+
+// a large file would stall the main loop; the registry and the evaluator can both be reached from the pool
+void DefsPanel::import_data(const string &path) {
+	thread_pool.submit([path] {
+		try {
+			vector<DataColumn> columns = import_file(path);
+			vector<ID> names;
+			string listed;
+			for (DataColumn &column : columns) {
+				listed += (listed.empty() ? "" : ", ") + string(column.name);
+				names.push_back(column.name);
+				data_columns.add(column.name, std::move(column.values));
+			}
+			main_ui.evaluator.refresh(names);
+			g_print("imported %s from %s\n", listed.c_str(), path.c_str());
+		} catch (DataError &err) {
+			g_printerr("%s\n", err.what.c_str());
+		}
+	});
 }
 
-void DefsPanel::remove_entry(DefsEntry *entry) {
-	gtk_box_remove(defs.vbox, *entry);
-	typedef decltype(defs.entries)::iterator Iter;
-	for (Iter it = defs.entries.begin(); it != defs.entries.end(); it++) {
-		if (*it == entry) {
-			defs.entries.erase(it);
-			break;
+void DefsPanel::add_slider(ID name) {
+	for (const unique<ParamSlider> &slider : sliders) {
+		if (slider->name == name) {
+			return;
 		}
 	}
-	for (int n = 0; n < defs.entries.size(); n++) {
-		defs.entries[n]->set_idx(n);
+	parameters.set(name, 1);
+	sliders.push_back(std::make_unique<ParamSlider>());
+	sliders.back()->init(name, 1);
+	gtk_box_append(sliders_box, *sliders.back());
+	gtk_widget_set_visible(GTK_WIDGET(sliders_box), true);
+	main_ui.evaluator.refresh({name});
+}
+
+void DefsPanel::remove_slider(ID name) {
+	auto found = std::find_if(sliders.begin(), sliders.end(),
+														[&](const unique<ParamSlider> &slider) { return slider->name == name; });
+	if (found == sliders.end()) {
+		return;
+	}
+	parameters.remove(name);
+	(*found)->stop();
+	gtk_box_remove(sliders_box, **found);
+	sliders.erase(found);
+	gtk_widget_set_visible(GTK_WIDGET(sliders_box), !sliders.empty());
+	main_ui.evaluator.refresh({name});
+}
+
+// a slider moving rebinds only the plots using it, whose tiles are redrawn over the old ones as they come in
+void DefsPanel::set_parameter(ID name, double value) {
+	parameters.set(name, value);
+	bool changed = false;
+	model.for_each([&](DefsModel::Definition &def) {
+		if (std::find(def.params.begin(), def.params.end(), name) == def.params.end()) {
+			return;
+		}
+		def.bound_fn = parameters.bind(def.plot_fn, def.params);
+		def.revision++;
+		changed = true;
+	});
+	if (changed) {
+		main_ui.output_panel.redraw();
+	}
+}
+
+void DefsPanel::_on_open_button_press(GtkWidget *, gpointer) {
+	GtkFileDialog *dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Open workspace");
+	gtk_file_dialog_open(dialog, GTK_WINDOW(main_ui.window), NULL,
+											 DefsPanel::_on_open_chosen, NULL);
+	g_object_unref(dialog);
+}
+
+void DefsPanel::_on_save_button_press(GtkWidget *, gpointer) {
+	GtkFileDialog *dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Save workspace");
+	gtk_file_dialog_set_initial_name(dialog, "workspace.mathvis");
+	gtk_file_dialog_save(dialog, GTK_WINDOW(main_ui.window), NULL,
+											 DefsPanel::_on_save_chosen, NULL);
+	g_object_unref(dialog);
+}
+
+void DefsPanel::_on_import_button_press(GtkWidget *, gpointer) {
+	GtkFileDialog *dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Import data");
+	gtk_file_dialog_open(dialog, GTK_WINDOW(main_ui.window), NULL,
+											 DefsPanel::_on_import_chosen, NULL);
+	g_object_unref(dialog);
+}
+
+// a cancelled dialog finishes with an error and no file
+void DefsPanel::_on_open_chosen(GObject *source, GAsyncResult *result, gpointer) {
+	GFile *file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file) {
+		return;
+	}
+	char *path = g_file_get_path(file);
+	if (path) {
+		main_ui.defs_panel.load(path);
+	}
+	g_free(path);
+	g_object_unref(file);
+}
+
+void DefsPanel::_on_save_chosen(GObject *source, GAsyncResult *result, gpointer) {
+	GFile *file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file) {
+		return;
+	}
+	char *path = g_file_get_path(file);
+	if (path) {
+		main_ui.defs_panel.save(path);
+	}
+	g_free(path);
+	g_object_unref(file);
+}
+
+void DefsPanel::_on_import_chosen(GObject *source, GAsyncResult *result, gpointer) {
+	GFile *file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file) {
+		return;
+	}
+	char *path = g_file_get_path(file);
+	if (path) {
+		main_ui.defs_panel.import_data(path);
+	}
+	g_free(path);
+	g_object_unref(file);
+}
+
+TileLayer DefsPanel::tile_layer(const DefsModel::Definition &def) const {
+	TileLayer layer;
+	layer.id = def.id;
+	layer.revision = def.revision;
+	layer.fn = def.bound_fn;
+	layer.points = def.points;
+	layer.kind = def.plot_kind;
+	layer.style = def.style;
+	return layer;
+}
+
+// searched over what's drawn, with the parameters bound in, so a slider moving moves the markers too
+vector<RootQuery> DefsPanel::root_queries(const DefsModel::Definition &def) const {
+	vector<RootQuery> queries;
+	if (!def.plotted() || def.plot_kind != PLOT_CURVE || !def.bound_fn) {
+		return queries;
+	}
+	RootQuery zeros;
+	zeros.layer = def.id;
+	zeros.revision = def.revision;
+	zeros.fn = def.bound_fn;
+	if (def.mark_zeros) {
+		queries.push_back(zeros);
+	}
+	for (uint64_t id : def.crossings) {
+		const DefsModel::Definition *other = model.find(id);
+		if (!other || !other->plotted() || other->plot_kind != PLOT_CURVE || !other->bound_fn) {
+			continue;
+		}
+		RootQuery crossing = zeros;
+		crossing.other = id;
+		crossing.other_revision = other->revision;
+		crossing.other_fn = other->bound_fn;
+		queries.push_back(crossing);
+	}
+	return queries;
+}
+
+void DefsPanel::_on_setup_row(GtkSignalListItemFactory *, GtkListItem *item, gpointer) {
+	DefsRow *row = new DefsRow();
+	row->init();
+	gtk_list_item_set_child(item, *row);
+	gtk_list_item_set_activatable(item, false);
+	gtk_list_item_set_selectable(item, false);
+	g_object_set_data_full(G_OBJECT(item), "row", row,
+												 [](gpointer row) { delete (DefsRow *)row; });
+	g_signal_connect(item, "notify::position",
+									 G_CALLBACK(DefsPanel::_on_position_changed), row);
+}
+
+void DefsPanel::_on_bind_row(GtkSignalListItemFactory *, GtkListItem *item, gpointer userdata) {
+	DefsPanel *panel = (DefsPanel *)userdata;
+	DefsRow *row = (DefsRow *)g_object_get_data(G_OBJECT(item), "row");
+	uint64_t id = ((DefsItem *)gtk_list_item_get_item(item))->id;
+	const DefsModel::Definition *def = panel->model.find(id);
+	if (!def) {
+		return;
 	}
-	delete entry;
+	row->bind(*def, gtk_list_item_get_position(item));
+	panel->bound[id] = row;
 }
 
-void DefsEntry::init() {
+void DefsPanel::_on_unbind_row(GtkSignalListItemFactory *, GtkListItem *item, gpointer userdata) {
+	DefsPanel *panel = (DefsPanel *)userdata;
+	DefsRow *row = (DefsRow *)g_object_get_data(G_OBJECT(item), "row");
+	auto found = panel->bound.find(row->id);
+	if (found != panel->bound.end() && found->second == row) {
+		panel->bound.erase(found);
+	}
+	row->unbind();
+}
+
+void DefsPanel::_on_position_changed(GtkListItem *item, GParamSpec *, gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	if (row->id) {
+		row->set_position(gtk_list_item_get_position(item));
+	}
+}
+
+void DefsRow::init() {
 	frame = GTK_FRAME(gtk_frame_new(NULL));
 	g_object_ref_sink(frame);
 	gtk_widget_set_size_request(GTK_WIDGET(frame),0,-1);
@@ -108,8 +452,12 @@ void DefsEntry::init() {
 	widget_set_align(GTK_WIDGET(options.display_toggle), GTK_ALIGN_CENTER);
 	gtk_box_append(options.vbox, GTK_WIDGET(options.display_toggle));
 
-	options.menu_button =
-	GTK_BUTTON(gtk_button_new_from_icon_name("open-menu-symbolic"));
+	options.menu_button = GTK_MENU_BUTTON(gtk_menu_button_new());
+	gtk_menu_button_set_icon_name(options.menu_button, "open-menu-symbolic");
+	gtk_widget_set_tooltip_text(GTK_WIDGET(options.menu_button), "Sliders");
+	gtk_menu_button_set_popover(options.menu_button, gtk_popover_new());
+	// filled in each time it opens, for whatever the row shows by then
+	gtk_menu_button_set_create_popup_func(options.menu_button, DefsRow::_on_menu_popup, this, NULL);
 	widget_set_align(GTK_WIDGET(options.menu_button), GTK_ALIGN_CENTER);
 	gtk_box_append(options.vbox, GTK_WIDGET(options.menu_button));
 
@@ -120,45 +468,303 @@ void DefsEntry::init() {
 
 	gtk_box_append(hbox, GTK_WIDGET(options.vbox));
 
-	g_signal_connect(gtk_text_view_get_buffer(textedit.text_view), "changed",
-									 G_CALLBACK(DefsEntry::_on_text_changed), this);
+	// ahead of the buffer's own handlers, while the iters still point into the text before the edit
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(textedit.text_view);
+	g_signal_connect(buffer, "insert-text",
+									 G_CALLBACK(DefsRow::_on_insert_text), this);
+	g_signal_connect(buffer, "delete-range",
+									 G_CALLBACK(DefsRow::_on_delete_range), this);
+	g_signal_connect(options.display_toggle, "toggled",
+									 G_CALLBACK(DefsRow::_on_display_changed), this);
+	g_signal_connect(options.color_button, "notify::rgba",
+									 G_CALLBACK(DefsRow::_on_color_changed), this);
+	g_signal_connect(options.remove_button, "clicked",
+									 G_CALLBACK(DefsRow::_on_remove_clicked), this);
 }
 
-DefsEntry::~DefsEntry() {
+DefsRow::~DefsRow() {
 	if (frame) {
 		g_object_unref(frame);
 	}
 }
 
-void DefsEntry::set_idx(int to) {
-	idx = to;
-	if (linenum) {
-		std::string linenum_text = std::to_string(to);
-		gtk_label_set_label(linenum, linenum_text.c_str());
+void DefsRow::bind(const DefsModel::Definition &def, size_t position) {
+	id = def.id;
+	binding = true;
+	set_position(position);
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(textedit.text_view);
+	gtk_text_buffer_set_text(buffer, def.text.c_str(), def.text.size());
+	gtk_check_button_set_active(options.display_toggle, def.shown);
+	GdkRGBA color = {(float)def.style.red, (float)def.style.green,
+									 (float)def.style.blue, (float)def.style.alpha};
+	gtk_color_dialog_button_set_rgba(options.color_button, &color);
+	set_message(def.message);
+	binding = false;
+}
+
+void DefsRow::unbind() {
+	id = 0;
+}
+
+void DefsRow::set_position(size_t position) {
+	std::string linenum_text = std::to_string(position);
+	gtk_label_set_label(linenum, linenum_text.c_str());
+}
+
+void DefsRow::set_message(const string &message) {
+	metric_entry = id;
+	StageTimer timer(STAGE_LABEL);
+	gtk_label_set_label(textedit.error, message.c_str());
+}
+
+void DefsRow::_on_display_changed(GtkWidget *, gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	DefsModel::Definition *def = main_ui.defs_panel.model.find(row->id);
+	if (row->binding || !def) {
+		return;
+	}
+	def->shown = gtk_check_button_get_active(row->options.display_toggle);
+	main_ui.output_panel.redraw();
+}
+
+void DefsRow::_on_color_changed(GtkWidget *, GParamSpec *, gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	DefsModel::Definition *def = main_ui.defs_panel.model.find(row->id);
+	if (row->binding || !def) {
+		return;
+	}
+	const GdkRGBA *color = gtk_color_dialog_button_get_rgba(row->options.color_button);
+	def->style.red = color->red;
+	def->style.green = color->green;
+	def->style.blue = color->blue;
+	def->style.alpha = color->alpha;
+	def->revision++;
+	main_ui.output_panel.redraw();
+}
+
+void DefsRow::_on_insert_text(GtkTextBuffer *, GtkTextIter *location, char *text, int len,
+														 gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	if (row->binding || !row->id) {
+		return;
+	}
+	main_ui.defs_panel.edit_text(row->id, gtk_text_iter_get_offset(location), 0, string(text, len));
+}
+
+void DefsRow::_on_delete_range(GtkTextBuffer *, GtkTextIter *start, GtkTextIter *end,
+															 gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	if (row->binding || !row->id) {
+		return;
+	}
+	int from = gtk_text_iter_get_offset(start);
+	int to = gtk_text_iter_get_offset(end);
+	main_ui.defs_panel.edit_text(row->id, std::min(from, to), std::abs(to - from), "");
+}
+
+void DefsRow::_on_remove_clicked(GtkWidget *, gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	// removing unbinds this row, so take the id first
+	uint64_t id = row->id;
+	main_ui.defs_panel.remove_definition(id);
+}
+
+gboolean DefsPanel::_on_evaluated(gpointer data) {
+	unique<EvalWorker::Result> result((EvalWorker::Result *)data);
+	DefsPanel &panel = main_ui.defs_panel;
+	DefsModel::Definition *def = panel.model.find(result->owner);
+	if (!def || def->generation != result->generation) {
+		return G_SOURCE_REMOVE;
+	}
+	def->evaluated = result->generation;
+	def->parse = std::move(result->parse);
+	def->value.node = std::move(result->value.node);
+	def->plot_fn = result->plot_fn;
+	def->plot_kind = result->plot_kind;
+	def->points = result->points;
+	def->params = std::move(result->params);
+	def->bound_fn = parameters.bind(def->plot_fn, def->params);
+	def->revision++;
+	// laying out a huge label would stall the main loop as surely as evaluating did
+	static constexpr size_t MAX_MESSAGE = 2000;
+	string &message = result->message;
+	if (message.size() > MAX_MESSAGE) {
+		size_t cut = MAX_MESSAGE;
+		while (cut > 0 && (message[cut] & 0xC0) == 0x80) {
+			cut--;
+		}
+		message = message.substr(0, cut) + "…";
+	}
+	def->message = std::move(message);
+	auto row = panel.bound.find(def->id);
+	if (row != panel.bound.end()) {
+		row->second->set_message(def->message);
+	}
+	main_ui.output_panel.redraw();
+	return G_SOURCE_REMOVE;
+}
+
+// a check for each free variable but the coordinates; checked ones are parameters
+// a curve also gets a check for marking its zeros, and one for marking where it meets each other curve
+void DefsRow::_on_menu_popup(GtkMenuButton *menu_button, gpointer userdata) {
+	DefsRow *row = (DefsRow *)userdata;
+	const DefsModel::Definition *def = main_ui.defs_panel.model.find(row->id);
+	set<ID> names;
+	if (def) {
+		if (def->value.defined()) {
+			names = def->value.find_vars();
+		}
+		names.insert(def->params.begin(), def->params.end());
+	}
+	names.erase(coordinate_x);
+	names.erase(coordinate_y);
+
+	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 4));
+	if (names.empty()) {
+		gtk_box_append(box, gtk_label_new("No free variables"));
+	}
+	for (ID name : names) {
+		string label = "Slider for " + string(name);
+		GtkWidget *check = gtk_check_button_new_with_label(label.c_str());
+		gtk_check_button_set_active(GTK_CHECK_BUTTON(check), parameters.has(name));
+		g_object_set_data_full(G_OBJECT(check), "name", g_strdup(string(name).c_str()), g_free);
+		g_signal_connect(check, "toggled", G_CALLBACK(DefsRow::_on_parameter_toggled), NULL);
+		gtk_box_append(box, check);
+	}
+
+	if (def && def->plot_kind == PLOT_CURVE && def->bound_fn) {
+		gtk_box_append(box, gtk_separator_new(GTK_ORIENTATION_HORIZONTAL));
+		GtkWidget *zeros = gtk_check_button_new_with_label("Mark zeros");
+		gtk_check_button_set_active(GTK_CHECK_BUTTON(zeros), def->mark_zeros);
+		g_signal_connect(zeros, "toggled", G_CALLBACK(DefsRow::_on_zeros_toggled), row);
+		gtk_box_append(box, zeros);
+		const DefsModel &model = main_ui.defs_panel.model;
+		model.for_each([&](const DefsModel::Definition &other) {
+			if (other.id == def->id || other.plot_kind != PLOT_CURVE || !other.bound_fn) {
+				return;
+			}
+			string label = "Intersections with " + std::to_string(model.position_of(other.id));
+			GtkWidget *check = gtk_check_button_new_with_label(label.c_str());
+			gtk_check_button_set_active(GTK_CHECK_BUTTON(check), def->crossings.count(other.id));
+			g_object_set_data(G_OBJECT(check), "other", GSIZE_TO_POINTER(other.id));
+			g_signal_connect(check, "toggled", G_CALLBACK(DefsRow::_on_crossing_toggled), row);
+			gtk_box_append(box, check);
+		});
+	}
+	gtk_popover_set_child(gtk_menu_button_get_popover(menu_button), GTK_WIDGET(box));
+}
+
+void DefsRow::_on_parameter_toggled(GtkCheckButton *check, gpointer) {
+	ID name((const char *)g_object_get_data(G_OBJECT(check), "name"));
+	if (gtk_check_button_get_active(check)) {
+		main_ui.defs_panel.add_slider(name);
+	} else {
+		main_ui.defs_panel.remove_slider(name);
+	}
+}
+
+void DefsRow::_on_zeros_toggled(GtkCheckButton *check, gpointer userdata) {
+	DefsModel::Definition *def = main_ui.defs_panel.model.find(((DefsRow *)userdata)->id);
+	if (def) {
+		def->mark_zeros = gtk_check_button_get_active(check);
+		main_ui.output_panel.redraw();
+	}
+}
+
+void DefsRow::_on_crossing_toggled(GtkCheckButton *check, gpointer userdata) {
+	DefsModel::Definition *def = main_ui.defs_panel.model.find(((DefsRow *)userdata)->id);
+	if (!def) {
+		return;
+	}
+	uint64_t other = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(check), "other"));
+	if (gtk_check_button_get_active(check)) {
+		def->crossings.insert(other);
+	} else {
+		def->crossings.erase(other);
 	}
+	main_ui.output_panel.redraw();
 }
 
-void DefsEntry::_on_text_changed(GtkTextBuffer *buffer, gpointer userdata) {
-	DefsEntry *entry = (DefsEntry *)userdata;
-	GtkTextIter start, end;
-	gtk_text_buffer_get_start_iter(buffer, &start);
-	gtk_text_buffer_get_end_iter(buffer, &end);
+// seconds a playing slider takes to cross its range
+static constexpr double SWEEP_SECONDS = 4;
 
-	const char *text = gtk_text_buffer_get_text(buffer, &start, &end, false);
-	Expr ex;
-	string message="what";
-	try{
-		ex = parse(text);
-		try{
-			ex = ex.evaluate();
-			message=ex.to_string(true);
-		}catch(ExprError err){
-			message=err.what;
+void ParamSlider::init(ID name, double value) {
+	this->name = name;
+	hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4));
+
+	string label = string(name) + " =";
+	name_label = GTK_LABEL(gtk_label_new(label.c_str()));
+	gtk_box_append(hbox, GTK_WIDGET(name_label));
+
+	scale = GTK_SCALE(gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, -10, 10, 0.01));
+	gtk_scale_set_draw_value(scale, true);
+	gtk_scale_set_digits(scale, 2);
+	gtk_range_set_value(GTK_RANGE(scale), value);
+	widget_set_expand(GTK_WIDGET(scale), true, false);
+	gtk_box_append(hbox, GTK_WIDGET(scale));
+
+	play_button = GTK_TOGGLE_BUTTON(gtk_toggle_button_new());
+	gtk_button_set_icon_name(GTK_BUTTON(play_button), "media-playback-start-symbolic");
+	gtk_widget_set_tooltip_text(GTK_WIDGET(play_button), "Animate");
+	gtk_box_append(hbox, GTK_WIDGET(play_button));
+
+	remove_button = GTK_BUTTON(gtk_button_new_from_icon_name("window-close-symbolic"));
+	gtk_widget_set_tooltip_text(GTK_WIDGET(remove_button), "Remove slider");
+	gtk_box_append(hbox, GTK_WIDGET(remove_button));
+
+	g_signal_connect(scale, "value-changed", G_CALLBACK(ParamSlider::_on_value_changed), this);
+	g_signal_connect(play_button, "toggled", G_CALLBACK(ParamSlider::_on_play_toggled), this);
+	g_signal_connect(remove_button, "clicked", G_CALLBACK(ParamSlider::_on_remove_clicked), this);
+}
+
+void ParamSlider::stop() {
+	if (tick) {
+		gtk_widget_remove_tick_callback(GTK_WIDGET(scale), tick);
+		tick = 0;
+	}
+}
+
+void ParamSlider::_on_value_changed(GtkRange *range, gpointer userdata) {
+	ParamSlider *slider = (ParamSlider *)userdata;
+	main_ui.defs_panel.set_parameter(slider->name, gtk_range_get_value(range));
+}
+
+// playing moves the slider once per frame of the display, by however long the frame took
+void ParamSlider::_on_play_toggled(GtkToggleButton *button, gpointer userdata) {
+	ParamSlider *slider = (ParamSlider *)userdata;
+	bool playing = gtk_toggle_button_get_active(button);
+	gtk_button_set_icon_name(GTK_BUTTON(button),
+													 playing ? "media-playback-pause-symbolic" : "media-playback-start-symbolic");
+	slider->stop();
+	if (playing) {
+		slider->last_frame = 0;
+		slider->tick = gtk_widget_add_tick_callback(GTK_WIDGET(slider->scale), ParamSlider::_on_tick, slider, NULL);
+	}
+}
+
+gboolean ParamSlider::_on_tick(GtkWidget *, GdkFrameClock *clock, gpointer userdata) {
+	ParamSlider *slider = (ParamSlider *)userdata;
+	gint64 now = gdk_frame_clock_get_frame_time(clock);
+	if (slider->last_frame) {
+		GtkAdjustment *range = gtk_range_get_adjustment(GTK_RANGE(slider->scale));
+		double lower = gtk_adjustment_get_lower(range);
+		double upper = gtk_adjustment_get_upper(range);
+		double seconds = (now - slider->last_frame) / 1e6;
+		double value = gtk_range_get_value(GTK_RANGE(slider->scale)) +
+									 slider->direction * (upper - lower) * seconds / SWEEP_SECONDS;
+		// bouncing off the ends
+		if (value >= upper || value <= lower) {
+			slider->direction = -slider->direction;
+			value = std::clamp(value, lower, upper);
 		}
-	}catch(ParseFail pf){
-		message=pf.reason;
+		gtk_range_set_value(GTK_RANGE(slider->scale), value);
 	}
+	slider->last_frame = now;
+	return G_SOURCE_CONTINUE;
+}
 
-	gtk_label_set_label(entry->textedit.error,message.c_str());
-	delete [] text;
+// removing the slider deletes this, so nothing of it is touched after
+void ParamSlider::_on_remove_clicked(GtkWidget *, gpointer userdata) {
+	ParamSlider *slider = (ParamSlider *)userdata;
+	main_ui.defs_panel.remove_slider(slider->name);
 }
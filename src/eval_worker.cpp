@@ -0,0 +1,286 @@
+#include "eval_worker.hpp"
+#include "metrics.hpp"
+#include "parse_cache.hpp"
+
+EvalWorker::~EvalWorker(){
+	{
+		std::lock_guard lock(mutex);
+		stopping=true;
+		cancel=true;
+	}
+	wake.notify_all();
+	if(thread.joinable()){
+		thread.join();
+	}
+}
+
+uint64_t EvalWorker::submit(uint64_t owner, const string& text){
+	return enqueue(owner,text,nullptr);
+}
+
+uint64_t EvalWorker::restore(uint64_t owner, const string& text, std::function<Saved()> load){
+	return enqueue(owner,text,std::move(load));
+}
+
+uint64_t EvalWorker::edit(uint64_t owner, size_t pos, size_t removed, const string& inserted){
+	uint64_t generation;
+	{
+		std::lock_guard lock(mutex);
+		generation=++next_generation;
+		Job& job=job_for(owner,generation);
+		//saved results are for the text before the edit
+		job.restore=nullptr;
+		if(job.edits_only){
+			job.edits.push_back(Edit{pos,removed,inserted});
+		}else{
+			job.text.replace(pos,removed,inserted);
+		}
+	}
+	wake.notify_one();
+	return generation;
+}
+
+uint64_t EvalWorker::enqueue(uint64_t owner, const string& text, std::function<Saved()> restore){
+	uint64_t generation;
+	{
+		std::lock_guard lock(mutex);
+		generation=++next_generation;
+		Job& job=job_for(owner,generation);
+		job.text=text;
+		job.edits_only=false;
+		job.edits.clear();
+		job.restore=std::move(restore);
+	}
+	wake.notify_one();
+	return generation;
+}
+
+EvalWorker::Job& EvalWorker::job_for(uint64_t owner, uint64_t generation){
+	if(!thread.joinable()){
+		thread=std::thread([this](){ work(); });
+	}
+	latest[owner]=generation;
+	if(running_owner==owner){
+		cancel=true;
+	}
+	for(Job& job : queue){
+		if(job.owner==owner){
+			job.generation=generation;
+			return job;
+		}
+	}
+	Job job;
+	job.owner=owner;
+	job.generation=generation;
+	job.edits_only=true;
+	queue.push_back(std::move(job));
+	return queue.back();
+}
+
+void EvalWorker::forget(uint64_t owner){
+	std::lock_guard lock(mutex);
+	latest.erase(owner);
+	queue.remove_if([owner](const Job& job){ return job.owner==owner; });
+	if(running_owner==owner){
+		cancel=true;
+	}
+	forgotten.push_back(owner);
+}
+
+void EvalWorker::refresh(const vector<ID>& names){
+	{
+		std::lock_guard lock(mutex);
+		if(!thread.joinable()){
+			thread=std::thread([this](){ work(); });
+		}
+		refreshed.insert(refreshed.end(),names.begin(),names.end());
+	}
+	wake.notify_one();
+}
+
+void EvalWorker::work(){
+	eval_cancel=&cancel;
+	while(true){
+		Job job;
+		bool has_job=false;
+		vector<uint64_t> removed;
+		vector<ID> changed;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock,[this](){ return stopping || !queue.empty() || !forgotten.empty() || !refreshed.empty(); });
+			if(stopping){
+				return;
+			}
+			removed.swap(forgotten);
+			changed.swap(refreshed);
+			if(!queue.empty()){
+				job=std::move(queue.front());
+				queue.pop_front();
+				has_job=true;
+				running_owner=job.owner;
+			}
+			cancel=false;
+		}
+		if(has_job){
+			take_text(job);
+		}
+
+		//a cancelled recompute delivers nothing; the graph carries what it missed into the next one
+		try{
+			for(uint64_t owner : removed){
+				sources.erase(owner);
+				applied.erase(owner);
+				DefinitionGraph::Plan plan=graph.remove(owner);
+				graph.recompute(plan,thread_pool,nullptr);
+				deliver(plan);
+			}
+			if(!changed.empty()){
+				DefinitionGraph::Plan plan=graph.touch(changed);
+				graph.recompute(plan,thread_pool,nullptr);
+				deliver(plan);
+			}
+			if(has_job){
+				deliver(job.restore ? run_restore(job) : run(job));
+			}
+		}catch(EvalCancelled){}
+
+		std::lock_guard lock(mutex);
+		running_owner=0;
+	}
+}
+
+//brings the owner's text up to date with the job; done before anything that can be cancelled,
+//since later edits are made to the text as this job leaves it
+void EvalWorker::take_text(const Job& job){
+	unique<IncrementalParse>& source=sources[job.owner];
+	if(!source){
+		source=std::make_unique<IncrementalParse>();
+	}
+	if(job.edits_only){
+		for(const Edit& edit : job.edits){
+			source->edit(edit.pos,edit.removed,edit.inserted);
+		}
+	}else{
+		source->set_text(job.text);
+	}
+}
+
+//posts a result for each definition in the plan that is still as last submitted
+void EvalWorker::deliver(const DefinitionGraph::Plan& plan){
+	vector<std::pair<uint64_t,uint64_t>> current;
+	{
+		std::lock_guard lock(mutex);
+		for(uint64_t owner : plan.owners()){
+			auto found=latest.find(owner);
+			auto at=applied.find(owner);
+			if(found!=latest.end() && at!=applied.end() && found->second==at->second){
+				current.emplace_back(owner,at->second);
+			}
+		}
+	}
+	if(!on_result){
+		return;
+	}
+	for(auto [owner,generation] : current){
+		const DefinitionGraph::Definition* def=graph.find(owner);
+		Result result;
+		result.owner=owner;
+		result.generation=generation;
+		result.parsed=def->parse_error.empty();
+		result.parse=def->parsed;
+		result.value=def->value;
+		result.message=def->message;
+		result.plot_fn=def->plot_fn;
+		result.plot_kind=def->plot_kind;
+		result.points=def->points;
+		result.params=def->params;
+		on_result(std::move(result));
+	}
+}
+
+DefinitionGraph::Plan EvalWorker::run(const Job& job){
+	metric_entry=job.owner;
+	unique<IncrementalParse>& source=sources.at(job.owner);
+	const string& text=source->text;
+
+	ParseCache::Result cached;
+	bool hit=false;
+	DefinitionGraph::Plan plan;
+	try{
+		hit=parse_cache.find(text,cached);
+		if(!hit){
+			//the one copy made: the incremental parse keeps changing its tree, so everyone else shares this
+			cached.parsed=std::make_shared<const Expr>(source->reparse());
+			parse_cache.store(text,cached.parsed);
+		}
+		plan=graph.update(job.owner,cached.parsed);
+	}catch(ParseFail pf){
+		plan=graph.update_failed(job.owner,pf.reason);
+	}
+	applied[job.owner]=job.generation;
+
+	//the edited definition uses its cached value, or its incremental one, with what it uses bound into the incremental
+	//parse rather than substituted into a copy; a cached parse skipped the incremental one, so that's left to the graph,
+	//as are equations, of which the graph may evaluate just one side
+	auto evaluate_first=[&](uint64_t owner, DefinitionGraph::Definition& def){
+		if(owner!=job.owner || !def.parse_error.empty() || def.body->type()==Equal::type || (hit && !cached.has_value)){
+			return false;
+		}
+		SymbolTable names;
+		Bindings values(names);
+		if(!cached.has_value && !graph.bind_uses(def,names,values)){
+			return true;
+		}
+		def.failed=false;
+		try{
+			{
+				StageTimer timer(STAGE_EVALUATE);
+				if(cached.has_value){
+					def.value=cached.value;
+				}else{
+					//the incremental parse's tree is what def's parse was copied from, node for node
+					Expr& body=def.body==def.parsed ? source->parsed : source->parsed.node->subexprs.back();
+					def.value=source->evaluate(body,values);
+				}
+			}
+			if(!cached.has_value && expr_is_pure(*cached.parsed)){
+				parse_cache.store_value(text,def.value);
+			}
+			StageTimer timer(STAGE_TO_STRING);
+			def.message=def.value.to_string(true);
+		}catch(ExprError err){
+			def.value.node.reset();
+			def.failed=true;
+			def.message=err.what;
+		}
+		return true;
+	};
+	graph.recompute(plan,thread_pool,evaluate_first);
+	return plan;
+}
+
+//puts the saved definition straight into the graph; it was computed along with its dependents, so only it is delivered
+DefinitionGraph::Plan EvalWorker::run_restore(const Job& job){
+	Saved saved;
+	try{
+		saved=job.restore();
+	}catch(...){
+		return run(job);
+	}
+	DefinitionGraph::Plan plan;
+	if(saved.parse.defined()){
+		bool pure=saved.value.defined() && expr_is_pure(saved.parse);
+		auto parsed=std::make_shared<const Expr>(std::move(saved.parse));
+		graph.restore(job.owner,parsed,saved.value,saved.message,std::move(saved.plot_fn),saved.plot_kind);
+		plan.levels.push_back({job.owner});
+		parse_cache.store(job.text,parsed);
+		if(pure){
+			parse_cache.store_value(job.text,saved.value);
+		}
+	}else{
+		plan=graph.update_failed(job.owner,saved.message);
+		graph.recompute(plan,thread_pool,nullptr);
+	}
+	applied[job.owner]=job.generation;
+	return plan;
+}
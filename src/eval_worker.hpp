@@ -0,0 +1,109 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "parser.hpp"
+#include "definition_graph.hpp"
+
+//parses and evaluates definitions on a thread of its own, keeping each one's incremental parse there
+//submitting text or an edit for an owner folds into any job of its still waiting, so bursts of edits collapse into one,
+//and cancels one already running at its next node
+//definitions see each other's names, so a job also recomputes everything depending on what it defines
+class EvalWorker{
+public:
+	struct Result{
+		uint64_t owner=0;
+		//as returned by the submit this answers
+		uint64_t generation=0;
+		bool parsed=false;
+		//the text's parse, if it parsed, shared with the worker
+		std::shared_ptr<const Expr> parse;
+		Expr value;
+		//the value, or the parse, evaluation or dependency error
+		string message;
+		//as in DefinitionGraph::Definition
+		std::shared_ptr<const CompiledExpr> plot_fn;
+		PlotKind plot_kind=PLOT_CURVE;
+		std::shared_ptr<const PointSet> points;
+		vector<ID> params;
+	};
+
+	//a definition as computed earlier, to be put back without parsing or evaluating
+	struct Saved{
+		//undefined if the text didn't parse
+		Expr parse;
+		//undefined if it failed
+		Expr value;
+		string message;
+		//compiled again from value if null
+		std::shared_ptr<const CompiledExpr> plot_fn;
+		PlotKind plot_kind=PLOT_CURVE;
+	};
+
+	//called on the worker thread, only with results nothing newer has been submitted over;
+	//a job yields one for its own owner and one for each dependent it recomputed
+	std::function<void(Result&&)> on_result;
+
+	EvalWorker(){}
+	EvalWorker(const EvalWorker&)=delete;
+	~EvalWorker();
+
+	//returns the job's generation, which increases with each submit
+	uint64_t submit(uint64_t owner, const string& text);
+	//as submit, for the owner's last text with 'removed' bytes at pos replaced by 'inserted';
+	//only the edit is passed on, for the incremental parse to retokenize just around it
+	uint64_t edit(uint64_t owner, size_t pos, size_t removed, const string& inserted);
+	//as submit, but the job takes its definition from load (run on the worker) rather than computing it;
+	//if load throws, text is parsed and evaluated as usual
+	uint64_t restore(uint64_t owner, const string& text, std::function<Saved()> load);
+	//drops the owner's job, parse state and definition, as when it is removed; its dependents are recomputed
+	void forget(uint64_t owner);
+	//recomputes whatever uses names, after what they mean changed outside any definition (as with imported data)
+	void refresh(const vector<ID>& names);
+
+private:
+	struct Edit{
+		size_t pos,removed;
+		string inserted;
+	};
+
+	struct Job{
+		uint64_t owner;
+		uint64_t generation;
+		//the whole text, or if edits_only, nothing, and the edits are to be made in order to the owner's last text
+		string text;
+		bool edits_only=false;
+		vector<Edit> edits;
+		std::function<Saved()> restore;
+	};
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread thread;
+	bool stopping=false;
+	uint64_t next_generation=0;
+	//waiting jobs, in submission order, at most one per owner
+	list<Job> queue;
+	//latest generation submitted per owner
+	std::unordered_map<uint64_t,uint64_t> latest;
+	uint64_t running_owner=0;
+	std::atomic<bool> cancel{false};
+	vector<uint64_t> forgotten;
+	vector<ID> refreshed;
+
+	//only touched by the worker thread
+	std::unordered_map<uint64_t,unique<IncrementalParse>> sources;
+	DefinitionGraph graph;
+	//generation of the text each owner's definition in the graph came from
+	std::unordered_map<uint64_t,uint64_t> applied;
+
+	void work();
+	void take_text(const Job& job);
+	uint64_t enqueue(uint64_t owner, const string& text, std::function<Saved()> restore);
+	//the owner's job, folded into the one waiting if there is one, or else queued; call with mutex held
+	Job& job_for(uint64_t owner, uint64_t generation);
+	DefinitionGraph::Plan run(const Job& job);
+	DefinitionGraph::Plan run_restore(const Job& job);
+	void deliver(const DefinitionGraph::Plan& plan);
+};
@@ -0,0 +1,305 @@
+#include "definition_graph.hpp"
+#include "defs_model.hpp"
+#include "parameters.hpp"
+#include "parse_cache.hpp"
+#include "parser.hpp"
+#include "plot_render.hpp"
+#include <cairo-svg.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options{
+	vector<string> files;
+	string out_dir=".";
+	bool svg=false;
+	Viewport view=Viewport{-10,10,-10,10,800,600};
+	bool quiet=false;
+	bool stats=false;
+};
+
+//one file's definitions, drawn into one image
+struct Job{
+	string file;
+	string out;
+	//errors, one per line, for stderr
+	string log;
+	uint64_t definitions=0;
+	uint64_t errors=0;
+	//the image wasn't made at all
+	bool failed=false;
+	double resolve_ms=0,render_ms=0,write_ms=0;
+};
+
+void usage(){
+	std::cerr<<
+		"usage: mathvis-export [options] file...\n"
+		"draws each file's definitions (one per line) into an image named after it, without a display\n"
+		"  -o dir              write the images into dir (default: the current directory)\n"
+		"  -f png|svg          image format (default: png)\n"
+		"  -v x0:x1:y0:y1      the region of the plane shown (default: -10:10:-10:10)\n"
+		"  -r widthxheight     image size in pixels (default: 800x600)\n"
+		"  -q                  don't print each image's timings\n"
+		"  -s                  report throughput and latency on stderr\n";
+}
+
+void parse_view(const string& arg, Viewport& view){
+	double bounds[4];
+	size_t from=0;
+	for(int n=0;n<4;n++){
+		size_t to=n<3 ? arg.find(':',from) : arg.size();
+		if(to==string::npos){
+			throw std::invalid_argument("bad view: "+arg);
+		}
+		bounds[n]=std::stod(arg.substr(from,to-from));
+		from=to+1;
+	}
+	if(!(bounds[0]<bounds[1]) || !(bounds[2]<bounds[3])){
+		throw std::invalid_argument("empty view: "+arg);
+	}
+	view.x0=bounds[0];
+	view.x1=bounds[1];
+	view.y0=bounds[2];
+	view.y1=bounds[3];
+}
+
+void parse_size(const string& arg, Viewport& view){
+	size_t x=arg.find('x');
+	if(x==string::npos){
+		throw std::invalid_argument("bad size: "+arg);
+	}
+	view.width=std::stoi(arg.substr(0,x));
+	view.height=std::stoi(arg.substr(x+1));
+	if(view.width<1 || view.height<1){
+		throw std::invalid_argument("bad size: "+arg);
+	}
+}
+
+double millis_since(Clock::time_point start){
+	return std::chrono::duration<double,std::milli>(Clock::now()-start).count();
+}
+
+//parses and evaluates job's file into graph, owned by line number; parses are shared through the parse cache
+void resolve(Job& job, DefinitionGraph& graph, vector<uint64_t>& owners){
+	std::ifstream in(job.file);
+	if(!in){
+		job.log+=job.file+": can't open\n";
+		job.failed=true;
+		return;
+	}
+	string line;
+	uint64_t lineno=0;
+	while(std::getline(in,line)){
+		lineno++;
+		if(line.find_first_not_of(" \t\r")==string::npos){
+			continue;
+		}
+		job.definitions++;
+		owners.push_back(lineno);
+		ParseCache::Result cached;
+		try{
+			if(!parse_cache.find(line,cached)){
+				cached.parsed=std::make_shared<const Expr>(parse(line));
+				parse_cache.store(line,cached.parsed);
+			}
+			graph.update(lineno,cached.parsed);
+		}catch(ParseFail pf){
+			graph.update_failed(lineno,pf.reason);
+		}
+	}
+
+	graph.recompute(graph.everything(),thread_pool,nullptr);
+
+	for(uint64_t owner : owners){
+		const DefinitionGraph::Definition* def=graph.find(owner);
+		if(def->failed){
+			job.errors++;
+			job.log+=job.file+":"+std::to_string(owner)+": "+def->message+"\n";
+		}
+	}
+}
+
+//each definition's plot over the background, in file order
+void draw(cairo_t* cr, const Viewport& view, const DefinitionGraph& graph, const vector<uint64_t>& owners){
+	draw_background(cr,view);
+	for(size_t n=0;n<owners.size();n++){
+		const DefinitionGraph::Definition* def=graph.find(owners[n]);
+		const PlotStyle& style=palette_style(n);
+		if(def->points){
+			draw_points(cr,view,*def->points,style);
+			continue;
+		}
+		if(!def->plot_fn){
+			continue;
+		}
+		std::shared_ptr<const CompiledExpr> bound=parameters.bind(def->plot_fn,def->params);
+		const CompiledExpr& fn=*bound;
+		switch(def->plot_kind){
+			case PLOT_HEATMAP:
+				draw_field(cr,view,fn,style);
+				break;
+			case PLOT_IMPLICIT:
+				draw_curve(cr,view,trace_implicit(fn,view),style);
+				break;
+			case PLOT_PARAMETRIC:
+				draw_curve(cr,view,sample_parametric(fn,view),style);
+				break;
+			case PLOT_CURVE:
+				draw_curve(cr,view,sample_function(fn,view),style);
+				break;
+			case PLOT_SCATTER:
+				break;
+		}
+	}
+}
+
+void render(Job& job, const Options& opts, CompileCache& compiled){
+	Clock::time_point start=Clock::now();
+	DefinitionGraph graph(&compiled);
+	vector<uint64_t> owners;
+	resolve(job,graph,owners);
+	job.resolve_ms=millis_since(start);
+	if(job.failed){
+		return;
+	}
+
+	const Viewport& view=opts.view;
+	start=Clock::now();
+	cairo_surface_t* surface=opts.svg
+		? cairo_svg_surface_create(job.out.c_str(),view.width,view.height)
+		: cairo_image_surface_create(CAIRO_FORMAT_ARGB32,view.width,view.height);
+	cairo_t* cr=cairo_create(surface);
+	draw(cr,view,graph,owners);
+	cairo_destroy(cr);
+	job.render_ms=millis_since(start);
+
+	//an svg surface writes as it's finished
+	start=Clock::now();
+	cairo_status_t status;
+	if(opts.svg){
+		cairo_surface_finish(surface);
+		status=cairo_surface_status(surface);
+	}else{
+		status=cairo_surface_write_to_png(surface,job.out.c_str());
+	}
+	cairo_surface_destroy(surface);
+	job.write_ms=millis_since(start);
+	if(status!=CAIRO_STATUS_SUCCESS){
+		job.log+=job.out+": "+cairo_status_to_string(status)+"\n";
+		job.failed=true;
+	}
+}
+
+double percentile(vector<double>& samples, double p){
+	if(samples.empty()){
+		return 0;
+	}
+	size_t n=std::min(samples.size()-1,(size_t)(p*samples.size()));
+	std::nth_element(samples.begin(),samples.begin()+n,samples.end());
+	return samples[n];
+}
+
+int main(int argc, char** argv){
+	Options opts;
+	try{
+		for(int n=1;n<argc;n++){
+			string arg=argv[n];
+			if(arg=="-o" && n+1<argc){
+				opts.out_dir=argv[++n];
+			}else if(arg=="-f" && n+1<argc){
+				string format=argv[++n];
+				if(format!="png" && format!="svg"){
+					throw std::invalid_argument("unknown format: "+format);
+				}
+				opts.svg=format=="svg";
+			}else if(arg=="-v" && n+1<argc){
+				parse_view(argv[++n],opts.view);
+			}else if(arg=="-r" && n+1<argc){
+				parse_size(argv[++n],opts.view);
+			}else if(arg=="-q"){
+				opts.quiet=true;
+			}else if(arg=="-s"){
+				opts.stats=true;
+			}else if(arg=="-h" || arg=="--help" || (arg.size()>1 && arg[0]=='-')){
+				usage();
+				return arg[1]=='h' || arg=="--help" ? 0 : 2;
+			}else{
+				opts.files.push_back(arg);
+			}
+		}
+	}catch(std::exception& e){
+		std::cerr<<e.what()<<"\n";
+		usage();
+		return 2;
+	}
+	if(opts.files.empty()){
+		usage();
+		return 2;
+	}
+
+	//plot functions are compiled once for the whole batch, however many files share them
+	CompileCache compiled;
+	vector<double> resolve_ms,render_ms,write_ms;
+	uint64_t definitions=0,errors=0,failed=0;
+	Clock::time_point start=Clock::now();
+
+	//files are drawn in batches across the pool, each reported in order once its batch is done
+	static constexpr size_t BATCH=256;
+	for(size_t first=0;first<opts.files.size();first+=BATCH){
+		vector<Job> jobs(std::min(BATCH,opts.files.size()-first));
+		for(size_t n=0;n<jobs.size();n++){
+			Job& job=jobs[n];
+			job.file=opts.files[first+n];
+			std::filesystem::path out=opts.out_dir;
+			out/=std::filesystem::path(job.file).stem();
+			out+=opts.svg ? ".svg" : ".png";
+			job.out=out.string();
+		}
+		thread_pool.parallel_for(jobs.size(),[&](size_t n){
+			render(jobs[n],opts,compiled);
+		});
+
+		for(Job& job : jobs){
+			std::cerr<<job.log;
+			definitions+=job.definitions;
+			errors+=job.errors;
+			if(job.failed){
+				failed++;
+				continue;
+			}
+			resolve_ms.push_back(job.resolve_ms);
+			render_ms.push_back(job.render_ms);
+			write_ms.push_back(job.write_ms);
+			if(!opts.quiet){
+				printf("%s\tresolve %.2f ms\trender %.2f ms\twrite %.2f ms\n",
+					job.out.c_str(),job.resolve_ms,job.render_ms,job.write_ms);
+			}
+		}
+	}
+	fflush(stdout);
+
+	if(opts.stats){
+		double wall_s=millis_since(start)/1e3;
+		fprintf(stderr,"%lu images (%lu failed), %lu definitions, %lu errors in %.3f s\n",
+			(unsigned long)resolve_ms.size(),(unsigned long)failed,(unsigned long)definitions,(unsigned long)errors,wall_s);
+		if(wall_s>0){
+			fprintf(stderr,"throughput: %.1f images/s\n",resolve_ms.size()/wall_s);
+		}
+		fprintf(stderr,"resolve ms:  p50 %.2f  p99 %.2f  max %.2f\n",
+			percentile(resolve_ms,0.5),percentile(resolve_ms,0.99),percentile(resolve_ms,1));
+		fprintf(stderr,"render ms:   p50 %.2f  p99 %.2f  max %.2f\n",
+			percentile(render_ms,0.5),percentile(render_ms,0.99),percentile(render_ms,1));
+		fprintf(stderr,"write ms:    p50 %.2f  p99 %.2f  max %.2f\n",
+			percentile(write_ms,0.5),percentile(write_ms,0.99),percentile(write_ms,1));
+		ParseCache::Stats parses=parse_cache.stats();
+		CompileCache::Stats compiles=compiled.stats();
+		fprintf(stderr,"parses: %lu hits, %lu misses; compiles: %lu hits, %lu misses\n",
+			(unsigned long)parses.hits,(unsigned long)parses.misses,(unsigned long)compiles.hits,(unsigned long)compiles.misses);
+	}
+	return errors || failed ? 1 : 0;
+}
@@ -1,5 +1,8 @@
 #include "expression.hpp"
+#include "compiled.hpp"
+#include "thread_pool.hpp"
 #include <cmath>
+#include <atomic>
 
 ID Expr::type() const {
 	if(defined())
@@ -7,7 +10,13 @@ ID Expr::type() const {
 	else
 		return ID();
 }
+static void check_cancelled(){
+	if(eval_cancel && eval_cancel->load(std::memory_order_relaxed))
+		throw EvalCancelled();
+}
+
 Expr Expr::evaluate() const {
+	check_cancelled();
 	if(defined())
 		return node->evaluate();
 	else
@@ -19,7 +28,7 @@ set<ID> Expr::find_vars() const {
 	else
 		return set<ID>();
 }
-Expr Expr::substitute(const map<ID,Expr>& context) const {
+Expr Expr::substitute(const Bindings& context) const {
 	if(defined())
 		return node->substitute(context);
 	else
@@ -82,6 +91,48 @@ set<ID> ExprNode::find_vars() const {
 	return ret;
 }
 
+uint32_t next_symbol_table_serial(){
+	static std::atomic<uint32_t> serial{0};
+	return ++serial;
+}
+
+SymbolTable::SymbolTable():serial(next_symbol_table_serial()){}
+
+uint32_t SymbolTable::add(ID name){
+	auto found=slots.find(name);
+	if(found!=slots.end()){
+		return found->second;
+	}
+	uint32_t slot=names.size();
+	names.push_back(name);
+	slots.emplace(name,slot);
+	return slot;
+}
+
+long SymbolTable::find(ID name) const {
+	auto found=slots.find(name);
+	return found==slots.end() ? -1 : (long)found->second;
+}
+
+void SymbolTable::bind(Expr& ex){
+	if(!ex.defined()){
+		return;
+	}
+	if(ex.type()==Variable::type){
+		Variable* var=dynamic_cast<Variable*>(ex.node.get());
+		var->table=serial;
+		var->slot=add(var->name);
+		return;
+	}
+	//function bodies are closed over their own inputs
+	if(ex.type()==Function::type){
+		return;
+	}
+	for(Expr& child : ex.node->subexprs){
+		bind(child);
+	}
+}
+
 enum Associativity{
 	//NON means association must be explicit
 	//LEFT/RIGHT, means that associative direction is assumed, but otherwise non-associative
@@ -109,6 +160,10 @@ struct Operator{
 	uint8_t left_argt{},right_argt{};
 
 	Expr (*do_op)(const Expr&,const Expr&){};
+	//the operation on two numbers, for operations that have one; packed arrays broadcast through it
+	long double (*on_numbers)(long double,long double){};
+	//builds the operation as a node, for operands whose values aren't known yet
+	Expr (*unevaluated)(const Expr&,const Expr&){};
 
 	const char* name;
 
@@ -117,16 +172,98 @@ struct Operator{
 };
 
 bool etype_is_value(ID type){
-	return type=="Boolean"_id || type=="Number"_id || type=="Function"_id ||
-		type=="Array"_id || type=="Tuple"_id;
+	return type==Boolean::type || type==Number::type || type==Function::type ||
+		type==Array::type || type==Tuple::type || type==NumericArray::type;
+}
+
+template<typename EXPRNODE>
+Expr unevaluated_op(const Expr& a, const Expr& b){
+	EXPRNODE* ret=new EXPRNODE();
+	ret->subexprs.push_back(a);
+	ret->subexprs.push_back(b);
+	return ret;
+}
+
+//beyond this many elements, a packed result is refused rather than allocated
+static constexpr size_t MAX_PACKED=size_t(1)<<30;
+//elements per task when filling a packed result in parallel
+static constexpr size_t PACKED_CHUNK=size_t(1)<<16;
+
+//a packed array of at(n) for n in [0,count), filled in parallel for large counts
+template<typename F>
+static Expr packed_map(size_t count, F&& at){
+	if(count>MAX_PACKED){
+		throw ExprError("broadcasting would make "+std::to_string(count)+" values");
+	}
+	std::shared_ptr<double[]> out=std::make_shared_for_overwrite<double[]>(count);
+	//the pool's threads answer to the caller's cancel flag
+	const std::atomic<bool>* cancel=eval_cancel;
+	thread_pool.parallel_for((count+PACKED_CHUNK-1)/PACKED_CHUNK,[&](size_t chunk){
+		if(cancel && cancel->load(std::memory_order_relaxed)){
+			throw EvalCancelled();
+		}
+		size_t end=std::min(count,(chunk+1)*PACKED_CHUNK);
+		for(size_t n=chunk*PACKED_CHUNK;n<end;n++){
+			out[n]=at(n);
+		}
+	});
+	return numeric_array(std::move(out),count);
+}
+
+Expr binary_op(const Operator& op, const Expr& a, const Expr& b);
+
+//op broadcast over whichever of a and b are packed arrays it doesn't take whole, as over an Array, but packed
+//where op has a numeric form and the other side is a number (or a packed array, giving every pairing as an Array would)
+static Expr packed_op(const Operator& op, const Expr& a, const Expr& b, bool pack_a, bool pack_b){
+	const NumericArray* a_arr=pack_a ? (const NumericArray*)a.node.get() : nullptr;
+	const NumericArray* b_arr=pack_b ? (const NumericArray*)b.node.get() : nullptr;
+	auto scalar=[](const Expr& ex, bool nothing_ok, long double& value){
+		if(ex.type()==Number::type){
+			value=((const Number*)ex.node.get())->value;
+			return true;
+		}
+		value=0;
+		return !ex.defined() && nothing_ok;
+	};
+
+	if(op.on_numbers){
+		auto fn=op.on_numbers;
+		long double value;
+		if(a_arr && b_arr){
+			size_t width=b_arr->count;
+			if(width && a_arr->count>MAX_PACKED/width){
+				throw ExprError("broadcasting would make "+std::to_string(a_arr->count)+"x"+std::to_string(width)+" values");
+			}
+			return packed_map(a_arr->count*width,[&](size_t n){ return (double)fn(a_arr->values[n/width],b_arr->values[n%width]); });
+		}
+		if(a_arr && scalar(b,op.right_argt&Operator::NOTHING,value)){
+			return packed_map(a_arr->count,[&](size_t n){ return (double)fn(a_arr->values[n],value); });
+		}
+		if(b_arr && scalar(a,op.left_argt&Operator::NOTHING,value)){
+			return packed_map(b_arr->count,[&](size_t n){ return (double)fn(value,b_arr->values[n]); });
+		}
+	}
+	//an operand that isn't a value yet, as in x*data, keeps the operation whole rather than spreading it over the elements
+	if(op.unevaluated && ((a.defined() && !etype_is_value(a.type())) || (b.defined() && !etype_is_value(b.type())))){
+		return op.unevaluated(a,b);
+	}
+	return binary_op(op,a_arr ? a_arr->expand() : a,b_arr ? b_arr->expand() : b);
 }
 
 Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
+	//broadcasting over arrays recurses here rather than through evaluate()
+	check_cancelled();
+
+	bool pack_a=a.type()==NumericArray::type && !(op.left_argt&Operator::ARRAY);
+	bool pack_b=b.type()==NumericArray::type && !(op.right_argt&Operator::ARRAY);
+	if(pack_a || pack_b){
+		return packed_op(op,a,b,pack_a,pack_b);
+	}
 
-	if(a.type()=="Array"_id){
+	if(a.type()==Array::type){
 		if(!(op.left_argt&Operator::ARRAY)){
 
-			if(b.type()=="Array"_id){
+			if(b.type()==Array::type){
 				if(!(op.right_argt&Operator::ARRAY)){
 					Array* ret=new Array();
 					for(const Expr& elem_a : a.node.get()->subexprs){
@@ -146,7 +283,7 @@ Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
 		}
 	}
 
-	if(b.type()=="Array"_id){
+	if(b.type()==Array::type){
 		if(!(op.right_argt&Operator::ARRAY)){
 			Array* ret=new Array();
 			for(const Expr& elem : b.node.get()->subexprs){
@@ -156,10 +293,10 @@ Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
 		}
 	}
 
-	if(a.type()=="Tuple"_id){
+	if(a.type()==Tuple::type){
 		if(!(op.left_argt&Operator::TUPLE)){
 
-			if(b.type()=="Tuple"_id){
+			if(b.type()==Tuple::type){
 
 				const Tuple* a_tup = dynamic_cast<const Tuple*>(a.node.get());
 				const Tuple* b_tup = dynamic_cast<const Tuple*>(b.node.get());
@@ -175,16 +312,33 @@ Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
 					a_it++; b_it++;
 				}
 				return ret;
-			}else{
-				throw ExprError("operator "+string(op.name)+" cannot take a tuple as left argument");
 			}
+
+			//anything else goes with each element, as (t,1)*2 is (t*2,2)
+			Tuple* ret=new Tuple();
+			for(const Expr& elem : a.node.get()->subexprs){
+				ret->subexprs.push_back(binary_op(op,elem,b));
+			}
+			return ret;
 		}
 	}
 
-	if(b.type()=="Tuple"_id){
+	if(b.type()==Tuple::type){
 		if(!(op.right_argt&Operator::TUPLE)){
-			throw ExprError("operator "+string(op.name)+" cannot take a tuple as right argument");
+			Tuple* ret=new Tuple();
+			for(const Expr& elem : b.node.get()->subexprs){
+				ret->subexprs.push_back(binary_op(op,a,elem));
+			}
+			return ret;
+		}
+	}
+
+	//broadcasting reaches elements that may not be values yet, as in (t,1)*2; those are left as the operation
+	if((a.defined() && !etype_is_value(a.type())) || (b.defined() && !etype_is_value(b.type()))){
+		if(!op.unevaluated){
+			throw ExprError("operator "+string(op.name)+" needs its operands' values");
 		}
+		return op.unevaluated(a,b);
 	}
 
 	if(!a.defined()){
@@ -192,17 +346,17 @@ Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
 			throw ExprError("operator "+string(op.name)+" cannot have nothing as left operand");
 		}
 	}
-	else if(a.type()=="Number"_id){
+	else if(a.type()==Number::type){
 		if(!(op.left_argt&Operator::NUMBER)){
 			throw ExprError("operator "+string(op.name)+" cannot have a number as left operand");
 		}
 	}
-	else if(a.type()=="Boolean"_id){
+	else if(a.type()==Boolean::type){
 		if(!(op.left_argt&Operator::BOOLEAN)){
 			throw ExprError("operator "+string(op.name)+" cannot have a boolean as left operand");
 		}
 	}
-	else if(a.type()=="Function"_id){
+	else if(a.type()==Function::type){
 		if(!(op.left_argt&Operator::FUNCTION)){
 			throw ExprError("operator "+string(op.name)+" cannot have a function as left operand");
 		}
@@ -213,17 +367,17 @@ Expr binary_op(const Operator& op, const Expr& a, const Expr& b){
 			throw ExprError("operator "+string(op.name)+" cannot have nothing as right operand");
 		}
 	}
-	else if(b.type()=="Number"_id){
+	else if(b.type()==Number::type){
 		if(!(op.right_argt&Operator::NUMBER)){
 			throw ExprError("operator "+string(op.name)+" cannot have a number as right operand");
 		}
 	}
-	else if(b.type()=="Boolean"_id){
+	else if(b.type()==Boolean::type){
 		if(!(op.right_argt&Operator::BOOLEAN)){
 			throw ExprError("operator "+string(op.name)+" cannot have a boolean as right operand");
 		}
 	}
-	else if(b.type()=="Function"_id){
+	else if(b.type()==Function::type){
 		if(!(op.right_argt&Operator::FUNCTION)){
 			throw ExprError("operator "+string(op.name)+" cannot have a function as right operand");
 		}
@@ -265,7 +419,7 @@ deque<Expr> nary_op(const Operator& op, deque<Expr>&& children){
 			Expr b = std::move((children.*next)());
 			(children.*pop)();
 			if(!b.defined()||etype_is_value(b.type())){
-				(children.*push)( op.associativity==LEFT_ASSOCIATIVE ? binary_op(op,a,b) : binary_op(op,b,a) );
+				(children.*push)( op.associativity==RIGHT_ASSOCIATIVE ? binary_op(op,b,a) : binary_op(op,a,b) );
 			}
 			else{
 				(alt.*push_alt)(std::move(a));
@@ -312,11 +466,12 @@ deque<Expr> sub_eval(const deque<Expr>& subs){
 #define NARY_OP_EXPR_EVAL(EXPRNODE,OPER)                        \
 Expr EXPRNODE::evaluate() const {                               \
 	EXPRNODE* ret=new EXPRNODE();                                 \
+	Expr owned(ret);                                              \
 	ret->subexprs=nary_op(OPER,sub_eval(subexprs));               \
 	if(ret->subexprs.size()==1){                                  \
-		return ret->subexprs.front();                               \
+		return std::move(ret->subexprs.front());                    \
 	}                                                             \
-	return ret;                                                   \
+	return owned;                                                 \
 }
 
 #define BIOP_EXPR_EVAL(EXPRNODE,OPER)                           \
@@ -324,16 +479,17 @@ Expr EXPRNODE::evaluate() const {                               \
 	if(subexprs.size()!=2) \
 		throw ExprError("operator "+string(OPER.name)+" is strictly binary"); \
 	EXPRNODE* ret=new EXPRNODE();                                 \
+	Expr owned(ret);                                              \
 	ret->subexprs=sub_eval(subexprs);  \
 	if((!ret->subexprs.front().defined()||etype_is_value(ret->subexprs.front().type())) && (!ret->subexprs.back().defined()||etype_is_value(ret->subexprs.back().type())) ){ \
 		return binary_op(OPER,ret->subexprs.front(),ret->subexprs.back());      \
 	}else{ \
-		return ret; \
+		return owned; \
 	} \
 }
 
 #define SUBSTITUTE_IMPL(EXPRNODE)                                 \
-Expr EXPRNODE::substitute(const map<ID,Expr>& context) const {    \
+Expr EXPRNODE::substitute(const Bindings& context) const {       \
 	EXPRNODE* ret=new EXPRNODE();                                   \
 	for(const Expr& ex : subexprs){                                 \
 		ret->subexprs.push_back(ex.substitute(context));              \
@@ -401,6 +557,8 @@ constexpr Operator op_add=[](){
 	op.left_argt=Operator::NUMBER;
 	op.right_argt=Operator::NUMBER;
 	op.name="+";
+	op.unevaluated=unevaluated_op<Add>;
+	op.on_numbers=[](long double a,long double b){ return a+b; };
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* a_num = dynamic_cast<const Number*>(a.node.get());
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
@@ -435,6 +593,9 @@ constexpr Operator op_sub=[](){
 	op.left_argt=Operator::NUMBER|Operator::NOTHING;
 	op.right_argt=Operator::NUMBER;
 	op.name="-";
+	op.unevaluated=unevaluated_op<Sub>;
+	//with nothing on the left, as in -x, a is 0
+	op.on_numbers=[](long double a,long double b){ return a-b; };
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		number_t a_num,b_num;
 		if(a.defined())
@@ -473,6 +634,8 @@ constexpr Operator op_mul=[](){
 	op.left_argt=Operator::NUMBER;
 	op.right_argt=Operator::NUMBER;
 	op.name="*";
+	op.unevaluated=unevaluated_op<Mul>;
+	op.on_numbers=[](long double a,long double b){ return a*b; };
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* a_num = dynamic_cast<const Number*>(a.node.get());
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
@@ -508,6 +671,8 @@ constexpr Operator op_div=[](){
 	op.left_argt=Operator::NUMBER;
 	op.right_argt=Operator::NUMBER;
 	op.name="/";
+	op.unevaluated=unevaluated_op<Div>;
+	op.on_numbers=[](long double a,long double b){ return a/b; };
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* a_num = dynamic_cast<const Number*>(a.node.get());
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
@@ -544,6 +709,8 @@ constexpr Operator op_exp=[](){
 	op.left_argt=Operator::NUMBER;
 	op.right_argt=Operator::NUMBER;
 	op.name="^";
+	op.unevaluated=unevaluated_op<Exponent>;
+	op.on_numbers=[](long double a,long double b){ return powl(a,b); };
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* a_num = dynamic_cast<const Number*>(a.node.get());
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
@@ -600,6 +767,7 @@ constexpr Operator op_eql=[](){
 	op.left_argt=Operator::NUMBER;
 	op.right_argt=Operator::NUMBER;
 	op.name="=";
+	op.unevaluated=unevaluated_op<Equal>;
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* a_num = dynamic_cast<const Number*>(a.node.get());
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
@@ -633,9 +801,19 @@ constexpr Operator op_idx=[](){
 	op.left_argt=Operator::ARRAY|Operator::TUPLE;
 	op.right_argt=Operator::NUMBER;
 	op.name="@";
+	op.unevaluated=unevaluated_op<Index>;
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Number* b_num = dynamic_cast<const Number*>(b.node.get());
 		long idx = b_num->value;
+		if(a.type()==NumericArray::type){
+			const NumericArray* arr = (const NumericArray*)a.node.get();
+			long size = arr->count;
+			if(size==0){
+				throw ExprError("can't index an empty array");
+			}
+			idx=((idx%size)+size)%size;
+			return number_t(arr->values[idx]);
+		}
 		long size = a.node->subexprs.size();
 		idx=((idx%size)+size)%size;
 		return a.node->subexprs[idx];
@@ -662,8 +840,42 @@ OP_TOSTRING_IMPL(Index,@,(
 	REQ_PAREN(Not)
 	REQ_PAREN(And)
 	REQ_PAREN(Or)
+	REQ_PAREN(Sum)
+	REQ_PAREN(Product)
 ))
 
+void Function::bind_inputs(){
+	std::shared_ptr<SymbolTable> table=std::make_shared<SymbolTable>();
+	for(ID input : inputs){
+		table->add(input);
+	}
+	table->bind(subexprs.front());
+	symbols=std::move(table);
+}
+
+//fn's body with its nth input replaced by arg(n), evaluated
+//the body's variables carry their slots from bind_inputs, so each is a direct index into the values rather than a
+//lookup by name; the first value given for a name wins, as a repeated input name shadows the later ones
+template<typename F>
+static Expr apply_function(const Function* fn, F&& arg){
+	std::shared_ptr<const SymbolTable> symbols=fn->symbols;
+	if(!symbols){
+		//built without binding; bound on a copy, as this one is shared
+		Function bound(*fn);
+		bound.bind_inputs();
+		return apply_function(&bound,arg);
+	}
+	Bindings values(*symbols);
+	for(size_t n=0;n<fn->inputs.size();n++){
+		ID input=fn->inputs[n];
+		uint32_t slot=n<symbols->names.size() && symbols->names[n]==input ? n : symbols->find(input);
+		if(!values[slot].defined()){
+			values[slot]=arg(n);
+		}
+	}
+	return fn->subexprs.front().substitute(values).evaluate();
+}
+
 constexpr Operator op_call=[](){
 	Operator op;
 
@@ -672,9 +884,10 @@ constexpr Operator op_call=[](){
 	op.left_argt=Operator::FUNCTION;
 	op.right_argt=Operator::SOMETHING;
 	op.name="#";
+	op.unevaluated=unevaluated_op<Call>;
 	op.do_op=[](const Expr& a,const Expr& b)->Expr{
 		const Function* a_func = dynamic_cast<const Function*>(a.node.get());
-		if(b.type()=="Function"_id){
+		if(b.type()==Function::type){
 
 			const Function* b_func = dynamic_cast<const Function*>(b.node.get());
 			Call* call=new Call();
@@ -695,49 +908,36 @@ constexpr Operator op_call=[](){
 			}
 			Expr gx(call);
 
-			map<ID,Expr> replacements;
+			Function* ret=new Function();
+			Expr owned(ret);
+			ret->inputs=b_func->inputs;
 			if(a_func->inputs.size()==1){
-				replacements.emplace(a_func->inputs.front(),std::move(gx));
+				ret->subexprs.push_back(apply_function(a_func,[&](size_t){ return std::move(gx); }));
 			}
 			else{
-				for(int n=0;n<a_func->inputs.size();n++){
+				ret->subexprs.push_back(apply_function(a_func,[&](size_t n){
 					Index* idx = new Index();
 					idx->subexprs.push_back(gx);
-					idx->subexprs.push_back(n);
-					replacements.emplace(a_func->inputs[n],idx);
-				}
+					idx->subexprs.push_back(Expr(number_t(n)));
+					return Expr(idx);
+				}));
 			}
-
-			Function* ret=new Function();
-			ret->inputs=b_func->inputs;
-			Expr ex=a_func->subexprs.front();
-			ex=ex.substitute(replacements);
-			ex=ex.evaluate();
-			ret->subexprs.push_back(std::move(ex));
-			return ret;
+			ret->bind_inputs();
+			return owned;
 
 		}
-		else if(b.type()=="Tuple"_id){
+		else if(b.type()==Tuple::type){
 			const Tuple* b_tup = dynamic_cast<const Tuple*>(b.node.get());
 			if(a_func->inputs.size()==1){
-				Expr ret=a_func->subexprs.front();
-				ret=ret.substitute(map<ID,Expr>{{a_func->inputs.front(),b}});
-				ret=ret.evaluate();
-				return ret;
+				return apply_function(a_func,[&](size_t){ return b; });
 			}
 			else if(a_func->inputs.size()==b_tup->subexprs.size()){
-				map<ID,Expr> replace;
-				for(int n=0;n<a_func->inputs.size();n++){
+				return apply_function(a_func,[&](size_t n){
 					Index* idx = new Index();
 					idx->subexprs.push_back(b);
-					idx->subexprs.push_back(n);
-
-					replace.emplace(a_func->inputs[n],idx);
-				}
-				Expr ret=a_func->subexprs.front();
-				ret=ret.substitute(replace);
-				ret=ret.evaluate();
-				return ret;
+					idx->subexprs.push_back(Expr(number_t(n)));
+					return Expr(idx);
+				});
 			}
 			else{
 				throw ExprError("bad arg count");
@@ -745,10 +945,7 @@ constexpr Operator op_call=[](){
 		}
 		else{
 			if(a_func->inputs.size()==1){
-				Expr ret=a_func->subexprs.front();
-				ret=ret.substitute(map<ID,Expr>{{a_func->inputs.front(),b}});
-				ret=ret.evaluate();
-				return ret;
+				return apply_function(a_func,[&](size_t){ return b; });
 			}
 			else{
 				throw ExprError("bad arg count");
@@ -776,13 +973,15 @@ OP_TOSTRING_IMPL(Call,#,(
 	REQ_PAREN(Not)
 	REQ_PAREN(And)
 	REQ_PAREN(Or)
+	REQ_PAREN(Sum)
+	REQ_PAREN(Product)
 ))
 
 
 Expr Number::evaluate() const {
 	return clone();
 }
-Expr Number::substitute(const map<ID,Expr>& context) const{
+Expr Number::substitute(const Bindings& context) const{
 	return clone();
 }
 bool Number::same_as(const Expr& b) const {
@@ -799,7 +998,7 @@ string Number::to_string(bool force_parentheses) const {
 Expr Boolean::evaluate() const {
 	return clone();
 }
-Expr Boolean::substitute(const map<ID,Expr>& context) const{
+Expr Boolean::substitute(const Bindings& context) const{
 	return clone();
 }
 bool Boolean::same_as(const Expr& b) const {
@@ -815,9 +1014,10 @@ string Boolean::to_string(bool force_parentheses) const {
 Expr Variable::evaluate() const {
 	return clone();
 }
-Expr Variable::substitute(const map<ID,Expr>& context) const {
-	if(context.contains(name)){
-		return context.at(name);
+Expr Variable::substitute(const Bindings& context) const {
+	long at = table==context.symbols->serial ? slot : context.symbols->find(name);
+	if(const Expr* value=context.find(at)){
+		return *value;
 	}
 	else{
 		return clone();
@@ -857,8 +1057,71 @@ string Array::to_string(bool force_parentheses) const {
 	return ret;
 }
 
-Expr Tuple::evaluate() const {
+Expr numeric_array(std::shared_ptr<const double[]> values, size_t count){
+	NumericArray* ret=new NumericArray();
+	ret->values=values.get();
+	ret->count=count;
+	ret->owner=std::move(values);
+	return ret;
+}
+Expr NumericArray::expand() const {
 	Array* ret=new Array();
+	Expr owned(ret);
+	for(size_t n=0;n<count;n++){
+		if(n%PACKED_CHUNK==0){
+			check_cancelled();
+		}
+		ret->subexprs.push_back(number_t(values[n]));
+	}
+	return owned;
+}
+Expr NumericArray::evaluate() const {
+	return clone();
+}
+Expr NumericArray::substitute(const Bindings& context) const {
+	return clone();
+}
+bool NumericArray::same_as(const Expr& b) const {
+	if(b.type()!=type){
+		return false;
+	}
+	const NumericArray* b_arr=(const NumericArray*)b.node.get();
+	if(count!=b_arr->count){
+		return false;
+	}
+	if(values==b_arr->values){
+		return true;
+	}
+	for(size_t n=0;n<count;n++){
+		if(number_t(values[n])!=number_t(b_arr->values[n])){
+			return false;
+		}
+	}
+	return true;
+}
+//long arrays show their ends and how many there are
+string NumericArray::to_string(bool force_parentheses) const {
+	static constexpr size_t SHOWN=8;
+	string ret="[";
+	for(size_t n=0;n<count;n++){
+		if(count>SHOWN && n==SHOWN-1){
+			ret+="…, ";
+			n=count-1;
+		}
+		ret+=string(number_t(values[n]));
+		if(n+1<count){
+			ret+=", ";
+		}
+	}
+	ret+="]";
+	if(count>SHOWN){
+		ret+=" ("+std::to_string(count)+" values)";
+	}
+	return ret;
+}
+
+Expr Tuple::evaluate() const {
+	Tuple* ret=new Tuple();
 	for(const Expr& child : subexprs){
 		ret->subexprs.push_back(child.evaluate());
 	}
@@ -882,7 +1145,7 @@ string Tuple::to_string(bool force_parentheses) const {
 Expr Function::evaluate() const{
 	return clone();
 }
-Expr Function::substitute(const map<ID,Expr>& context) const {
+Expr Function::substitute(const Bindings& context) const {
 	return clone();
 }
 bool Function::same_as(const Expr& b) const{
@@ -906,3 +1169,269 @@ set<ID> Function::find_vars() const{
 string Function::to_string(bool force_parentheses) const{
 	return "$func";
 }
+
+
+//most terms evaluated one at a time through the tree, for a term that doesn't compile
+static constexpr int64_t MAX_TREE_TERMS=int64_t(1)<<20;
+//past this, not every whole number is a double
+static constexpr long double MAX_BOUND=9007199254740992.0L;
+
+//values combined pairwise as they come in, keeping one partial result per power of two
+struct PairwiseFold{
+	const Operator& op;
+	vector<std::pair<Expr,uint64_t>> partials;
+
+	PairwiseFold(const Operator& op):op(op){}
+
+	void add(Expr value){
+		uint64_t size=1;
+		while(!partials.empty() && partials.back().second==size){
+			value=binary_op(op,partials.back().first,value);
+			partials.pop_back();
+			size*=2;
+		}
+		partials.emplace_back(std::move(value),size);
+	}
+	Expr total(Expr empty){
+		if(partials.empty()){
+			return empty;
+		}
+		Expr ret=std::move(partials.back().first);
+		for(size_t n=partials.size()-1;n-->0;){
+			ret=binary_op(op,partials[n].first,ret);
+		}
+		return ret;
+	}
+};
+
+static int64_t reduction_bound(const Expr& bound, const char* name){
+	if(bound.type()!=Number::type){
+		throw ExprError(string(name)+"'s bounds must be numbers");
+	}
+	long double value=((const Number*)bound.node.get())->value.value;
+	if(value!=roundl(value) || fabsl(value)>MAX_BOUND){
+		throw ExprError(string(name)+"'s bounds must be whole numbers no larger than 2^53");
+	}
+	return (int64_t)value;
+}
+
+//the range form's (k, lo, hi, term)
+template<typename REDUCTION>
+static const deque<Expr>& reduction_range(const REDUCTION& node){
+	return node.subexprs.front().node->subexprs;
+}
+
+//a range or term that isn't known yet leaves the reduction, with what is known evaluated
+template<typename REDUCTION>
+static Expr partial_reduction(const REDUCTION& node, Expr&& lo, Expr&& hi){
+	const deque<Expr>& range=reduction_range(node);
+	REDUCTION* ret=new REDUCTION();
+	Expr owned(ret);
+	ret->variable=node.variable;
+	Tuple* args=new Tuple();
+	ret->subexprs.push_back(args);
+	args->subexprs.push_back(range[0]);
+	args->subexprs.push_back(std::move(lo));
+	args->subexprs.push_back(std::move(hi));
+	args->subexprs.push_back(range[3].evaluate());
+	return owned;
+}
+
+template<typename REDUCTION>
+static Expr evaluate_reduction(const REDUCTION& node, const Operator& op, bool product, const char* name){
+	Expr empty(number_t(product ? 1 : 0));
+	if(!node.variable){
+		Expr over=node.subexprs.front().evaluate();
+		if(over.type()==NumericArray::type){
+			const NumericArray* arr=(const NumericArray*)over.node.get();
+			return Expr(number_t(reduce_values(arr->values,arr->count,product)));
+		}
+		if(over.type()==Array::type || over.type()==Tuple::type){
+			PairwiseFold fold(op);
+			for(const Expr& value : over.node->subexprs){
+				fold.add(value);
+			}
+			return fold.total(std::move(empty));
+		}
+		if(!over.defined() || etype_is_value(over.type())){
+			return over;
+		}
+		REDUCTION* ret=new REDUCTION();
+		ret->subexprs.push_back(std::move(over));
+		return ret;
+	}
+
+	const deque<Expr>& range=reduction_range(node);
+	Expr lo=range[1].evaluate();
+	Expr hi=range[2].evaluate();
+	const Expr& term=range[3];
+	set<ID> vars=term.find_vars();
+	vars.erase(node.variable);
+	if(!etype_is_value(lo.type()) || !etype_is_value(hi.type()) || !vars.empty()){
+		return partial_reduction(node,std::move(lo),std::move(hi));
+	}
+	int64_t first=reduction_bound(lo,name);
+	int64_t last=reduction_bound(hi,name);
+	if(first>last){
+		return empty;
+	}
+
+	CompiledExpr fn(term,{node.variable});
+	if(fn.is_compiled() && fn.outputs()==1){
+		return Expr(number_t(reduce_range(fn,product,first,last)));
+	}
+	//a term that doesn't compile, as one over arrays or tuples, goes through the tree a term at a time
+	if(last-first>=MAX_TREE_TERMS){
+		throw ExprError(string(name)+" of more than "+std::to_string(MAX_TREE_TERMS)+" terms that don't compile");
+	}
+	SymbolTable index;
+	index.add(node.variable);
+	Expr body=term;
+	index.bind(body);
+	Bindings at(index);
+	PairwiseFold fold(op);
+	for(int64_t k=first;k<=last;k++){
+		at[0]=Expr(number_t(k));
+		fold.add(body.substitute(at).evaluate());
+	}
+	return fold.total(std::move(empty));
+}
+
+//the index is bound by the reduction, so within the term it isn't whatever the context gives that name
+template<typename REDUCTION>
+static Expr substitute_reduction(const REDUCTION& node, const Bindings& context){
+	REDUCTION* ret=new REDUCTION();
+	Expr owned(ret);
+	ret->variable=node.variable;
+	if(!node.variable){
+		ret->subexprs.push_back(node.subexprs.front().substitute(context));
+		return owned;
+	}
+	const deque<Expr>& range=reduction_range(node);
+	Tuple* args=new Tuple();
+	ret->subexprs.push_back(args);
+	args->subexprs.push_back(range[0]);
+	args->subexprs.push_back(range[1].substitute(context));
+	args->subexprs.push_back(range[2].substitute(context));
+	long slot=context.symbols->find(node.variable);
+	if(context.find(slot)){
+		args->subexprs.push_back(range[3].substitute(Bindings(context,slot)));
+	}else{
+		args->subexprs.push_back(range[3].substitute(context));
+	}
+	return owned;
+}
+
+template<typename REDUCTION>
+static set<ID> reduction_vars(const REDUCTION& node){
+	if(!node.variable){
+		return node.ExprNode::find_vars();
+	}
+	const deque<Expr>& range=reduction_range(node);
+	set<ID> ret=range[1].find_vars();
+	ret.merge(range[2].find_vars());
+	set<ID> term=range[3].find_vars();
+	term.erase(node.variable);
+	ret.merge(term);
+	return ret;
+}
+
+template<typename REDUCTION>
+static bool same_reduction(const REDUCTION& node, const Expr& b){
+	if(b.type()!=node.type){
+		return false;
+	}
+	const REDUCTION* b_red=(const REDUCTION*)b.node.get();
+	return node.variable==b_red->variable && node.subexprs.front().same_as(b_red->subexprs.front());
+}
+
+//what follows the # binds looser than it unless it's a single thing
+static string reduction_string(const char* name, const Expr& over, bool force_parentheses){
+	ID type=over.type();
+	bool bare=type==Variable::type || type==Number::type || type==Boolean::type || type==Array::type ||
+		type==Tuple::type || type==NumericArray::type || type==Index::type || type==Parenthetical::type;
+	string ret=force_parentheses ? "(" : "";
+	ret+=string(name)+" # ";
+	ret+=bare ? over.to_string(force_parentheses) : "("+over.to_string(force_parentheses)+")";
+	if(force_parentheses){
+		ret+=")";
+	}
+	return ret;
+}
+
+Expr Sum::evaluate() const {
+	return evaluate_reduction(*this,op_add,false,"sum");
+}
+Expr Sum::substitute(const Bindings& context) const {
+	return substitute_reduction(*this,context);
+}
+set<ID> Sum::find_vars() const {
+	return reduction_vars(*this);
+}
+bool Sum::same_as(const Expr& b) const {
+	return same_reduction(*this,b);
+}
+string Sum::to_string(bool force_parentheses) const {
+	return reduction_string("sum",subexprs.front(),force_parentheses);
+}
+
+Expr Product::evaluate() const {
+	return evaluate_reduction(*this,op_mul,true,"product");
+}
+Expr Product::substitute(const Bindings& context) const {
+	return substitute_reduction(*this,context);
+}
+set<ID> Product::find_vars() const {
+	return reduction_vars(*this);
+}
+bool Product::same_as(const Expr& b) const {
+	return same_reduction(*this,b);
+}
+string Product::to_string(bool force_parentheses) const {
+	return reduction_string("product",subexprs.front(),force_parentheses);
+}
+
+Expr DefiniteIntegral::evaluate() const {
+	if(!variable){
+		throw ExprError("integral takes (variable, from, to, integrand)");
+	}
+	const deque<Expr>& range=reduction_range(*this);
+	Expr lo=range[1].evaluate();
+	Expr hi=range[2].evaluate();
+	set<ID> vars=range[3].find_vars();
+	vars.erase(variable);
+	if(!etype_is_value(lo.type()) || !etype_is_value(hi.type()) || !vars.empty()){
+		return partial_reduction(*this,std::move(lo),std::move(hi));
+	}
+	if(lo.type()!=Number::type || hi.type()!=Number::type){
+		throw ExprError("integral's bounds must be numbers");
+	}
+	//a term that doesn't compile is still evaluated a batch at a time, through the tree
+	CompiledExpr fn(range[3],{variable});
+	if(fn.outputs()!=1){
+		throw ExprError("can only integrate numbers");
+	}
+	Quadrature result=integrate(fn,((const Number*)lo.node.get())->value,((const Number*)hi.node.get())->value);
+	if(std::isnan(result.value)){
+		throw ExprError("integrand isn't a number everywhere between the bounds");
+	}
+	if(result.diverged()){
+		throw ExprError("integral doesn't converge");
+	}
+	if(eval_error){
+		*eval_error+=result.error;
+	}
+	return Expr(number_t(result.value));
+}
+Expr DefiniteIntegral::substitute(const Bindings& context) const {
+	return substitute_reduction(*this,context);
+}
+set<ID> DefiniteIntegral::find_vars() const {
+	return reduction_vars(*this);
+}
+bool DefiniteIntegral::same_as(const Expr& b) const {
+	return same_reduction(*this,b);
+}
+string DefiniteIntegral::to_string(bool force_parentheses) const {
+	return reduction_string("integral",subexprs.front(),force_parentheses);
+}
@@ -2,12 +2,15 @@
 #include <map>
 #include <set>
 #include "string_id.hpp"
+#include "perfect_hash.hpp"
 #include <vector>
 #include <list>
 #include <memory>
 #include <limits>
 #include <deque>
 #include <cmath>
+#include <unordered_map>
+#include <atomic>
 
 template<typename T>
 using unique = std::unique_ptr<T>;
@@ -23,6 +26,14 @@ struct ExprError{
 	ExprError(string what):what(what){}
 };
 
+//thrown out of evaluate() once the evaluating thread's cancel flag is raised
+struct EvalCancelled{};
+
+//while set, evaluate() on this thread checks it at every node
+inline thread_local const std::atomic<bool>* eval_cancel=nullptr;
+//while set, evaluate() on this thread adds to it the estimated absolute error of each numerical integral it takes
+inline thread_local double* eval_error=nullptr;
+
 struct SafeFloat{
 	static constexpr long double epsilon = std::numeric_limits<long double>::epsilon();
 	long double value=0;
@@ -33,7 +44,8 @@ struct SafeFloat{
 	constexpr SafeFloat(long double n):value(n){}
 
 	bool operator==(const SafeFloat& b) const {
-		return fabsl(b.value-value) < epsilon * std::max(fabsl(value),fabsl(b.value));
+		//at most, so zero equals zero
+		return fabsl(b.value-value) <= epsilon * std::max(fabsl(value),fabsl(b.value));
 	}
 	bool operator!=(const SafeFloat& b) const{
 		return !(*this==b);
@@ -75,6 +87,7 @@ SafeFloat operator OP (const SafeFloat& b) const{\
 using number_t = SafeFloat;
 
 struct ExprNode;
+struct Bindings;
 
 struct Expr{
 	unique<ExprNode> node{};
@@ -83,7 +96,7 @@ struct Expr{
 
 	Expr evaluate() const;
 	set<ID> find_vars() const;
-	Expr substitute(const map<ID,Expr>&) const;
+	Expr substitute(const Bindings&) const;
 	string to_string(bool force_parentheses=false) const;
 	bool same_as(const Expr& b) const;
 
@@ -103,6 +116,52 @@ struct Expr{
 	Expr& operator=(Expr&& b);
 };
 
+//numbers the names used in a context with small dense slots, so their values can sit in a flat vector
+struct SymbolTable{
+	//unique per table, so variables can tell whose slot they carry
+	const uint32_t serial;
+	vector<ID> names;
+	std::unordered_map<ID,uint32_t> slots;
+
+	SymbolTable();
+	SymbolTable(const SymbolTable&)=delete;
+
+	uint32_t add(ID name);
+	//slot of name, or -1
+	long find(ID name) const;
+	//stores each variable's slot in its node (adding names as needed), making substitution a direct index
+	void bind(Expr& ex);
+
+	size_t size() const { return names.size(); }
+};
+
+//values by slot of a SymbolTable; an undefined value leaves the variable alone
+struct Bindings{
+	const SymbolTable* symbols;
+	vector<Expr> values;
+	//for bindings that are another's with one slot left unbound: the other, whose values these are, and the slot
+	const Bindings* outer=nullptr;
+	long hidden=-1;
+
+	Bindings(const SymbolTable& symbols):symbols(&symbols),values(symbols.size()){}
+	//outer's values, without copying them, but for hidden, which is unbound here
+	Bindings(const Bindings& outer, long hidden):symbols(outer.symbols),outer(&outer),hidden(hidden){}
+
+	Expr& operator[](uint32_t slot){ return values[slot]; }
+	const Expr& operator[](uint32_t slot) const { return values[slot]; }
+
+	//the value slot is bound to, or null if it isn't
+	const Expr* find(long slot) const {
+		if(slot<0 || slot==hidden){
+			return nullptr;
+		}
+		if(outer){
+			return outer->find(slot);
+		}
+		return slot<(long)values.size() && values[slot].defined() ? &values[slot] : nullptr;
+	}
+};
+
 struct ExprNode{
 	const ID type;
 	deque<Expr> subexprs;
@@ -111,12 +170,13 @@ struct ExprNode{
 	virtual Expr evaluate() const =0;
 	//get all referenced names that don't have a built-in definition
 	virtual set<ID> find_vars() const;
-	virtual Expr substitute(const map<ID,Expr>&) const =0;
+	virtual Expr substitute(const Bindings&) const =0;
 	virtual Expr clone() const =0;
 	virtual string to_string(bool force_parentheses=false) const =0;
 	virtual bool same_as(const Expr& b) const =0;
 
 	ExprNode(ID type):type(type){}
+	virtual ~ExprNode(){}
 };
 
 
@@ -137,14 +197,29 @@ operators by precedence:
 | (or)
  */
 
+//every node type, by name; kind is its index here
+//new kinds go at the end, as snapshots store kinds by number
+inline constexpr PerfectHash<32,6> node_kinds({
+	"Add","Sub","Mul","Div","Exponent","Parenthetical","Equal","Number","Boolean","Variable",
+	"Array","Tuple","Index","Call","Function","And","Or","Not","Less","Greater","LessEqual",
+	"GreaterEqual","Restricted","Piecewise","Derivative","DefiniteIntegral","Cosine","Sine","Tangent",
+	"NumericArray","Sum","Product"
+});
+
+//the plane's coordinates, in nearly every plotted expression; permanent, as node types are
+inline const ID coordinate_x=ID::permanent("x");
+inline const ID coordinate_y=ID::permanent("y");
+
 #define SUBEXPR(EXPRTYPE) \
-inline static const ID type = #EXPRTYPE;\
+inline static const ID type = ID::permanent(#EXPRTYPE);\
+static_assert(node_kinds.find(#EXPRTYPE)>=0, #EXPRTYPE " is missing from node_kinds");\
+static constexpr uint8_t kind = node_kinds.find(#EXPRTYPE);\
 Expr evaluate() const override;\
 Expr clone() const override{return new EXPRTYPE(*this);}\
 string to_string(bool force_parentheses=false) const override;\
-Expr substitute(const map<ID,Expr>&) const override;\
+Expr substitute(const Bindings&) const override;\
 bool same_as(const Expr& b) const override;\
-EXPRTYPE():ExprNode(#EXPRTYPE){}\
+EXPRTYPE():ExprNode(type){}\
 
 struct Add : public ExprNode{
 	SUBEXPR(Add);
@@ -183,6 +258,9 @@ struct Boolean : public ExprNode{
 
 struct Variable : public ExprNode{
 	ID name;
+	//set by SymbolTable::bind
+	uint32_t table=0;
+	uint32_t slot=0;
 	set<ID> find_vars() const override;
 	SUBEXPR(Variable);
 };
@@ -191,6 +269,23 @@ struct Array : public ExprNode{
 	SUBEXPR(Array);
 };
 
+//numbers packed in one read-only buffer, as imported from data or computed from it; copies share the buffer,
+//so evaluating, substituting and cloning cost the same at any size
+//operations with a numeric form broadcast over it without a node per element; anything else sees an Array of Numbers
+struct NumericArray : public ExprNode{
+	//keeps values alive: a mapped file, or memory of its own
+	std::shared_ptr<const void> owner;
+	const double* values=nullptr;
+	size_t count=0;
+
+	//the elements as an Array of Numbers
+	Expr expand() const;
+	SUBEXPR(NumericArray);
+};
+
+//a NumericArray over values of its own
+Expr numeric_array(std::shared_ptr<const double[]> values, size_t count);
+
 struct Tuple : public ExprNode{
 	SUBEXPR(Tuple);
 };
@@ -208,11 +303,36 @@ struct Call : public ExprNode{
 
 struct Function : public ExprNode{
 	vector<ID> inputs;
+	//the inputs and the body's other variables, with the body bound to it by bind_inputs; shared by copies,
+	//whose bodies carry the same slots
+	std::shared_ptr<const SymbolTable> symbols;
 	set<ID> find_vars() const override;
 
+	//binds the body's variables to slots once, so a call fills one flat array of values by slot;
+	//called once the inputs and body are in place
+	void bind_inputs();
+
 	SUBEXPR(Function);
 };
 
+//sum # (k, lo, hi, term) adds up term for k over the whole numbers lo to hi; sum # values adds up an array or tuple
+//the one child is what follows the #: for a range, the tuple as written, and variable is its first element's name;
+//for values, variable is empty
+//a term that compiles is reduced in chunks straight from its program, and over the pool for long ranges,
+//without making a node per term
+struct Sum : public ExprNode{
+	ID variable;
+	set<ID> find_vars() const override;
+	SUBEXPR(Sum);
+};
+
+//as Sum, multiplying
+struct Product : public ExprNode{
+	ID variable;
+	set<ID> find_vars() const override;
+	SUBEXPR(Product);
+};
+
 //TODO
 struct And : public ExprNode{
 	SUBEXPR(And);
@@ -266,7 +386,10 @@ struct Derivative : public ExprNode{
 	SUBEXPR(Derivative);
 };
 
-//TODO
+//integral # (t, a, b, term) integrates term over t from a to b, either of which may be infinite, numerically;
+//kept as Sum keeps its range, with the tuple as its one child
+//its value is within INTEGRAL_TOLERANCE of the integral of the term's absolute value, or as near as it gets,
+//and the estimated error is added to eval_error
 struct DefiniteIntegral : public ExprNode{
 	ID variable;
 	set<ID> find_vars() const override;
@@ -1,4 +1,8 @@
 #include <gtk/gtk.h>
+#include <glib-unix.h>
+#include <csignal>
+#include <cstdio>
+#include "metrics.hpp"
 #include "ui.hpp"
 
 void MainUI::init(){
@@ -18,12 +22,30 @@ void MainUI::init(){
 	widget_set_margin(output_panel,4);
 
 	color_dialog = gtk_color_dialog_new();
+
+	evaluator.on_result = [](EvalWorker::Result&& result){
+		g_idle_add(DefsPanel::_on_evaluated, new EvalWorker::Result(std::move(result)));
+	};
+}
+
+//to the file named by MATHVIS_METRICS, or else stderr
+static void dump_metrics(){
+	std::string json = metrics.to_json();
+	const char* path = getenv("MATHVIS_METRICS");
+	FILE* out = path ? fopen(path, "w") : stderr;
+	if (!out) {
+		perror(path);
+		return;
+	}
+	fwrite(json.data(), 1, json.size(), out);
+	if (out != stderr) {
+		fclose(out);
+	}
 }
 
-void OutputPanel::init(){
-	tab_pane=GTK_NOTEBOOK(gtk_notebook_new());
-	graph_area=GTK_DRAWING_AREA(gtk_drawing_area_new());
-	gtk_notebook_append_page(tab_pane,GTK_WIDGET(graph_area),NULL);
+static gboolean on_dump_signal (gpointer){
+	dump_metrics();
+	return G_SOURCE_CONTINUE;
 }
 
 static void activate (GtkApplication* app, gpointer user_data){
@@ -31,13 +53,29 @@ static void activate (GtkApplication* app, gpointer user_data){
 	gtk_window_present (GTK_WINDOW (main_ui.window));
 }
 
+// mathvis workspace.mathvis starts with the snapshot loaded
+static void on_open (GApplication* app, GFile** files, int n_files, const char* hint, gpointer user_data){
+	activate (GTK_APPLICATION (app), user_data);
+	char* path = g_file_get_path (files[0]);
+	if (path) {
+		main_ui.defs_panel.load (path);
+	}
+	g_free (path);
+}
+
 int main (int argc, char **argv){
 	int status;
 
-	main_ui.app = gtk_application_new ("org.gtk.example", G_APPLICATION_DEFAULT_FLAGS);
+	main_ui.app = gtk_application_new ("org.gtk.example", G_APPLICATION_HANDLES_OPEN);
 	g_signal_connect (main_ui.app, "activate", G_CALLBACK (activate), NULL);
+	g_signal_connect (main_ui.app, "open", G_CALLBACK (on_open), NULL);
+	// kill -USR1 dumps timings at any point; with MATHVIS_METRICS set they're also written on exit
+	g_unix_signal_add (SIGUSR1, on_dump_signal, NULL);
 	status = g_application_run (G_APPLICATION (main_ui.app), argc, argv);
 	g_object_unref (main_ui.app);
+	if (getenv("MATHVIS_METRICS")) {
+		dump_metrics();
+	}
 
 	return status;
 }
@@ -0,0 +1,114 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+void Metrics::record(MetricStage stage, uint64_t entry, double micros){
+	Ring& ring=rings[stage];
+	std::lock_guard lock(ring.mutex);
+	ring.samples[ring.total%CAPACITY]=Sample{entry,(float)micros};
+	ring.total++;
+}
+
+uint64_t Metrics::snapshot(MetricStage stage, std::vector<Sample>& out){
+	Ring& ring=rings[stage];
+	std::lock_guard lock(ring.mutex);
+	uint64_t first=ring.total>CAPACITY ? ring.total-CAPACITY : 0;
+	for(uint64_t n=first;n<ring.total;n++){
+		out.push_back(ring.samples[n%CAPACITY]);
+	}
+	return ring.total;
+}
+
+std::vector<Metrics::Sample> Metrics::samples(MetricStage stage){
+	std::vector<Sample> ret;
+	snapshot(stage,ret);
+	return ret;
+}
+
+static Metrics::Summary summarize(std::vector<float>& micros, uint64_t total){
+	Metrics::Summary ret;
+	ret.count=micros.size();
+	ret.total=total;
+	if(micros.empty()){
+		return ret;
+	}
+	std::sort(micros.begin(),micros.end());
+	auto at=[&](double p){
+		return micros[std::min(micros.size()-1,(size_t)(p*micros.size()))];
+	};
+	ret.p50=at(0.5);
+	ret.p99=at(0.99);
+	ret.max=micros.back();
+	return ret;
+}
+
+Metrics::Summary Metrics::summary(MetricStage stage){
+	std::vector<Sample> all;
+	uint64_t total=snapshot(stage,all);
+	std::vector<float> micros;
+	for(const Sample& sample : all){
+		micros.push_back(sample.micros);
+	}
+	return summarize(micros,total);
+}
+
+void Metrics::clear(){
+	for(Ring& ring : rings){
+		std::lock_guard lock(ring.mutex);
+		ring.total=0;
+	}
+}
+
+std::string Metrics::table(){
+	std::string ret;
+	char line[128];
+	snprintf(line,sizeof(line),"%-10s %8s %10s %10s %10s\n","stage","count","p50 us","p99 us","max us");
+	ret+=line;
+	for(int stage=0;stage<STAGE_COUNT;stage++){
+		Summary s=summary((MetricStage)stage);
+		snprintf(line,sizeof(line),"%-10s %8lu %10.1f %10.1f %10.1f\n",
+			STAGE_NAMES[stage],(unsigned long)s.total,s.p50,s.p99,s.max);
+		ret+=line;
+	}
+	return ret;
+}
+
+static std::string json_summary(const Metrics::Summary& s){
+	char buf[160];
+	snprintf(buf,sizeof(buf),"\"count\":%lu,\"total\":%lu,\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f",
+		(unsigned long)s.count,(unsigned long)s.total,s.p50,s.p99,s.max);
+	return buf;
+}
+
+std::string Metrics::to_json(){
+	std::string ret="{";
+	char buf[64];
+	for(int stage=0;stage<STAGE_COUNT;stage++){
+		std::vector<Sample> all;
+		uint64_t total=snapshot((MetricStage)stage,all);
+		std::vector<float> micros;
+		std::map<uint64_t,std::vector<float>> by_entry;
+		for(const Sample& sample : all){
+			micros.push_back(sample.micros);
+			by_entry[sample.entry].push_back(sample.micros);
+		}
+
+		ret+=std::string(stage ? "," : "")+"\""+STAGE_NAMES[stage]+"\":{"+json_summary(summarize(micros,total));
+		ret+=",\"entries\":{";
+		bool first=true;
+		for(auto& [entry,times] : by_entry){
+			uint64_t count=times.size();
+			ret+=std::string(first ? "" : ",")+"\""+std::to_string(entry)+"\":{"+json_summary(summarize(times,count))+"}";
+			first=false;
+		}
+		ret+="},\"samples\":[";
+		for(size_t n=0;n<all.size();n++){
+			snprintf(buf,sizeof(buf),"%s[%lu,%.3f]",n ? "," : "",(unsigned long)all[n].entry,all[n].micros);
+			ret+=buf;
+		}
+		ret+="]}";
+	}
+	ret+="}\n";
+	return ret;
+}
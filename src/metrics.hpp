@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//the steps between an edit and the pixels it changes, timed separately
+enum MetricStage : uint8_t{
+	STAGE_TOKENIZE,
+	STAGE_PARSE,
+	STAGE_EVALUATE,
+	STAGE_TO_STRING,
+	//setting an entry's result label on the main loop
+	STAGE_LABEL,
+	//rendering one tile of a layer
+	STAGE_TILE,
+	//searching a curve for its zeros or intersections
+	STAGE_ROOTS,
+	//drawing the whole graph area
+	STAGE_FRAME,
+	STAGE_COUNT
+};
+inline constexpr const char* STAGE_NAMES[STAGE_COUNT]={
+	"tokenize","parse","evaluate","to_string","label","tile","roots","frame"
+};
+
+//recent timings of each stage, with the entry each was for, in a fixed ring per stage;
+//recording from any thread is cheap enough to leave on
+class Metrics{
+public:
+	static constexpr size_t CAPACITY=1024;
+
+	struct Sample{
+		//the definition it was for, or 0 for frames
+		uint64_t entry=0;
+		float micros=0;
+	};
+	struct Summary{
+		//samples still in the ring, and ever recorded
+		size_t count=0;
+		uint64_t total=0;
+		double p50=0,p99=0,max=0;
+	};
+
+	void record(MetricStage stage, uint64_t entry, double micros);
+	//the samples in the ring, oldest first
+	std::vector<Sample> samples(MetricStage stage);
+	Summary summary(MetricStage stage);
+	void clear();
+
+	//one line per stage, for display
+	std::string table();
+	//every stage's summary, per-entry summaries, and the samples themselves
+	std::string to_json();
+
+private:
+	struct Ring{
+		std::mutex mutex;
+		std::array<Sample,CAPACITY> samples;
+		uint64_t total=0;
+	};
+	std::array<Ring,STAGE_COUNT> rings;
+
+	//appends the ring's samples to out, returning how many were ever recorded
+	uint64_t snapshot(MetricStage stage, std::vector<Sample>& out);
+};
+
+inline Metrics metrics;
+
+//the definition this thread is working on, for whatever it records
+inline thread_local uint64_t metric_entry=0;
+
+//records the time from construction to destruction against this thread's current entry
+struct StageTimer{
+	MetricStage stage;
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+
+	StageTimer(MetricStage stage):stage(stage){}
+	StageTimer(const StageTimer&)=delete;
+	~StageTimer(){
+		double micros=std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count();
+		metrics.record(stage,metric_entry,micros);
+	}
+};
@@ -0,0 +1,180 @@
+#include "metrics.hpp"
+#include "plot_render.hpp"
+#include "ui.hpp"
+#include <cmath>
+
+void OutputPanel::init(){
+	tab_pane=GTK_NOTEBOOK(gtk_notebook_new());
+	graph_area=GTK_DRAWING_AREA(gtk_drawing_area_new());
+	widget_set_expand(GTK_WIDGET(graph_area),true);
+	gtk_drawing_area_set_draw_func(graph_area,OutputPanel::_on_draw,this,NULL);
+	graph_overlay=GTK_OVERLAY(gtk_overlay_new());
+	gtk_overlay_set_child(graph_overlay,GTK_WIDGET(graph_area));
+	gtk_notebook_append_page(tab_pane,GTK_WIDGET(graph_overlay),NULL);
+
+	metrics_label=GTK_LABEL(gtk_label_new(NULL));
+	gtk_widget_add_css_class(GTK_WIDGET(metrics_label),"monospace");
+	gtk_widget_add_css_class(GTK_WIDGET(metrics_label),"osd");
+	widget_set_align(GTK_WIDGET(metrics_label),GTK_ALIGN_END,GTK_ALIGN_START);
+	widget_set_margin(GTK_WIDGET(metrics_label),8);
+	//drags and scrolls go through to the graph
+	gtk_widget_set_can_target(GTK_WIDGET(metrics_label),FALSE);
+	gtk_widget_set_visible(GTK_WIDGET(metrics_label),FALSE);
+	gtk_overlay_add_overlay(graph_overlay,GTK_WIDGET(metrics_label));
+
+	GtkEventController* shortcuts=gtk_shortcut_controller_new();
+	gtk_shortcut_controller_set_scope(GTK_SHORTCUT_CONTROLLER(shortcuts),GTK_SHORTCUT_SCOPE_GLOBAL);
+	gtk_shortcut_controller_add_shortcut(GTK_SHORTCUT_CONTROLLER(shortcuts),gtk_shortcut_new(
+		gtk_keyval_trigger_new(GDK_KEY_F12,(GdkModifierType)0),
+		gtk_callback_action_new(OutputPanel::_on_metrics_key,this,NULL)));
+	gtk_widget_add_controller(GTK_WIDGET(tab_pane),shortcuts);
+
+	GtkGesture* drag=gtk_gesture_drag_new();
+	g_signal_connect(drag,"drag-begin",G_CALLBACK(OutputPanel::_on_drag_begin),this);
+	g_signal_connect(drag,"drag-update",G_CALLBACK(OutputPanel::_on_drag_update),this);
+	g_signal_connect(drag,"drag-end",G_CALLBACK(OutputPanel::_on_drag_end),this);
+	gtk_widget_add_controller(GTK_WIDGET(graph_area),GTK_EVENT_CONTROLLER(drag));
+
+	GtkEventController* scroll=gtk_event_controller_scroll_new(GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+	g_signal_connect(scroll,"scroll",G_CALLBACK(OutputPanel::_on_scroll),this);
+	gtk_widget_add_controller(GTK_WIDGET(graph_area),scroll);
+
+	GtkEventController* motion=gtk_event_controller_motion_new();
+	g_signal_connect(motion,"motion",G_CALLBACK(OutputPanel::_on_motion),this);
+	gtk_widget_add_controller(GTK_WIDGET(graph_area),motion);
+
+	//tiles and root searches finish on workers; redraw once on the main loop for however many arrive in the meantime
+	tiles.on_tile_ready=[this](){
+		if(!redraw_queued.exchange(true)){
+			g_idle_add(OutputPanel::_on_tiles_ready,this);
+		}
+	};
+	roots.on_ready=tiles.on_tile_ready;
+}
+
+void OutputPanel::redraw(){
+	if(graph_area){
+		gtk_widget_queue_draw(GTK_WIDGET(graph_area));
+	}
+}
+
+//refreshed twice a second while shown
+void OutputPanel::toggle_metrics(){
+	bool show=!gtk_widget_get_visible(GTK_WIDGET(metrics_label));
+	gtk_widget_set_visible(GTK_WIDGET(metrics_label),show);
+	if(show){
+		_on_metrics_tick(this);
+		if(!metrics_timer){
+			metrics_timer=g_timeout_add(500,OutputPanel::_on_metrics_tick,this);
+		}
+	}
+}
+
+gboolean OutputPanel::_on_metrics_key(GtkWidget*, GVariant*, gpointer userdata){
+	((OutputPanel*)userdata)->toggle_metrics();
+	return TRUE;
+}
+
+gboolean OutputPanel::_on_metrics_tick(gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	if(!gtk_widget_get_visible(GTK_WIDGET(panel->metrics_label))){
+		panel->metrics_timer=0;
+		return G_SOURCE_REMOVE;
+	}
+	std::string table=metrics.table();
+	table.pop_back();
+	gtk_label_set_label(panel->metrics_label,table.c_str());
+	return G_SOURCE_CONTINUE;
+}
+
+gboolean OutputPanel::_on_tiles_ready(gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	panel->redraw_queued=false;
+	panel->redraw();
+	return G_SOURCE_REMOVE;
+}
+
+void OutputPanel::_on_draw(GtkDrawingArea*, cairo_t* cr, int width, int height, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	metric_entry=0;
+	StageTimer timer(STAGE_FRAME);
+	Viewport view=Viewport::around(panel->center_x,panel->center_y,panel->scale,width,height);
+	draw_background(cr,view);
+
+	//half a view ahead of a drag, where it's about to uncover
+	bool moving=panel->motion_x!=0 || panel->motion_y!=0;
+	Viewport ahead;
+	if(moving){
+		double len=hypot(panel->motion_x,panel->motion_y);
+		ahead=Viewport::around(
+			panel->center_x-panel->motion_x/len*width/2*panel->scale,
+			panel->center_y+panel->motion_y/len*height/2*panel->scale,
+			panel->scale,width,height);
+	}
+
+	const DefsPanel& defs=main_ui.defs_panel;
+	defs.model.for_each([&](const DefsModel::Definition& def){
+		if(!def.plotted()){
+			return;
+		}
+		TileLayer layer=defs.tile_layer(def);
+		panel->tiles.draw(cr,view,layer);
+		if(moving){
+			panel->tiles.prefetch(ahead,layer);
+		}
+	});
+
+	//markers go over every curve, from searches that only need redoing once the view strays far from them
+	defs.model.for_each([&](const DefsModel::Definition& def){
+		for(const RootQuery& query : defs.root_queries(def)){
+			std::shared_ptr<const RootCache::Points> points=panel->roots.find(query,view.x0,view.x1);
+			if(points){
+				draw_markers(cr,view,points->xs,points->ys,def.style);
+			}
+		}
+	});
+}
+
+void OutputPanel::_on_drag_begin(GtkGestureDrag*, double, double, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	panel->drag_x=panel->drag_y=0;
+	panel->motion_x=panel->motion_y=0;
+}
+
+void OutputPanel::_on_drag_update(GtkGestureDrag*, double offset_x, double offset_y, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	double dx=offset_x-panel->drag_x;
+	double dy=offset_y-panel->drag_y;
+	panel->drag_x=offset_x;
+	panel->drag_y=offset_y;
+	panel->center_x-=dx*panel->scale;
+	panel->center_y+=dy*panel->scale;
+	panel->motion_x=(panel->motion_x+dx)/2;
+	panel->motion_y=(panel->motion_y+dy)/2;
+	panel->redraw();
+}
+
+void OutputPanel::_on_drag_end(GtkGestureDrag*, double, double, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	panel->motion_x=panel->motion_y=0;
+}
+
+//zooms about the pointer, keeping the point under it in place
+gboolean OutputPanel::_on_scroll(GtkEventControllerScroll*, double, double dy, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	double half_w=gtk_widget_get_width(GTK_WIDGET(panel->graph_area))/2.0;
+	double half_h=gtk_widget_get_height(GTK_WIDGET(panel->graph_area))/2.0;
+	double x=panel->center_x+(panel->pointer_x-half_w)*panel->scale;
+	double y=panel->center_y-(panel->pointer_y-half_h)*panel->scale;
+	panel->scale*=pow(1.1,dy);
+	panel->center_x=x-(panel->pointer_x-half_w)*panel->scale;
+	panel->center_y=y+(panel->pointer_y-half_h)*panel->scale;
+	panel->redraw();
+	return TRUE;
+}
+
+void OutputPanel::_on_motion(GtkEventControllerMotion*, double x, double y, gpointer userdata){
+	OutputPanel* panel=(OutputPanel*)userdata;
+	panel->pointer_x=x;
+	panel->pointer_y=y;
+}
@@ -0,0 +1,33 @@
+#include "parameters.hpp"
+
+void Parameters::set(ID name, double value){
+	std::lock_guard lock(mutex);
+	values[name]=value;
+}
+
+void Parameters::remove(ID name){
+	std::lock_guard lock(mutex);
+	values.erase(name);
+}
+
+bool Parameters::has(ID name) const {
+	std::lock_guard lock(mutex);
+	return values.count(name);
+}
+
+double Parameters::value(ID name) const {
+	std::lock_guard lock(mutex);
+	auto found=values.find(name);
+	return found==values.end() ? NAN : found->second;
+}
+
+std::shared_ptr<const CompiledExpr> Parameters::bind(const std::shared_ptr<const CompiledExpr>& fn, const vector<ID>& names) const {
+	if(!fn || names.empty() || names.size()>fn->inputs().size()){
+		return fn;
+	}
+	vector<double> fixed;
+	for(ID name : names){
+		fixed.push_back(value(name));
+	}
+	return fn->bind(fn->inputs().size()-names.size(),fixed.data());
+}
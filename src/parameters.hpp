@@ -0,0 +1,25 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include "compiled.hpp"
+
+//names bound to a slider or an animation clock instead of a definition
+//definitions keep them as free variables, and the graph compiles them as trailing inputs of the plot function,
+//so a new value is just bound into the compiled form: nothing is parsed, substituted or evaluated again
+class Parameters{
+public:
+	//makes name a parameter, or moves it if it already is one
+	void set(ID name, double value);
+	void remove(ID name);
+	bool has(ID name) const;
+	//NaN if name isn't a parameter
+	double value(ID name) const;
+	//fn, compiled over some inputs followed by names, with names fixed at their current values; fn itself if there are none
+	std::shared_ptr<const CompiledExpr> bind(const std::shared_ptr<const CompiledExpr>& fn, const vector<ID>& names) const;
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<ID,double> values;
+};
+
+inline Parameters parameters;
@@ -0,0 +1,112 @@
+#include "parse_cache.hpp"
+
+size_t expr_bytes(const Expr& ex){
+	if(!ex.defined()){
+		return 0;
+	}
+	//node plus the deque's map and first block, which it allocates as soon as it holds anything
+	size_t bytes=sizeof(ExprNode)+sizeof(number_t);
+	if(!ex.node->subexprs.empty()){
+		bytes+=512+8*sizeof(void*);
+	}
+	for(const Expr& child : ex.node->subexprs){
+		bytes+=expr_bytes(child);
+	}
+	return bytes;
+}
+
+list<ParseCache::Entry>::iterator ParseCache::lookup(const string& text){
+	auto found=by_hash.find(str_hash(text));
+	if(found==by_hash.end() || found->second->text!=text){
+		return lru.end();
+	}
+	lru.splice(lru.begin(),lru,found->second);
+	return found->second;
+}
+
+void ParseCache::evict(){
+	while(counters.bytes>max_bytes && !lru.empty()){
+		Entry& last=lru.back();
+		by_hash.erase(str_hash(last.text));
+		counters.bytes-=last.bytes;
+		counters.evictions++;
+		lru.pop_back();
+	}
+	counters.entries=lru.size();
+}
+
+bool ParseCache::find(const string& text, Result& out){
+	std::lock_guard lock(mutex);
+	auto entry=lookup(text);
+	if(entry==lru.end()){
+		counters.misses++;
+		return false;
+	}
+	counters.hits++;
+	out.parsed=entry->parsed;
+	out.has_value=entry->has_value;
+	if(entry->has_value){
+		counters.value_hits++;
+		out.value=entry->value;
+	}
+	return true;
+}
+
+void ParseCache::store(const string& text, std::shared_ptr<const Expr> parsed){
+	if(text.empty() || !parsed){
+		return;
+	}
+	std::lock_guard lock(mutex);
+	if(lookup(text)!=lru.end()){
+		return;
+	}
+	uint64_t hash=str_hash(text);
+	auto collided=by_hash.find(hash);
+	if(collided!=by_hash.end()){
+		counters.bytes-=collided->second->bytes;
+		lru.erase(collided->second);
+		by_hash.erase(collided);
+	}
+
+	lru.emplace_front();
+	Entry& entry=lru.front();
+	entry.text=text;
+	entry.bytes=sizeof(Entry)+text.size()+expr_bytes(*parsed);
+	entry.parsed=std::move(parsed);
+	by_hash.emplace(hash,lru.begin());
+	counters.bytes+=entry.bytes;
+	evict();
+}
+
+void ParseCache::store_value(const string& text, const Expr& value){
+	std::lock_guard lock(mutex);
+	auto entry=lookup(text);
+	if(entry==lru.end() || entry->has_value){
+		return;
+	}
+	size_t value_bytes=expr_bytes(value);
+	entry->value=value;
+	entry->has_value=true;
+	entry->bytes+=value_bytes;
+	counters.bytes+=value_bytes;
+	evict();
+}
+
+void ParseCache::set_max_bytes(size_t to){
+	std::lock_guard lock(mutex);
+	max_bytes=to;
+	evict();
+}
+
+ParseCache::Stats ParseCache::stats(){
+	std::lock_guard lock(mutex);
+	return counters;
+}
+
+void ParseCache::clear(){
+	std::lock_guard lock(mutex);
+	lru.clear();
+	by_hash.clear();
+	counters.bytes=0;
+	counters.entries=0;
+}
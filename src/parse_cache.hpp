@@ -0,0 +1,66 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include "expression.hpp"
+
+//approximate heap footprint of an expression tree
+size_t expr_bytes(const Expr& ex);
+
+//process-wide LRU of parses by source text, plus their values where those can't depend on anything outside the text
+//evicts least recently used entries once the estimated memory use goes over max_bytes
+struct ParseCache{
+	struct Stats{
+		uint64_t hits=0;
+		uint64_t misses=0;
+		uint64_t value_hits=0;
+		uint64_t evictions=0;
+		size_t bytes=0;
+		size_t entries=0;
+
+		double hit_rate() const {
+			return hits+misses ? (double)hits/(hits+misses) : 0;
+		}
+	};
+
+	struct Result{
+		//shared with the cache, rather than copied out of it
+		std::shared_ptr<const Expr> parsed;
+		Expr value;
+		bool has_value=false;
+	};
+
+	//a cached parse of text (and a copy of its value, if it has one); false if there is none
+	bool find(const string& text, Result& out);
+	void store(const string& text, std::shared_ptr<const Expr> parsed);
+	//attaches a value to text's entry; only for values that don't depend on free variables
+	void store_value(const string& text, const Expr& value);
+
+	void set_max_bytes(size_t);
+	Stats stats();
+	void clear();
+
+private:
+	struct Entry{
+		string text;
+		std::shared_ptr<const Expr> parsed;
+		Expr value;
+		bool has_value=false;
+		size_t bytes=0;
+	};
+
+	std::mutex mutex;
+	size_t max_bytes=64<<20;
+	list<Entry> lru;
+	std::unordered_map<uint64_t,list<Entry>::iterator> by_hash;
+	Stats counters;
+
+	list<Entry>::iterator lookup(const string& text);
+	void evict();
+};
+
+inline ParseCache parse_cache;
+
+//whether an expression's value can be cached with its text
+inline bool expr_is_pure(const Expr& ex){
+	return ex.find_vars().empty();
+}
@@ -1,51 +1,79 @@
 #include "parser.hpp"
 #include "expression.hpp"
+#include "metrics.hpp"
+#include <array>
+
+constexpr uint32_t OPERATOR_TOKENS=[](){
+	uint32_t mask=0;
+	for(Token::Type t : {Token::PLUS, Token::MINUS, Token::TIMES, Token::DIVIDE, Token::POWER, Token::NOT, Token::EQUAL, Token::AND,
+			Token::OR, Token::LESS, Token::LESS_EQUAL, Token::GREATER, Token::GREATER_EQUAL, Token::INDEX, Token::CALL}){
+		mask|=1u<<t;
+	}
+	return mask;
+}();
+static_assert(Token::TYPE_COUNT<=32);
 
+bool token_is_operator(const Token& t){
+	return OPERATOR_TOKENS>>t.type & 1;
+}
 
-struct Token{
-#define MODE(NAME,VALUE) inline static const ID NAME = #VALUE##_id
-	MODE(PLUS,+);
-	MODE(MINUS,-);
-	MODE(TIMES,*);
-	MODE(DIVIDE,/);
-	MODE(POWER,^);
-	MODE(PARENTHESES,());
-	MODE(SQUARE_BRACKET,[]);
-	MODE(CURLY_BRACKET,{});
-	MODE(NOT,~);
-	MODE(EQUAL,=);
-	MODE(AND,&);
-	MODE(OR,|);
-	MODE(LESS,<);
-	MODE(LESS_EQUAL,<=);
-	MODE(GREATER,>);
-	MODE(GREATER_EQUAL,>=);
-	MODE(INDEX,@);
-	MODE(CALL,#);
-	inline static const ID COMMA = ","_id;
-	MODE(IDENTIFIER,id);
-	MODE(NUMBER,num);
-#undef MODE
-
-	//a type from above
-	ID type;
-
-	//only if type == id
-	ID id;
-
-	//only if type is PARENTHESES, SQUARE_BRACKET, or CURLY_BRACKET
-	list<Token> subtokens;
-
-	//only if type is NUMBER
-	number_t num;
+//what a character can start, so the tokenizer needs one lookup per character
+struct CharInfo{
+	enum Class : uint8_t{
+		IGNORED, ID_CHAR, NUM_CHAR, OPEN, SINGLE, COMPARE
+	};
+	Class cls=IGNORED;
+	//the token it makes; for COMPARE, when not followed by '='
+	Token::Type token=Token::NONE;
+	//for COMPARE, when followed by '='
+	Token::Type with_equal=Token::NONE;
+	//for OPEN
+	char close=0;
+	const char* name="";
 };
 
-bool token_is_operator(Token t){
-	return t.type==Token::PLUS || t.type==Token::MINUS || t.type==Token::TIMES || t.type==Token::DIVIDE || t.type==Token::POWER || t.type==Token::NOT || t.type==Token::EQUAL || t.type==Token::AND || t.type==Token::OR || t.type==Token::LESS || t.type==Token::LESS_EQUAL || t.type==Token::GREATER || t.type==Token::GREATER_EQUAL || t.type==Token::INDEX || t.type==Token::CALL;
+constexpr std::array<CharInfo,256> CHAR_INFO=[](){
+	std::array<CharInfo,256> table{};
+	for(int c='a';c<='z';c++) table[c].cls=CharInfo::ID_CHAR;
+	for(int c='A';c<='Z';c++) table[c].cls=CharInfo::ID_CHAR;
+	table['_'].cls=CharInfo::ID_CHAR;
+	for(int c='0';c<='9';c++) table[c].cls=CharInfo::NUM_CHAR;
+	table['.'].cls=CharInfo::NUM_CHAR;
+
+	auto open=[&](char c, char close, Token::Type t, const char* name){
+		table[(uint8_t)c]={CharInfo::OPEN,t,Token::NONE,close,name};
+	};
+	open('(',')',Token::PARENTHESES,"parentheses");
+	open('[',']',Token::SQUARE_BRACKET,"square brackets");
+	open('{','}',Token::CURLY_BRACKET,"curly brackets");
+
+	auto single=[&](char c, Token::Type t){
+		table[(uint8_t)c]={CharInfo::SINGLE,t};
+	};
+	single('@',Token::INDEX);
+	single('#',Token::CALL);
+	single('^',Token::POWER);
+	single('/',Token::DIVIDE);
+	single('*',Token::TIMES);
+	single('-',Token::MINUS);
+	single('+',Token::PLUS);
+	single('=',Token::EQUAL);
+	single('~',Token::NOT);
+	single('&',Token::AND);
+	single('|',Token::OR);
+	single(',',Token::COMMA);
+
+	table['<']={CharInfo::COMPARE,Token::LESS,Token::LESS_EQUAL};
+	table['>']={CharInfo::COMPARE,Token::GREATER,Token::GREATER_EQUAL};
+	return table;
+}();
+
+constexpr const CharInfo& char_info(char c){
+	return CHAR_INFO[(uint8_t)c];
 }
 
 //may throw Parser::ParseFail if syntax is really bad
-list<Token> tokenize(string);
+list<Token> tokenize(const string&);
 using TokenIterator = list<Token>::const_iterator;
 using CharIterator = string::const_iterator;
 
@@ -73,19 +101,32 @@ void seek_char(CharIterator& iter, const CharIterator& end, char target){
 }
 
 bool is_id_char(char c){
-	return c>='a'&&c<='z' || c>='A'&&c<='Z' || c=='_';
+	return char_info(c).cls==CharInfo::ID_CHAR;
 }
 bool is_num_char(char c){
-	return c>='0'&&c<='9' || c=='.';
+	return char_info(c).cls==CharInfo::NUM_CHAR;
+}
+
+Token identifier_token(const string& name, size_t begin, size_t end){
+	Token t;
+	t.type=Token::IDENTIFIER;
+	t.id=ID(name);
+	t.begin=begin;
+	t.end=end;
+	return t;
 }
 
-list<Token> tokenize(string str){
+//tokenizes str[from,to), with token positions relative to the start of str
+list<Token> tokenize(const string& str, size_t from, size_t to){
 	list<Token> ret;
 	bool is_making_id=false;
 	bool is_making_number=false;
 	string accum;
-	CharIterator iter=str.begin();
-	while(iter!=str.end()){
+	size_t accum_begin=0;
+	const CharIterator start=str.begin();
+	const CharIterator end=str.begin()+to;
+	CharIterator iter=str.begin()+from;
+	while(iter!=end){
 
 		if(is_making_id){
 			if(is_id_char(*iter)){
@@ -93,12 +134,9 @@ list<Token> tokenize(string str){
 				iter++;
 			}
 			else{
-				Token t;
-				t.type=Token::IDENTIFIER;
-				t.id=ID(accum);
+				ret.push_back(identifier_token(accum,accum_begin,iter-start));
 				accum="";
 				is_making_id=false;
-				ret.push_back(t);
 			}
 			continue;
 		}
@@ -116,6 +154,8 @@ list<Token> tokenize(string str){
 				}catch(std::invalid_argument){
 					throw ParseFail("bad number syntax");
 				}
+				t.begin=accum_begin;
+				t.end=iter-start;
 				accum="";
 				is_making_number=false;
 				ret.push_back(t);
@@ -123,131 +163,73 @@ list<Token> tokenize(string str){
 			continue;
 		}
 
-		if(is_id_char(*iter)){
+		const CharInfo& info=char_info(*iter);
+		switch(info.cls){
+
+		case CharInfo::ID_CHAR:
 			accum.push_back(*iter);
+			accum_begin=iter-start;
 			is_making_id=true;
 			iter++;
 			continue;
-		}
 
-		if(is_num_char(*iter)){
+		case CharInfo::NUM_CHAR:
 			accum.push_back(*iter);
+			accum_begin=iter-start;
 			is_making_number=true;
 			iter++;
 			continue;
-		}
 
-		if(*iter=='('){
+		case CharInfo::OPEN:{
 			auto icpy = iter;
-			seek_char(++icpy,str.end(),')');
-			if(icpy==str.end()){
-				throw ParseFail("unclosed parentheses");
+			seek_char(++icpy,end,info.close);
+			if(icpy==end){
+				throw ParseFail("unclosed "+string(info.name));
 			}
-			iter++;
-			if(iter==icpy){
-				throw ParseFail("nothing in parentheses");
-			}
-			string sub (iter,icpy);
 			Token t;
-			t.type=Token::PARENTHESES;
-			t.subtokens=tokenize(sub);
-			ret.push_back(t);
-			iter=icpy;
-			iter++;
-			continue;
-		}
-
-		if(*iter=='['){
-			auto icpy = iter;
-			seek_char(++icpy,str.end(),']');
-			if(icpy==str.end()){
-				throw ParseFail("unclosed square brackets");
-			}
+			t.type=info.token;
+			t.begin=iter-start;
+			t.end=icpy-start+1;
 			iter++;
 			if(iter==icpy){
-				throw ParseFail("nothing in square brackets");
+				throw ParseFail("nothing in "+string(info.name));
 			}
-			string sub (iter,icpy);
-			Token t;
-			t.type=Token::SQUARE_BRACKET;
-			t.subtokens=tokenize(sub);
+			t.subtokens=tokenize(str,iter-start,icpy-start);
 			ret.push_back(t);
 			iter=icpy;
 			iter++;
 			continue;
 		}
 
-		if(*iter=='{'){
-			auto icpy = iter;
-			seek_char(++icpy,str.end(),'}');
-			if(icpy==str.end()){
-				throw ParseFail("unclosed curly brackets");
-			}
-			iter++;
-			if(iter==icpy){
-				throw ParseFail("nothing in curly brackets");
-			}
-			string sub (iter,icpy);
+		case CharInfo::SINGLE:{
 			Token t;
-			t.type=Token::CURLY_BRACKET;
-			t.subtokens=tokenize(sub);
+			t.type=info.token;
+			t.begin=iter-start;
+			t.end=t.begin+1;
 			ret.push_back(t);
-			iter=icpy;
 			iter++;
 			continue;
 		}
 
-#define CHAR_TOKEN(CHAR,TOKTYPE)     \
-		if(*iter==CHAR){                 \
-			Token t;                       \
-			t.type = Token::TOKTYPE;       \
-			ret.push_back(t);              \
-			iter++;                        \
-			continue;                      \
-		}
-
-		CHAR_TOKEN('@',INDEX)
-		CHAR_TOKEN('#',CALL)
-		CHAR_TOKEN('^',POWER)
-		CHAR_TOKEN('/',DIVIDE)
-		CHAR_TOKEN('*',TIMES)
-		CHAR_TOKEN('-',MINUS)
-		CHAR_TOKEN('+',PLUS)
-		CHAR_TOKEN('=',EQUAL)
-		CHAR_TOKEN('~',NOT)
-		CHAR_TOKEN('&',AND)
-		CHAR_TOKEN('|',OR)
-		CHAR_TOKEN(',',COMMA)
-#undef CHAR_TOKEN
-
-		if(*iter=='<'){
+		case CharInfo::COMPARE:{
+			Token t;
+			t.begin=iter-start;
 			iter++;
-			if(iter==str.end() || *iter!='='){
-				Token t;
-				t.type=Token::LESS;
+			if(iter==end || *iter!='='){
+				t.type=info.token;
+				t.end=t.begin+1;
 				ret.push_back(t);
 				continue;
 			}
-			Token t;
-			t.type=Token::LESS_EQUAL;
+			t.type=info.with_equal;
+			t.end=t.begin+2;
 			ret.push_back(t);
 			iter++;
 			continue;
 		}
 
-		if(*iter=='>'){
-			iter++;
-			if(iter==str.end() || *iter!='='){
-				Token t;
-				t.type=Token::GREATER;
-				ret.push_back(t);
-				continue;
-			}
-			Token t;
-			t.type=Token::GREATER_EQUAL;
-			ret.push_back(t);
-			iter++;
-			continue;
+		case CharInfo::IGNORED:
+			break;
 		}
 
 		//ignore all other characters
@@ -256,12 +238,9 @@ list<Token> tokenize(string str){
 	}
 
 	if(is_making_id){
-		Token t;
-		t.type=Token::IDENTIFIER;
-		t.id=ID(accum);
+		ret.push_back(identifier_token(accum,accum_begin,to));
 		accum="";
 		is_making_id=false;
-		ret.push_back(t);
 	}
 
 	if(is_making_number){
@@ -272,6 +251,8 @@ list<Token> tokenize(string str){
 		}catch(std::invalid_argument){
 			throw ParseFail("bad number syntax");
 		}
+		t.begin=accum_begin;
+		t.end=to;
 		accum="";
 		is_making_number=false;
 		ret.push_back(t);
@@ -280,10 +261,78 @@ list<Token> tokenize(string str){
 	return ret;
 }
 
+list<Token> tokenize(const string& str){
+	return tokenize(str,0,str.size());
+}
+
+bool is_bracket_char(char c){
+	return c=='(' || c==')' || c=='[' || c==']' || c=='{' || c=='}';
+}
+
+bool is_bracket_token(const Token& t){
+	return t.type==Token::PARENTHESES || t.type==Token::SQUARE_BRACKET || t.type==Token::CURLY_BRACKET;
+}
+
+//tokens that could absorb characters typed right after them
+bool token_can_extend(const Token& t){
+	return t.type==Token::IDENTIFIER || t.type==Token::NUMBER || t.type==Token::LESS || t.type==Token::GREATER;
+}
+
+void shift_tokens(list<Token>::iterator iter, const list<Token>::iterator& end, long delta){
+	while(iter!=end){
+		iter->begin+=delta;
+		iter->end+=delta;
+		shift_tokens(iter->subtokens.begin(),iter->subtokens.end(),delta);
+		iter++;
+	}
+}
+
+//updates tokens of the old text range [lo,hi) after old [pos,pos+removed) was replaced by 'inserted' bytes
+//text is the new text; the edit must not add or remove any brackets
+//returns false if the tokens can't be patched and the text needs a full tokenize
+bool retokenize(list<Token>& tokens, const string& text, size_t lo, size_t hi, size_t pos, size_t removed, size_t inserted){
+	long delta=(long)inserted-(long)removed;
+	using Iter=list<Token>::iterator;
+
+	//an edit inside brackets only touches what's between them
+	for(Iter it=tokens.begin(); it!=tokens.end() && it->begin<pos; it++){
+		if(is_bracket_token(*it) && pos+removed<it->end){
+			if((long)(it->end-it->begin-2)+delta<=0){
+				return false;
+			}
+			if(!retokenize(it->subtokens,text,it->begin+1,it->end-1,pos,removed,inserted)){
+				return false;
+			}
+			it->end+=delta;
+			Iter next=it;
+			shift_tokens(++next,tokens.end(),delta);
+			return true;
+		}
+	}
+
+	Iter first=tokens.begin();
+	while(first!=tokens.end() && (first->end<pos || (first->end==pos && !token_can_extend(*first)))){
+		first++;
+	}
+	Iter kept=first;
+	while(kept!=tokens.end() && kept->begin<=pos+removed){
+		kept++;
+	}
+
+	size_t from = first!=tokens.end() ? std::min(first->begin,pos) : pos;
+	size_t to = (kept!=tokens.end() ? kept->begin : hi) + delta;
+	list<Token> fresh=tokenize(text,from,to);
+
+	shift_tokens(kept,tokens.end(),delta);
+	tokens.erase(first,kept);
+	tokens.splice(kept,fresh);
+	return true;
+}
+
 //gets a token of type 'what' at iter, assigns it to where (if where isn't NULL)
 //if fails, throws ParseFail
 //increments iter
-void expect(TokenIterator& iter,ID what,Token* where){
+void expect(TokenIterator& iter,Token::Type what,Token* where){
 	if(iter->type==what){
 		if(where){
 			*where=*iter;
@@ -291,16 +340,16 @@ void expect(TokenIterator& iter,ID what,Token* where){
 		iter++;
 	}
 	else{
-		throw ParseFail("expected "+string(what));
+		throw ParseFail("expected "+string(Token::NAMES[what]));
 	}
 }
 
 //increments iter until just past a token of type 'what'
 //throws ParseFail if not found
 //assigns content between [iter , found) to middle, if not NULL
-void seek(TokenIterator& iter, const TokenIterator& end, ID what,list<Token>* middle, Token* found){
+void seek(TokenIterator& iter, const TokenIterator& end, Token::Type what,list<Token>* middle, Token* found){
 	if(iter==end){
-		throw ParseFail("expected "+string(what));
+		throw ParseFail("expected "+string(Token::NAMES[what]));
 	}
 	while(iter!=end){
 		if(iter->type==what){
@@ -315,12 +364,12 @@ void seek(TokenIterator& iter, const TokenIterator& end, ID what,list<Token>* mi
 			iter++;
 		}
 	}
-	throw ParseFail("expected "+string(what));
+	throw ParseFail("expected "+string(Token::NAMES[what]));
 }
 
 //increments iter until just past a token of type 'what', or to end
 //assigns content between iter and found (or remainder) (exclusive) to middle, if not NULL
-void seek_opt(TokenIterator& iter, const TokenIterator& end, ID what,list<Token>* middle, Token* found) noexcept{
+void seek_opt(TokenIterator& iter, const TokenIterator& end, Token::Type what,list<Token>* middle, Token* found) noexcept{
 	while(iter!=end){
 		if(iter->type==what){
 			if(found){
@@ -339,7 +388,7 @@ void seek_opt(TokenIterator& iter, const TokenIterator& end, ID what,list<Token>
 template<typename NODE>
 struct _expr_type;
 
-#define ETYPE(AAA,BBB) template<> struct _expr_type<BBB>{ static constexpr const ID& op = Token::AAA; };
+#define ETYPE(AAA,BBB) template<> struct _expr_type<BBB>{ static constexpr Token::Type op = Token::AAA; };
 
 ETYPE(INDEX,Index)
 ETYPE(CALL,Call)
@@ -359,15 +408,68 @@ ETYPE(OR,Or)
 
 #undef ETYPE
 
-Expr parse_non_op(const list<Token>&);
+Expr parse_non_op(const list<Token>&,ParseMemo*);
+
+//parses a nonempty run of tokens, or takes it from the memo if that text was parsed before
+template<typename PARSER>
+Expr parse_span(const list<Token>& tokens, ParseMemo* memo){
+	if(!memo || (tokens.size()==1 && tokens.front().subtokens.empty())){
+		return PARSER{memo}(tokens);
+	}
+	size_t begin=tokens.front().begin;
+	size_t end=tokens.back().end;
+	Expr ex=memo->reuse(begin,end);
+	if(!ex.defined()){
+		ex=PARSER{memo}(tokens);
+	}
+	memo->record(begin,end,ex);
+	return ex;
+}
+
+//sum # x and product # x are reductions rather than calls: over a range if x is a tuple (k, lo, hi, term), and
+//otherwise over the values of x; integral # x only takes a range
+//the tuple is kept as parsed, as the memo may have recorded it
+template<typename REDUCTION>
+Expr reduction(Expr&& over){
+	REDUCTION* ret=new REDUCTION();
+	const deque<Expr>& args=over.node->subexprs;
+	if(over.type()==Tuple::type && args.size()==4 && args.front().type()==Variable::type){
+		ret->variable=dynamic_cast<const Variable*>(args.front().node.get())->name;
+	}
+	ret->subexprs.push_back(std::move(over));
+	return ret;
+}
+
+Expr reduction(deque<Expr>& call){
+	if(call.size()!=2 || call.front().type()!=Variable::type || !call.back().defined()){
+		return Expr();
+	}
+	std::string_view name=dynamic_cast<const Variable*>(call.front().node.get())->name.view();
+	if(name=="sum"){
+		return reduction<Sum>(std::move(call.back()));
+	}
+	if(name=="product"){
+		return reduction<Product>(std::move(call.back()));
+	}
+	if(name=="integral"){
+		Expr ret=reduction<DefiniteIntegral>(std::move(call.back()));
+		if(!dynamic_cast<const DefiniteIntegral*>(ret.node.get())->variable){
+			throw ParseFail("integral takes (variable, from, to, integrand)");
+		}
+		return ret;
+	}
+	return Expr();
+}
 
 template<typename...Ts>
 struct parse_op;
 
 template<typename NODE,typename...OTHERS>
 struct parse_op<NODE,OTHERS...>{
+	ParseMemo* memo=nullptr;
+
 	Expr operator ()(const list<Token>& tokens) const {
-		ID op = _expr_type<NODE>::op;
+		Token::Type op = _expr_type<NODE>::op;
 		TokenIterator iter=tokens.begin();
 		deque<Expr> subexprs;
 		list<Token> sub;
@@ -375,8 +477,12 @@ struct parse_op<NODE,OTHERS...>{
 			seek_opt(iter,tokens.end(),op,&sub,NULL);
 			if(sub.empty()){
 				subexprs.push_back(Expr());
+			}else if(subexprs.empty() && iter==tokens.end()){
+				//no operator at this level, so it's the same span one level down
+				subexprs.push_back(parse_op<OTHERS...>{memo}(sub));
+				sub.clear();
 			}else{
-				subexprs.push_back(parse_op<OTHERS...>()(sub));
+				subexprs.push_back(parse_span<parse_op<OTHERS...>>(sub,memo));
 				sub.clear();
 			}
 			if(iter!=tokens.end()){
@@ -390,6 +496,12 @@ struct parse_op<NODE,OTHERS...>{
 		if(subexprs.size()==1){
 			return std::move(subexprs.front());
 		}
+		if constexpr(std::is_same_v<NODE,Call>){
+			Expr ex=reduction(subexprs);
+			if(ex.defined()){
+				return ex;
+			}
+		}
 		NODE* ex = new NODE();
 		ex->subexprs=std::move(subexprs);
 		return ex;
@@ -397,18 +509,20 @@ struct parse_op<NODE,OTHERS...>{
 };
 
 template<> struct parse_op<>{
+	ParseMemo* memo=nullptr;
+
 	Expr operator()(const list<Token>& tokens) const{
-		return parse_non_op(tokens);
+		return parse_non_op(tokens,memo);
 	}
 };
 
-Expr parse_tokens(const list<Token>& tokens){
+Expr parse_tokens(const list<Token>& tokens, ParseMemo* memo=nullptr){
 	if(tokens.empty())
 		return Expr();
-	return parse_op<Equal,Add,Sub,Mul,Div,Exponent,Call,Index>()(tokens);
+	return parse_span<parse_op<Equal,Add,Sub,Mul,Div,Exponent,Call,Index>>(tokens,memo);
 }
 
-deque<Expr> parse_list(const list<Token>& tokens){
+deque<Expr> parse_list(const list<Token>& tokens, ParseMemo* memo){
 	TokenIterator iter=tokens.begin();
 	deque<Expr> subexprs;
 	list<Token> sub;
@@ -417,7 +531,7 @@ deque<Expr> parse_list(const list<Token>& tokens){
 		if(sub.empty()){
 			subexprs.push_back(Expr());
 		}else{
-			subexprs.push_back(parse_tokens(sub));
+			subexprs.push_back(parse_tokens(sub,memo));
 			sub.clear();
 		}
 		if(iter!=tokens.end()){
@@ -427,9 +541,9 @@ deque<Expr> parse_list(const list<Token>& tokens){
 	return subexprs;
 }
 
-Expr parse_one(const Token& token){
+Expr parse_one(const Token& token, ParseMemo* memo){
 	if(token.type==Token::PARENTHESES){
-		deque<Expr> sub = parse_list(token.subtokens);
+		deque<Expr> sub = parse_list(token.subtokens,memo);
 		if(sub.empty()){
 			throw ParseFail("empty ()");
 		}
@@ -442,7 +556,7 @@ Expr parse_one(const Token& token){
 	}
 
 	else if(token.type==Token::SQUARE_BRACKET){
-		deque<Expr> sub = parse_list(token.subtokens);
+		deque<Expr> sub = parse_list(token.subtokens,memo);
 		if(sub.empty()){
 			throw ParseFail("empty []");
 		}
@@ -470,12 +584,12 @@ Expr parse_one(const Token& token){
 	throw ParseFail("syntax error");
 }
 
-Expr parse_non_op(const list<Token>& tokens){
+Expr parse_non_op(const list<Token>& tokens, ParseMemo* memo){
 	if(tokens.empty()){
 		throw ParseFail("expected expression");
 	}
 	if(tokens.size()==1){
-		return parse_one(tokens.front());
+		return parse_one(tokens.front(),memo);
 	}
 	throw ParseFail("invalid adjacent non-operator tokens");
 }
@@ -483,3 +597,262 @@ Expr parse_non_op(const list<Token>& tokens){
 Expr parse(string str){
 	return parse_tokens(tokenize(str));
 }
+
+void ParseMemo::start(Expr& prev){
+	prev_spans=std::move(spans);
+	spans.clear();
+	prev_slots.clear();
+	prev_parents.clear();
+	prev_nodes.clear();
+	for(auto& [hash,span] : prev_spans){
+		prev_nodes.emplace(span.node,span);
+	}
+	collect(prev,nullptr);
+}
+
+void ParseMemo::clear(){
+	spans.clear();
+	prev_spans.clear();
+	prev_slots.clear();
+	prev_parents.clear();
+	prev_nodes.clear();
+}
+
+void ParseMemo::collect(Expr& ex, const ExprNode* parent){
+	if(!ex.defined()){
+		return;
+	}
+	prev_slots.emplace(ex.node.get(),&ex);
+	prev_parents.emplace(ex.node.get(),parent);
+	for(Expr& child : ex.node->subexprs){
+		collect(child,ex.node.get());
+	}
+}
+
+Expr ParseMemo::reuse(size_t begin, size_t end){
+	if(!prev_text){
+		return Expr();
+	}
+	size_t len=end-begin;
+	auto range=prev_spans.equal_range(str_hash(text->data()+begin,len));
+	for(auto it=range.first; it!=range.second; it++){
+		const Span& span=it->second;
+		if(span.len!=len || prev_text->compare(span.begin,len,*text,begin,len)!=0){
+			continue;
+		}
+		//the same text may occur more than once, but each subtree can only be taken once
+		auto slot=prev_slots.find(span.node);
+		if(slot==prev_slots.end()){
+			continue;
+		}
+		Expr ex=std::move(*slot->second);
+		//the ancestors are missing it now, so taking one of them would take a hole
+		for(auto parent=prev_parents.find(span.node); parent!=prev_parents.end() && parent->second;
+			parent=prev_parents.find(parent->second)){
+			prev_slots.erase(parent->second);
+		}
+		retire(ex,span.begin,begin,true);
+		return ex;
+	}
+	return Expr();
+}
+
+//ex went into the new parse, moved from old_begin to begin: its nodes can't be taken again, and its descendants
+//are recorded at their new places, so the next edit can still reuse them (the root is recorded by its caller)
+void ParseMemo::retire(const Expr& ex, size_t old_begin, size_t begin, bool root){
+	if(!ex.defined()){
+		return;
+	}
+	const ExprNode* node=ex.node.get();
+	prev_slots.erase(node);
+	auto found=prev_nodes.find(node);
+	if(!root && found!=prev_nodes.end()){
+		const Span& span=found->second;
+		size_t at=span.begin-old_begin+begin;
+		spans.emplace(str_hash(text->data()+at,span.len),Span{node,at,span.len});
+	}
+	for(const Expr& child : node->subexprs){
+		retire(child,old_begin,begin,false);
+	}
+}
+
+void ParseMemo::record(size_t begin, size_t end, const Expr& ex){
+	if(!ex.defined()){
+		return;
+	}
+	spans.emplace(str_hash(text->data()+begin,end-begin),Span{ex.node.get(),begin,end-begin});
+}
+
+void forget_values(const Expr& ex, std::unordered_map<const ExprNode*,Expr>& values){
+	if(!ex.defined()){
+		return;
+	}
+	values.erase(ex.node.get());
+	for(const Expr& child : ex.node->subexprs){
+		forget_values(child,values);
+	}
+}
+
+void IncrementalParse::edit(size_t pos, size_t removed, const string& inserted){
+	bool brackets_changed=false;
+	for(size_t n=pos;n<pos+removed;n++){
+		brackets_changed |= is_bracket_char(text[n]);
+	}
+	for(char c : inserted){
+		brackets_changed |= is_bracket_char(c);
+	}
+
+	size_t old_size=text.size();
+	text.replace(pos,removed,inserted);
+
+	if(!tokens_valid){
+		return;
+	}
+	if(brackets_changed){
+		tokens_valid=false;
+		return;
+	}
+	try{
+		tokens_valid=retokenize(tokens,text,0,old_size,pos,removed,inserted.size());
+	}catch(ParseFail){
+		tokens_valid=false;
+	}
+}
+
+//as a single edit over the span where the texts differ
+void IncrementalParse::set_text(const string& to){
+	size_t shorter=std::min(text.size(),to.size());
+	size_t prefix=0;
+	while(prefix<shorter && text[prefix]==to[prefix]){
+		prefix++;
+	}
+	size_t suffix=0;
+	while(suffix<shorter-prefix && text[text.size()-1-suffix]==to[to.size()-1-suffix]){
+		suffix++;
+	}
+	if(prefix==text.size() && prefix==to.size()){
+		return;
+	}
+	edit(prefix,text.size()-prefix-suffix,to.substr(prefix,to.size()-prefix-suffix));
+}
+
+const Expr& IncrementalParse::reparse(){
+	if(!tokens_valid){
+		StageTimer timer(STAGE_TOKENIZE);
+		tokens=tokenize(text);
+		tokens_valid=true;
+	}
+	StageTimer timer(STAGE_PARSE);
+
+	memo.text=&text;
+	memo.prev_text=&parsed_text;
+	memo.start(parsed);
+
+	Expr ex;
+	try{
+		ex=parse_tokens(tokens,&memo);
+	}catch(ParseFail){
+		//reused subtrees went down with the failed parse, so start over next time
+		parsed.node.reset();
+		parsed_text.clear();
+		values.clear();
+		memo.clear();
+		throw;
+	}
+
+	//whatever is left of the old tree wasn't reused; drop its values before its nodes are freed
+	forget_values(parsed,values);
+	parsed.node=std::move(ex.node);
+	parsed_text=text;
+	memo.prev_spans.clear();
+	memo.prev_slots.clear();
+	memo.prev_parents.clear();
+	memo.prev_nodes.clear();
+	return parsed;
+}
+
+Expr IncrementalParse::evaluate(){
+	return evaluate_part(parsed,nullptr);
+}
+
+Expr IncrementalParse::evaluate(Expr& part, const Bindings& values){
+	return evaluate_part(part,&values);
+}
+
+Expr IncrementalParse::evaluate_part(Expr& part, const Bindings* bound){
+	vector<ID> names;
+	for(size_t slot=0;bound && slot<bound->symbols->size();slot++){
+		if(bound->find(slot)){
+			names.push_back(bound->symbols->names[slot]);
+		}
+	}
+	if(names!=bound_names){
+		values.clear();
+		bound_names=std::move(names);
+	}
+	try{
+		bool uses_bound=false;
+		return evaluate_node(part,bound,uses_bound);
+	}catch(ExprError){
+		//children get evaluated before their parent's own checks here, so redo it in the usual order for the right message
+		return bound ? part.substitute(*bound).evaluate() : part.evaluate();
+	}
+}
+
+//whether any of ex's free variables is bound to a value
+static bool binds_any(const Expr& ex, const Bindings& bound){
+	for(ID name : ex.find_vars()){
+		if(bound.find(bound.symbols->find(name))){
+			return true;
+		}
+	}
+	return false;
+}
+
+Expr IncrementalParse::evaluate_node(Expr& ex, const Bindings* bound, bool& uses_bound){
+	if(!ex.defined()){
+		return Expr();
+	}
+	ExprNode* node=ex.node.get();
+	//substituted whole: leaves and functions aren't cached anyway, and a reduction binds its own variable,
+	//which substituting into its children one by one would replace too
+	if(bound && (node->subexprs.empty() || node->type==Function::type
+		|| node->type==Sum::type || node->type==Product::type || node->type==DefiniteIntegral::type)){
+		if(binds_any(ex,*bound)){
+			uses_bound=true;
+			return ex.substitute(*bound).evaluate();
+		}
+		bound=nullptr;
+	}
+	if(node->subexprs.empty() || node->type==Function::type){
+		return ex.evaluate();
+	}
+	auto found=values.find(node);
+	if(found!=values.end()){
+		return found->second;
+	}
+
+	//evaluate this node over its children's values, which are either cached or on the edited path
+	deque<Expr> children=std::move(node->subexprs);
+	Expr value;
+	bool children_bound=false;
+	try{
+		deque<Expr> child_values;
+		for(Expr& child : children){
+			child_values.push_back(evaluate_node(child,bound,children_bound));
+		}
+		node->subexprs=std::move(child_values);
+		value=node->evaluate();
+	}catch(...){
+		node->subexprs=std::move(children);
+		throw;
+	}
+	node->subexprs=std::move(children);
+	//a value over a bound name only holds for what it's bound to now
+	if(children_bound){
+		uses_bound=true;
+	}else{
+		values.emplace(node,value);
+	}
+	return value;
+}
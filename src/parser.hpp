@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <unordered_map>
 #include "expression.hpp"
 using std::string;
 
@@ -9,5 +10,98 @@ struct ParseFail{
 	ParseFail(string r):reason(r){}
 };
 
+struct Token{
+	enum Type : uint8_t{
+		NONE,
+		PLUS, MINUS, TIMES, DIVIDE, POWER,
+		PARENTHESES, SQUARE_BRACKET, CURLY_BRACKET,
+		NOT, EQUAL, AND, OR, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL,
+		INDEX, CALL, COMMA, IDENTIFIER, NUMBER,
+		TYPE_COUNT
+	};
+	static constexpr const char* NAMES[TYPE_COUNT]={
+		"",
+		"+","-","*","/","^",
+		"()","[]","{}",
+		"~","=","&","|","<","<=",">",">=",
+		"@","#",",","id","num"
+	};
+
+	//a type from above
+	Type type=NONE;
+
+	//only if type == id
+	ID id;
+
+	//only if type is PARENTHESES, SQUARE_BRACKET, or CURLY_BRACKET
+	list<Token> subtokens;
+
+	//only if type is NUMBER
+	number_t num;
+
+	//byte range of the token in the source text, brackets included
+	size_t begin=0,end=0;
+};
+
 Expr parse(string str);
 
+//subtrees of the previous parse, by the source text they came from
+struct ParseMemo{
+	struct Span{
+		const ExprNode* node;
+		size_t begin,len;
+	};
+
+	const string* text=nullptr;
+	const string* prev_text=nullptr;
+	std::unordered_multimap<uint64_t,Span> spans;
+	std::unordered_multimap<uint64_t,Span> prev_spans;
+	//where each node of the previous parse is held, while it can still be taken
+	std::unordered_map<const ExprNode*,Expr*> prev_slots;
+	//each node of the previous parse's parent, and where it was parsed from, if it was recorded
+	std::unordered_map<const ExprNode*,const ExprNode*> prev_parents;
+	std::unordered_map<const ExprNode*,Span> prev_nodes;
+
+	//moves what was recorded to prev, for parsing text again with the subtrees of prev, which was parsed from prev_text
+	void start(Expr& prev);
+	void clear();
+	//takes the subtree previously parsed from text[begin,end), if there is one; none of its descendants or
+	//ancestors can be taken after it, and its descendants are recorded again where they are in the new text
+	Expr reuse(size_t begin, size_t end);
+	void record(size_t begin, size_t end, const Expr& ex);
+
+private:
+	void collect(Expr& ex, const ExprNode* parent);
+	void retire(const Expr& ex, size_t old_begin, size_t begin, bool root);
+};
+
+//keeps the parse and value of an edited text up to date,
+//retokenizing only around an edit and reusing the subtrees it didn't touch
+struct IncrementalParse{
+	string text;
+	Expr parsed;
+
+	//replaces 'removed' bytes at pos with 'inserted'
+	void edit(size_t pos, size_t removed, const string& inserted);
+	void set_text(const string& to);
+
+	//may throw ParseFail
+	const Expr& reparse();
+	//evaluates the last reparse, only redoing the nodes that changed; may throw ExprError
+	Expr evaluate();
+	//as evaluate, for part of parsed (all of it or a subtree), with values substituted as Expr::substitute would;
+	//nodes over a bound name are redone every time, since what it's bound to may have changed
+	Expr evaluate(Expr& part, const Bindings& values);
+
+private:
+	list<Token> tokens;
+	bool tokens_valid=false;
+	string parsed_text;
+	ParseMemo memo;
+	std::unordered_map<const ExprNode*,Expr> values;
+	//the names bound when values were evaluated; once they change, a value cached with a name free is wrong
+	vector<ID> bound_names;
+
+	Expr evaluate_part(Expr& part, const Bindings* bound);
+	Expr evaluate_node(Expr& ex, const Bindings* bound, bool& uses_bound);
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <string_view>
+#include "string_id.hpp"
+
+//collision-free table over a fixed set of names, found at compile time;
+//find() costs one hash of the name, one slot read and one compare
+//fails to compile if the names can't be separated in 2^BITS slots (or repeat)
+template<size_t N, unsigned BITS>
+struct PerfectHash{
+	static_assert(N < (1u<<BITS) && N < 255);
+
+	std::array<std::string_view,N> names{};
+	uint64_t multiplier=0;
+	//index+1 of the name in each slot, 0 if empty
+	std::array<uint8_t,(1u<<BITS)> slots{};
+
+	static constexpr uint64_t slot_of(uint64_t hash, uint64_t multiplier){
+		return (hash*multiplier)>>(64-BITS);
+	}
+
+	consteval PerfectHash(std::array<std::string_view,N> keys):names(keys){
+		uint64_t candidate=0x9E3779B97F4A7C15ull;
+		for(int attempt=0;attempt<4096;attempt++){
+			candidate=candidate*6364136223846793005ull+1442695040888963407ull;
+			uint64_t mult=candidate|1;
+			std::array<uint8_t,(1u<<BITS)> filled{};
+			bool separated=true;
+			for(size_t n=0;n<N && separated;n++){
+				uint64_t slot=slot_of(str_hash(names[n].data(),names[n].size()),mult);
+				if(filled[slot]){
+					separated=false;
+				}else{
+					filled[slot]=n+1;
+				}
+			}
+			if(separated){
+				multiplier=mult;
+				slots=filled;
+				return;
+			}
+		}
+		throw "names collide, or need more slots";
+	}
+
+	//index of name, or -1
+	constexpr int find(std::string_view name) const {
+		if(name.empty()){
+			return -1;
+		}
+		uint8_t slot=slots[slot_of(str_hash(name.data(),name.size()),multiplier)];
+		if(slot==0 || names[slot-1]!=name){
+			return -1;
+		}
+		return slot-1;
+	}
+};
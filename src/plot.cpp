@@ -0,0 +1,775 @@
+#include "plot.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+Viewport Viewport::around(double x, double y, double units_per_px, int width, int height){
+	Viewport view;
+	view.width=std::max(1,width);
+	view.height=std::max(1,height);
+	view.x0=x-units_per_px*view.width/2;
+	view.x1=x+units_per_px*view.width/2;
+	view.y0=y-units_per_px*view.height/2;
+	view.y1=y+units_per_px*view.height/2;
+	return view;
+}
+
+namespace{
+
+//pixels between the initial samples
+constexpr double INITIAL_SPACING=2;
+//how far, in pixels, the line may stray from the true curve between samples
+constexpr double TOLERANCE=0.25;
+//halvings of an initial interval; 10 takes it to 1/500th of a pixel
+constexpr int MAX_DEPTH=10;
+
+struct Sampler{
+	const CompiledExpr& fn;
+	const Viewport& view;
+	double px_per_y;
+
+	double at(double x) const {
+		return fn.evaluate(&x);
+	}
+	//an antiderivative only integrates from a neighboring sample
+	double at(double x, double from, double value_from) const {
+		if(fn.is_antiderivative() && std::isfinite(value_from)){
+			return value_from+fn.integral_between(from,x);
+		}
+		return at(x);
+	}
+
+	//appends samples in (xa,xb], given the values at both ends
+	void refine(double xa, double ya, double xb, double yb, int depth, Curve& out) const {
+		bool finite_a=std::isfinite(ya);
+		bool finite_b=std::isfinite(yb);
+		if(depth<MAX_DEPTH && (finite_a || finite_b)){
+			double xm=(xa+xb)/2;
+			double ym=finite_a ? at(xm,xa,ya) : at(xm,xb,yb);
+			bool finite_m=std::isfinite(ym);
+			bool split;
+			if(finite_a && finite_b && finite_m){
+				//wholly past one edge of the view, the shape doesn't matter
+				bool above=ya>view.y1 && yb>view.y1 && ym>view.y1;
+				bool below=ya<view.y0 && yb<view.y0 && ym<view.y0;
+				split=!above && !below && std::abs(ym-(ya+yb)/2)*px_per_y>TOLERANCE;
+			}else{
+				//look for the edge of the domain
+				split=true;
+			}
+			if(split){
+				refine(xa,ya,xm,ym,depth+1,out);
+				refine(xm,ym,xb,yb,depth+1,out);
+				return;
+			}
+		}
+		if(finite_a && finite_b && depth>=MAX_DEPTH && std::abs(yb-ya)*px_per_y>view.height){
+			//still jumping across the whole view in a sliver of a pixel, so not continuous here
+			out.break_line((xa+xb)/2);
+		}
+		if(finite_b){
+			out.push(xb,yb);
+		}else{
+			out.break_line(xb);
+		}
+	}
+};
+
+}
+
+Curve sample_function(const CompiledExpr& fn, const Viewport& view, ThreadPool& pool){
+	Sampler sampler{fn,view,view.height/(view.y1-view.y0)};
+
+	size_t intervals=std::max<size_t>(64,view.width/INITIAL_SPACING);
+	vector<double> xs(intervals+1),ys(intervals+1);
+	for(size_t n=0;n<=intervals;n++){
+		xs[n]=view.x0+(view.x1-view.x0)*n/intervals;
+	}
+
+	//the even samples are evaluated, then the intervals between them refined, in contiguous runs;
+	//each run refines into its own curve, and they're joined in order after
+	size_t runs=std::min<size_t>(intervals,(pool.worker_count()+1)*4);
+	pool.parallel_for(runs,[&](size_t run){
+		size_t from=(intervals+1)*run/runs;
+		size_t to=(intervals+1)*(run+1)/runs;
+		const double* column=xs.data()+from;
+		fn.evaluate_batch(&column,ys.data()+from,to-from);
+	});
+	vector<Curve> parts(runs);
+	pool.parallel_for(runs,[&](size_t run){
+		size_t from=intervals*run/runs;
+		size_t to=intervals*(run+1)/runs;
+		for(size_t n=from;n<to;n++){
+			sampler.refine(xs[n],ys[n],xs[n+1],ys[n+1],0,parts[run]);
+		}
+	});
+
+	Curve ret;
+	size_t total=1;
+	for(const Curve& part : parts){
+		total+=part.size();
+	}
+	ret.xs.reserve(total);
+	ret.ys.reserve(total);
+	ret.push(xs[0],std::isfinite(ys[0]) ? ys[0] : NAN);
+	for(const Curve& part : parts){
+		size_t skip=part.size() && std::isnan(part.ys[0]) && std::isnan(ret.ys.back());
+		ret.xs.insert(ret.xs.end(),part.xs.begin()+skip,part.xs.end());
+		ret.ys.insert(ret.ys.end(),part.ys.begin()+skip,part.ys.end());
+	}
+	return ret;
+}
+
+namespace{
+
+//pixels per side of the cells contours are first traced through
+constexpr double CONTOUR_CELL=2;
+//cells per side of the blocks the interval test starts from, and of the smallest it splits them into
+constexpr int BLOCK_CELLS=16;
+constexpr int LEAF_CELLS=4;
+//cells the contour passes through are retraced this many times finer per side
+constexpr int CONTOUR_SUBDIVISION=4;
+
+struct ContourGrid{
+	const CompiledExpr& fn;
+	const Viewport& view;
+	//units per cell
+	double cell_w,cell_h;
+	int cols,rows;
+
+	double x(double cx) const { return view.x0+cx*cell_w; }
+	double y(double cy) const { return view.y0+cy*cell_h; }
+
+	//collects the blocks of at most LEAF_CELLS cells per side that the contour may pass through,
+	//splitting the size-cell block at (cx,cy) while fn can be shown not to reach 0 in some parts
+	void prune(int cx, int cy, int size, vector<std::array<int,3>>& leaves) const {
+		if(cx>=cols || cy>=rows){
+			return;
+		}
+		Interval box[2]={
+			{x(cx),x(std::min(cx+size,cols))},
+			{y(cy),y(std::min(cy+size,rows))}
+		};
+		if(!fn.evaluate_interval(box).contains(0)){
+			return;
+		}
+		if(size<=LEAF_CELLS){
+			leaves.push_back({cx,cy,size});
+			return;
+		}
+		int half=size/2;
+		prune(cx,cy,half,leaves);
+		prune(cx+half,cy,half,leaves);
+		prune(cx,cy+half,half,leaves);
+		prune(cx+half,cy+half,half,leaves);
+	}
+
+	//where fn crosses 0 between two points, or false if the sign change is a jump rather than a root
+	bool crossing(double xa, double ya, double va, double xb, double yb, double vb, double& cx, double& cy) const {
+		double t=va/(va-vb);
+		cx=xa+(xb-xa)*t;
+		cy=ya+(yb-ya)*t;
+		double at[2]={cx,cy};
+		return std::abs(fn.evaluate(at))<=std::max(std::abs(va),std::abs(vb));
+	}
+
+	//marching squares over one cell, corners counterclockwise from (x0,y0)
+	void march(double x0, double y0, double w, double h, const double v[4], Curve& out) const {
+		int inside=0;
+		for(int n=0;n<4;n++){
+			if(!std::isfinite(v[n])){
+				return;
+			}
+			inside|=(v[n]>0)<<n;
+		}
+		if(inside==0 || inside==15){
+			return;
+		}
+		double xs[4]={x0,x0+w,x0+w,x0};
+		double ys[4]={y0,y0,y0+h,y0+h};
+		//edge n runs from corner n to corner n+1
+		double ex[4],ey[4];
+		bool crossed[4],valid=true;
+		for(int n=0;n<4;n++){
+			int m=(n+1)%4;
+			crossed[n]=(v[n]>0)!=(v[m]>0);
+			if(crossed[n]){
+				valid&=crossing(xs[n],ys[n],v[n],xs[m],ys[m],v[m],ex[n],ey[n]);
+			}
+		}
+		if(!valid){
+			return;
+		}
+		auto segment=[&](int a, int b){
+			out.push(ex[a],ey[a]);
+			out.push(ex[b],ey[b]);
+			out.break_line(ex[b]);
+		};
+		if(inside==5 || inside==10){
+			//a saddle: the center decides which diagonal the inside connects along
+			bool center=(v[0]+v[1]+v[2]+v[3])/4>0;
+			if(center==(v[0]>0)){
+				segment(0,1);
+				segment(2,3);
+			}else{
+				segment(3,0);
+				segment(1,2);
+			}
+			return;
+		}
+		int first=-1;
+		for(int n=0;n<4;n++){
+			if(crossed[n]){
+				if(first<0){
+					first=n;
+				}else{
+					segment(first,n);
+				}
+			}
+		}
+	}
+
+	//traces the contour through one band of blocks: prunes them, evaluates the corners of what's left as one batch,
+	//then retraces the cells the contour crosses at a finer grid, also as one batch
+	void trace_band(int band, Curve& out) const {
+		vector<std::array<int,3>> leaves;
+		for(int cx=0;cx<cols;cx+=BLOCK_CELLS){
+			prune(cx,band*BLOCK_CELLS,BLOCK_CELLS,leaves);
+		}
+
+		vector<double> px,py;
+		for(auto [cx,cy,size] : leaves){
+			for(int j=0;j<=size;j++){
+				for(int i=0;i<=size;i++){
+					px.push_back(x(cx+i));
+					py.push_back(y(cy+j));
+				}
+			}
+		}
+		vector<double> values(px.size());
+		const double* columns[2]={px.data(),py.data()};
+		fn.evaluate_batch(columns,values.data(),values.size());
+
+		vector<std::array<int,2>> crossed;
+		size_t base=0;
+		for(auto [cx,cy,size] : leaves){
+			int stride=size+1;
+			for(int j=0;j<size;j++){
+				for(int i=0;i<size;i++){
+					if(cx+i>=cols || cy+j>=rows){
+						continue;
+					}
+					const double* row=values.data()+base+j*stride+i;
+					double v[4]={row[0],row[1],row[stride+1],row[stride]};
+					bool any_in=false,any_out=false;
+					for(double value : v){
+						any_in|=value>0;
+						any_out|=value<=0;
+					}
+					if(any_in && any_out){
+						crossed.push_back({cx+i,cy+j});
+					}
+				}
+			}
+			base+=stride*stride;
+		}
+
+		constexpr int S=CONTOUR_SUBDIVISION;
+		constexpr int STRIDE=S+1;
+		px.clear();
+		py.clear();
+		for(auto [cx,cy] : crossed){
+			for(int j=0;j<=S;j++){
+				for(int i=0;i<=S;i++){
+					px.push_back(x(cx+(double)i/S));
+					py.push_back(y(cy+(double)j/S));
+				}
+			}
+		}
+		values.resize(px.size());
+		columns[0]=px.data();
+		columns[1]=py.data();
+		fn.evaluate_batch(columns,values.data(),values.size());
+
+		double w=cell_w/S,h=cell_h/S;
+		for(size_t c=0;c<crossed.size();c++){
+			const double* fine=values.data()+c*STRIDE*STRIDE;
+			for(int j=0;j<S;j++){
+				for(int i=0;i<S;i++){
+					const double* row=fine+j*STRIDE+i;
+					double v[4]={row[0],row[1],row[STRIDE+1],row[STRIDE]};
+					march(x(crossed[c][0]+(double)i/S),y(crossed[c][1]+(double)j/S),w,h,v,out);
+				}
+			}
+		}
+	}
+};
+
+}
+
+Curve trace_implicit(const CompiledExpr& fn, const Viewport& view, ThreadPool& pool){
+	ContourGrid grid{fn,view,0,0,0,0};
+	grid.cols=std::max(1,(int)ceil(view.width/CONTOUR_CELL));
+	grid.rows=std::max(1,(int)ceil(view.height/CONTOUR_CELL));
+	grid.cell_w=(view.x1-view.x0)/grid.cols;
+	grid.cell_h=(view.y1-view.y0)/grid.rows;
+
+	int bands=(grid.rows+BLOCK_CELLS-1)/BLOCK_CELLS;
+	vector<Curve> parts(bands);
+	pool.parallel_for(bands,[&](size_t band){
+		grid.trace_band(band,parts[band]);
+	});
+
+	Curve ret;
+	for(const Curve& part : parts){
+		ret.xs.insert(ret.xs.end(),part.xs.begin(),part.xs.end());
+		ret.ys.insert(ret.ys.end(),part.ys.begin(),part.ys.end());
+	}
+	return ret;
+}
+
+//Douglas-Peucker over the points of one run, given in pixels; marks the ones to keep besides the ends
+static void simplify(const vector<double>& px, const vector<double>& py, double tolerance, vector<bool>& keep){
+	vector<std::pair<size_t,size_t>> spans{{0,px.size()-1}};
+	while(!spans.empty()){
+		auto [a,b]=spans.back();
+		spans.pop_back();
+		if(b<=a+1){
+			continue;
+		}
+		double dx=px[b]-px[a];
+		double dy=py[b]-py[a];
+		double length2=dx*dx+dy*dy;
+		double worst=-1;
+		size_t at=a;
+		for(size_t n=a+1;n<b;n++){
+			//distance to the segment, not the line, so spikes back past an end aren't lost
+			double t=length2>0 ? std::clamp(((px[n]-px[a])*dx+(py[n]-py[a])*dy)/length2,0.0,1.0) : 0;
+			double distance=std::hypot(px[n]-px[a]-t*dx,py[n]-py[a]-t*dy);
+			if(distance>worst){
+				worst=distance;
+				at=n;
+			}
+		}
+		if(worst>tolerance){
+			keep[at]=true;
+			spans.push_back({a,at});
+			spans.push_back({at,b});
+		}
+	}
+}
+
+Curve decimate(const Curve& curve, const Viewport& view, double tolerance){
+	Curve ret;
+	vector<size_t> kept;
+	vector<double> px,py;
+	vector<bool> keep;
+	size_t n=0;
+	while(n<curve.size()){
+		if(std::isnan(curve.ys[n])){
+			ret.break_line(curve.xs[n]);
+			n++;
+			continue;
+		}
+		size_t end=n;
+		while(end<curve.size() && !std::isnan(curve.ys[end])){
+			end++;
+		}
+
+		kept.clear();
+		for(size_t from=n;from<end;){
+			double column=floor(view.px_x(curve.xs[from]));
+			size_t lo=from,hi=from,to=from+1;
+			while(to<end && floor(view.px_x(curve.xs[to]))==column){
+				if(curve.ys[to]<curve.ys[lo]){
+					lo=to;
+				}
+				if(curve.ys[to]>curve.ys[hi]){
+					hi=to;
+				}
+				to++;
+			}
+			for(size_t pick : {from,std::min(lo,hi),std::max(lo,hi),to-1}){
+				if(kept.empty() || kept.back()<pick){
+					kept.push_back(pick);
+				}
+			}
+			from=to;
+		}
+
+		px.resize(kept.size());
+		py.resize(kept.size());
+		for(size_t k=0;k<kept.size();k++){
+			px[k]=view.px_x(curve.xs[kept[k]]);
+			py[k]=view.px_y(curve.ys[kept[k]]);
+		}
+		keep.assign(kept.size(),false);
+		keep.front()=keep.back()=true;
+		simplify(px,py,tolerance,keep);
+		for(size_t k=0;k<kept.size();k++){
+			if(keep[k]){
+				ret.push(curve.xs[kept[k]],curve.ys[kept[k]]);
+			}
+		}
+		n=end;
+	}
+	return ret;
+}
+
+namespace{
+
+//parameter intervals the range is first cut into
+constexpr size_t PARAMETRIC_INTERVALS=512;
+//longest a segment may be on screen, in pixels, and most it may turn at its midpoint, in radians
+constexpr double MAX_SEGMENT=6;
+constexpr double MAX_TURN=0.1;
+//halvings of an initial interval
+constexpr int PARAMETRIC_DEPTH=12;
+
+struct Span{
+	double ta,tb;
+	//ends in pixels
+	double xa,ya,xb,yb;
+	int depth;
+	bool broken=false;
+};
+
+}
+
+Curve sample_parametric(const CompiledExpr& fn, const Viewport& view, double t0, double t1, ThreadPool& pool){
+	//evaluates both outputs for every t in one batch, split over the pool, into pixels
+	vector<double> ts,px,py;
+	auto evaluate=[&](){
+		px.resize(ts.size());
+		py.resize(ts.size());
+		size_t runs=std::min<size_t>((ts.size()+255)/256,(pool.worker_count()+1)*4);
+		pool.parallel_for(runs,[&](size_t run){
+			size_t from=ts.size()*run/runs;
+			size_t to=ts.size()*(run+1)/runs;
+			const double* column=ts.data()+from;
+			double* outs[2]={px.data()+from,py.data()+from};
+			fn.evaluate_batch(&column,outs,to-from);
+			for(size_t n=from;n<to;n++){
+				px[n]=view.px_x(px[n]);
+				py[n]=view.px_y(py[n]);
+			}
+		});
+	};
+
+	for(size_t n=0;n<=PARAMETRIC_INTERVALS;n++){
+		ts.push_back(t0+(t1-t0)*n/PARAMETRIC_INTERVALS);
+	}
+	evaluate();
+	vector<Span> open,done;
+	for(size_t n=0;n<PARAMETRIC_INTERVALS;n++){
+		open.push_back(Span{ts[n],ts[n+1],px[n],py[n],px[n+1],py[n+1],0});
+	}
+
+	//refined breadth first, so each round's midpoints are evaluated together
+	double diagonal=std::hypot(view.width,view.height);
+	while(!open.empty()){
+		ts.clear();
+		for(const Span& span : open){
+			ts.push_back((span.ta+span.tb)/2);
+		}
+		evaluate();
+		vector<Span> next;
+		for(size_t n=0;n<open.size();n++){
+			const Span& span=open[n];
+			double xm=px[n],ym=py[n];
+			Span first{span.ta,ts[n],span.xa,span.ya,xm,ym,span.depth+1};
+			Span second{ts[n],span.tb,xm,ym,span.xb,span.yb,span.depth+1};
+			bool finite=std::isfinite(span.xa+span.ya) && std::isfinite(span.xb+span.yb) && std::isfinite(xm+ym);
+			bool split;
+			if(finite){
+				//wholly past one edge of the view, the shape doesn't matter
+				bool past=(span.xa<0 && xm<0 && span.xb<0) || (span.xa>view.width && xm>view.width && span.xb>view.width) ||
+					(span.ya<0 && ym<0 && span.yb<0) || (span.ya>view.height && ym>view.height && span.yb>view.height);
+				double ax=xm-span.xa,ay=ym-span.ya;
+				double bx=span.xb-xm,by=span.yb-ym;
+				double turn=std::abs(std::atan2(ax*by-ay*bx,ax*bx+ay*by));
+				double length=std::hypot(ax,ay)+std::hypot(bx,by);
+				split=!past && (length>MAX_SEGMENT || (turn>MAX_TURN && length>TOLERANCE));
+			}else{
+				//look for the edge of the domain
+				split=std::isfinite(span.xa+span.ya) || std::isfinite(span.xb+span.yb);
+			}
+			if(split && span.depth+1<PARAMETRIC_DEPTH){
+				next.push_back(first);
+				next.push_back(second);
+				continue;
+			}
+			if(split && finite){
+				//still long after every halving, so it jumps rather than runs here
+				first.broken=second.broken=std::hypot(span.xb-span.xa,span.yb-span.ya)>diagonal/4;
+			}
+			done.push_back(first);
+			done.push_back(second);
+		}
+		open=std::move(next);
+	}
+
+	std::sort(done.begin(),done.end(),[](const Span& a, const Span& b){ return a.ta<b.ta; });
+	Curve ret;
+	bool drawing=false;
+	for(const Span& span : done){
+		bool finite=std::isfinite(span.xa+span.ya) && std::isfinite(span.xb+span.yb);
+		if(!finite || span.broken){
+			if(drawing){
+				ret.break_line(NAN);
+				drawing=false;
+			}
+			continue;
+		}
+		if(!drawing){
+			ret.push(view.x_at(span.xa),view.y_at(span.ya));
+			drawing=true;
+		}
+		ret.push(view.x_at(span.xb),view.y_at(span.yb));
+	}
+	return ret;
+}
+
+void evaluate_field(const CompiledExpr& fn, const Viewport& view, int block, vector<float>& out, ThreadPool& pool){
+	int cols=(view.width+block-1)/block;
+	int rows=(view.height+block-1)/block;
+	out.resize((size_t)cols*rows);
+	vector<double> xs(cols);
+	for(int i=0;i<cols;i++){
+		xs[i]=view.x_at((i+0.5)*block);
+	}
+	size_t bands=std::min<size_t>(rows,(pool.worker_count()+1)*4);
+	pool.parallel_for(bands,[&](size_t band){
+		vector<double> ys(cols),values(cols);
+		const double* columns[2]={xs.data(),ys.data()};
+		for(size_t j=rows*band/bands;j<rows*(band+1)/bands;j++){
+			std::fill(ys.begin(),ys.end(),view.y_at((j+0.5)*block));
+			fn.evaluate_batch(columns,values.data(),cols);
+			std::copy(values.begin(),values.end(),out.begin()+j*cols);
+		}
+	});
+}
+
+//points a task takes at the least
+static constexpr size_t POINT_CHUNK=size_t(1)<<16;
+
+//tasks to split n points over, each with a grid or table of its own
+static size_t point_tasks(size_t n, ThreadPool& pool){
+	return std::clamp<size_t>(n/POINT_CHUNK,1,pool.worker_count()+1);
+}
+
+PointSet::PointSet(std::shared_ptr<const void> owner, const double* xs, const double* ys, size_t count, ThreadPool& pool)
+	:owner(std::move(owner)),xs(xs),ys(ys),count(count){
+	size_t tasks=point_tasks(count,pool);
+	vector<std::array<double,4>> bounds(tasks,{INFINITY,-INFINITY,INFINITY,-INFINITY});
+	pool.parallel_for(tasks,[&](size_t task){
+		std::array<double,4>& b=bounds[task];
+		for(size_t n=count*task/tasks;n<count*(task+1)/tasks;n++){
+			double px=x(n),py=y(n);
+			if(!std::isfinite(px) || !std::isfinite(py)){
+				continue;
+			}
+			b={std::min(b[0],px),std::max(b[1],px),std::min(b[2],py),std::max(b[3],py)};
+		}
+	});
+	for(const std::array<double,4>& b : bounds){
+		x0=std::min(x0,b[0]);
+		x1=std::max(x1,b[1]);
+		y0=std::min(y0,b[2]);
+		y1=std::max(y1,b[3]);
+	}
+}
+
+//the index's bucket along one axis, for v between lo and hi
+static int index_cell(double v, double lo, double hi){
+	double at=hi>lo ? (v-lo)/(hi-lo)*PointSet::Index::CELLS : 0;
+	return (int)std::clamp(at,0.0,PointSet::Index::CELLS-1.0);
+}
+
+const PointSet::Index* PointSet::index(ThreadPool& pool) const {
+	std::call_once(indexed,[&](){
+		if(count>=UINT32_MAX || x0>x1){
+			return;
+		}
+		constexpr size_t BUCKETS=(size_t)Index::CELLS*Index::CELLS;
+		//a counting sort: each task counts its points per bucket, then places them after those of the tasks before it
+		auto bucket=[&](size_t n){
+			double px=x(n),py=y(n);
+			if(!std::isfinite(px) || !std::isfinite(py)){
+				return BUCKETS;
+			}
+			return (size_t)index_cell(py,y0,y1)*Index::CELLS+index_cell(px,x0,x1);
+		};
+		size_t tasks=point_tasks(count,pool);
+		vector<vector<uint32_t>> at(tasks,vector<uint32_t>(BUCKETS+1,0));
+		pool.parallel_for(tasks,[&](size_t task){
+			for(size_t n=count*task/tasks;n<count*(task+1)/tasks;n++){
+				at[task][bucket(n)]++;
+			}
+		});
+		std::unique_ptr<Index> index=std::make_unique<Index>();
+		index->start.resize(BUCKETS+1);
+		uint32_t placed=0;
+		for(size_t b=0;b<BUCKETS;b++){
+			index->start[b]=placed;
+			for(size_t task=0;task<tasks;task++){
+				uint32_t counted=at[task][b];
+				at[task][b]=placed;
+				placed+=counted;
+			}
+		}
+		index->start[BUCKETS]=placed;
+		//points that can't be drawn aren't placed
+		index->order.resize(placed);
+		pool.parallel_for(tasks,[&](size_t task){
+			for(size_t n=count*task/tasks;n<count*(task+1)/tasks;n++){
+				size_t b=bucket(n);
+				if(b<BUCKETS){
+					index->order[at[task][b]++]=n;
+				}
+			}
+		});
+		buckets=std::move(index);
+	});
+	return buckets.get();
+}
+
+//ex's numbers, if it's a packed array, or an array of numbers, which are packed here
+static bool point_column(const Expr& ex, std::shared_ptr<const void>& owner, const double*& values, size_t& count){
+	if(ex.type()==NumericArray::type){
+		const NumericArray* arr=(const NumericArray*)ex.node.get();
+		owner=arr->owner;
+		values=arr->values;
+		count=arr->count;
+		return true;
+	}
+	if(ex.type()!=Array::type || ex.node->subexprs.empty()){
+		return false;
+	}
+	const deque<Expr>& items=ex.node->subexprs;
+	std::shared_ptr<double[]> packed=std::make_shared_for_overwrite<double[]>(items.size());
+	for(size_t n=0;n<items.size();n++){
+		if(!items[n].defined() || items[n].type()!=Number::type){
+			return false;
+		}
+		packed[n]=((const Number*)items[n].node.get())->value.value;
+	}
+	values=packed.get();
+	count=items.size();
+	owner=std::move(packed);
+	return true;
+}
+
+std::shared_ptr<const PointSet> point_set(const Expr& value, ThreadPool& pool){
+	if(!value.defined()){
+		return nullptr;
+	}
+	std::shared_ptr<const void> owner;
+	const double* ys;
+	size_t count;
+	if(point_column(value,owner,ys,count)){
+		return std::make_shared<PointSet>(std::move(owner),nullptr,ys,count,pool);
+	}
+	const deque<Expr>& items=value.node->subexprs;
+	if(value.type()==Tuple::type && items.size()==2){
+		std::shared_ptr<const void> x_owner,y_owner;
+		const double* xs;
+		size_t x_count;
+		if(!point_column(items[0],x_owner,xs,x_count) || !point_column(items[1],y_owner,ys,count) || x_count!=count){
+			return nullptr;
+		}
+		owner=std::make_shared<std::pair<std::shared_ptr<const void>,std::shared_ptr<const void>>>(x_owner,y_owner);
+		return std::make_shared<PointSet>(std::move(owner),xs,ys,count,pool);
+	}
+	if(value.type()!=Array::type || items.empty()){
+		return nullptr;
+	}
+	//pairs, packed as all their xs then all their ys
+	count=items.size();
+	std::shared_ptr<double[]> packed=std::make_shared_for_overwrite<double[]>(count*2);
+	for(size_t n=0;n<count;n++){
+		const Expr& item=items[n];
+		if(!item.defined() || item.type()!=Tuple::type || item.node->subexprs.size()!=2){
+			return nullptr;
+		}
+		for(int axis=0;axis<2;axis++){
+			const Expr& coord=item.node->subexprs[axis];
+			if(!coord.defined() || coord.type()!=Number::type){
+				return nullptr;
+			}
+			packed[axis*count+n]=((const Number*)coord.node.get())->value.value;
+		}
+	}
+	const double* xs=packed.get();
+	return std::make_shared<PointSet>(std::move(packed),xs,xs+count,count,pool);
+}
+
+void bin_points(const PointSet& points, const Viewport& view, int block, vector<uint32_t>& out, ThreadPool& pool){
+	int cols=(view.width+block-1)/block;
+	int rows=(view.height+block-1)/block;
+	out.assign((size_t)cols*rows,0);
+	if(std::max(view.x0,points.x0)>std::min(view.x1,points.x1) || std::max(view.y0,points.y0)>std::min(view.y1,points.y1)){
+		return;
+	}
+	double col_scale=view.width/(view.x1-view.x0)/block;
+	double row_scale=view.height/(view.y1-view.y0)/block;
+	double col_end=(double)view.width/block;
+	double row_end=(double)view.height/block;
+	auto bin=[&](size_t n, uint32_t* grid){
+		double col=(points.x(n)-view.x0)*col_scale;
+		double row=(view.y1-points.y(n))*row_scale;
+		//NaNs fail these too
+		if(col>=0 && col<col_end && row>=0 && row<row_end){
+			grid[(size_t)row*cols+(size_t)col]++;
+		}
+	};
+
+	//runs of point numbers (or of positions in the index's order) to bin
+	vector<std::pair<size_t,size_t>> runs;
+	constexpr int CELLS=PointSet::Index::CELLS;
+	int cx0=index_cell(view.x0,points.x0,points.x1),cx1=index_cell(view.x1,points.x0,points.x1);
+	int cy0=index_cell(view.y0,points.y0,points.y1),cy1=index_cell(view.y1,points.y0,points.y1);
+	bool zoomed=(size_t)(cx1-cx0+1)*(cy1-cy0+1)*4<(size_t)CELLS*CELLS;
+	const PointSet::Index* index=zoomed ? points.index(pool) : nullptr;
+	if(index){
+		//a row of buckets is one run
+		for(int cy=cy0;cy<=cy1;cy++){
+			runs.emplace_back(index->start[cy*CELLS+cx0],index->start[cy*CELLS+cx1+1]);
+		}
+	}else{
+		runs.emplace_back(0,points.size());
+	}
+	vector<size_t> before{0};
+	for(const std::pair<size_t,size_t>& run : runs){
+		before.push_back(before.back()+run.second-run.first);
+	}
+	size_t total=before.back();
+
+	//the first task bins straight into out
+	size_t tasks=point_tasks(total,pool);
+	vector<vector<uint32_t>> grids(tasks-1,vector<uint32_t>(out.size(),0));
+	pool.parallel_for(tasks,[&](size_t task){
+		uint32_t* grid=task ? grids[task-1].data() : out.data();
+		size_t from=total*task/tasks,to=total*(task+1)/tasks;
+		size_t r=std::upper_bound(before.begin(),before.end(),from)-before.begin()-1;
+		for(;r<runs.size() && before[r]<to;r++){
+			size_t begin=runs[r].first+std::max(from,before[r])-before[r];
+			size_t end=runs[r].first+std::min(to,before[r+1])-before[r];
+			for(size_t at=begin;at<end;at++){
+				bin(index ? index->order[at] : at,grid);
+			}
+		}
+	});
+	if(grids.empty()){
+		return;
+	}
+	size_t bands=std::min<size_t>(rows,(pool.worker_count()+1)*4);
+	pool.parallel_for(bands,[&](size_t band){
+		size_t begin=(size_t)cols*(rows*band/bands),end=(size_t)cols*(rows*(band+1)/bands);
+		for(const vector<uint32_t>& grid : grids){
+			for(size_t n=begin;n<end;n++){
+				out[n]+=grid[n];
+			}
+		}
+	});
+}
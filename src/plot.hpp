@@ -0,0 +1,123 @@
+#pragma once
+#include "compiled.hpp"
+#include "thread_pool.hpp"
+
+//the region of the plane on screen, and the size in pixels it's shown at; pixel y grows downward
+struct Viewport{
+	double x0=-10,x1=10,y0=-10,y1=10;
+	int width=1,height=1;
+
+	//centered on (x,y), with square pixels
+	static Viewport around(double x, double y, double units_per_px, int width, int height);
+
+	double px_x(double x) const { return (x-x0)/(x1-x0)*width; }
+	double px_y(double y) const { return (y1-y)/(y1-y0)*height; }
+	double x_at(double px) const { return x0+px/width*(x1-x0); }
+	double y_at(double px) const { return y1-px/height*(y1-y0); }
+};
+
+//points along a line, which a NaN y breaks; a function's samples are in increasing x
+struct Curve{
+	vector<double> xs,ys;
+
+	size_t size() const { return xs.size(); }
+	void push(double x, double y){
+		xs.push_back(x);
+		ys.push_back(y);
+	}
+	//ends the line at x, unless it's already broken
+	void break_line(double x){
+		if(ys.empty() || !std::isnan(ys.back())){
+			push(x,NAN);
+		}
+	}
+};
+
+//how a definition's compiled function is drawn
+enum PlotKind : uint8_t{
+	//y over x
+	PLOT_CURVE,
+	//(x,y) over t
+	PLOT_PARAMETRIC,
+	//where f(x,y) is 0
+	PLOT_IMPLICIT,
+	//f(x,y) as color
+	PLOT_HEATMAP,
+	//a set of points, as their density
+	PLOT_SCATTER
+};
+
+//points to scatter, over the packed columns they came in rather than a copy; xs null means each point's x is its position
+class PointSet{
+public:
+	//a grid of buckets over the points' bounds, each listing its points, so a view visits just the buckets it overlaps
+	struct Index{
+		static constexpr int CELLS=512;
+		//bucket b's points are order[start[b]] to order[start[b+1]-1], buckets row by row from (x0,y0)
+		vector<uint32_t> start;
+		vector<uint32_t> order;
+	};
+
+	//owner keeps xs and ys alive; the bounds are found over the pool
+	PointSet(std::shared_ptr<const void> owner, const double* xs, const double* ys, size_t count, ThreadPool& pool=thread_pool);
+
+	size_t size() const { return count; }
+	double x(size_t n) const { return xs ? xs[n] : n; }
+	double y(size_t n) const { return ys[n]; }
+	//of the points that aren't NaN; x0>x1 if there are none
+	double x0=INFINITY,x1=-INFINITY,y0=INFINITY,y1=-INFINITY;
+
+	//built over the pool on first use, and null if there are too many points to index
+	const Index* index(ThreadPool& pool=thread_pool) const;
+
+private:
+	std::shared_ptr<const void> owner;
+	const double* xs;
+	const double* ys;
+	size_t count;
+	mutable std::once_flag indexed;
+	mutable std::unique_ptr<Index> buckets;
+};
+
+//value's points, if it's a set of them: a pair of arrays of equal length as their xs and ys,
+//an array of pairs, or one array as ys over 0, 1, 2, ...; packed arrays are used in place; null otherwise
+std::shared_ptr<const PointSet> point_set(const Expr& value, ThreadPool& pool=thread_pool);
+
+struct PlotStyle{
+	double red=0.15,green=0.35,blue=0.85,alpha=1;
+	double line_width=2;
+};
+
+struct Plot{
+	Curve curve;
+	PlotStyle style;
+};
+
+//samples fn (of one input) across the view: evenly at first, then refining wherever the line bends
+//by more than a fraction of a pixel, and breaking it at discontinuities and outside fn's domain
+//the work is split over the pool
+Curve sample_function(const CompiledExpr& fn, const Viewport& view, ThreadPool& pool=thread_pool);
+
+//samples fn (of one input, with two outputs) as the curve (x(t),y(t)) for t from t0 to t1
+//t is refined wherever a segment is long or turns sharply on screen, and the line is broken where it jumps
+//or leaves fn's domain; each round of refinement is evaluated as one batch over the pool
+Curve sample_parametric(const CompiledExpr& fn, const Viewport& view, double t0=-10, double t1=10, ThreadPool& pool=thread_pool);
+
+//values of fn (of x and y) at the centers of block-pixel squares across the view, row by row, in out;
+//bands of rows are split over the pool
+void evaluate_field(const CompiledExpr& fn, const Viewport& view, int block, vector<float>& out, ThreadPool& pool=thread_pool);
+
+//how many points fall in each block-pixel square across the view, row by row, in out
+//tasks bin ranges of points into grids of their own, which are summed at the end; zoomed in past a quarter of the points'
+//bounds, only the buckets of the index the view overlaps are visited, so the work follows the points in view
+void bin_points(const PointSet& points, const Viewport& view, int block, vector<uint32_t>& out, ThreadPool& pool=thread_pool);
+
+//the points of curve that matter at view's scale: runs within one pixel column are cut to their first, lowest,
+//highest and last points, then what's left is simplified by Douglas-Peucker to within tolerance pixels
+//the result has at most a few points per column the curve spans, however densely it was sampled
+Curve decimate(const Curve& curve, const Viewport& view, double tolerance=0.25);
+
+//traces where fn (of x and y) is 0 across the view by marching squares, as separate short segments
+//blocks fn's interval bounds keep clear of 0 are skipped, and cells the contour crosses are retraced finer;
+//bands of rows are split over the pool
+Curve trace_implicit(const CompiledExpr& fn, const Viewport& view, ThreadPool& pool=thread_pool);
@@ -0,0 +1,227 @@
+#include "plot_render.hpp"
+#include <array>
+#include <cmath>
+
+//a 1, 2 or 5 times a power of ten, near the given span
+static double grid_step(double span){
+	double pow10=pow(10,floor(log10(span)));
+	double mantissa=span/pow10;
+	if(mantissa<2){
+		return pow10;
+	}
+	if(mantissa<5){
+		return 2*pow10;
+	}
+	return 5*pow10;
+}
+
+void draw_grid(cairo_t* cr, const Viewport& view){
+	//about one line per 80 pixels
+	double step=grid_step((view.x1-view.x0)*80/view.width);
+
+	cairo_set_line_width(cr,1);
+	cairo_set_source_rgb(cr,0.88,0.88,0.88);
+	for(double x=ceil(view.x0/step)*step;x<=view.x1;x+=step){
+		double px=round(view.px_x(x))+0.5;
+		cairo_move_to(cr,px,0);
+		cairo_line_to(cr,px,view.height);
+	}
+	for(double y=ceil(view.y0/step)*step;y<=view.y1;y+=step){
+		double px=round(view.px_y(y))+0.5;
+		cairo_move_to(cr,0,px);
+		cairo_line_to(cr,view.width,px);
+	}
+	cairo_stroke(cr);
+
+	cairo_set_source_rgb(cr,0.3,0.3,0.3);
+	if(view.x0<=0 && view.x1>=0){
+		double px=round(view.px_x(0))+0.5;
+		cairo_move_to(cr,px,0);
+		cairo_line_to(cr,px,view.height);
+	}
+	if(view.y0<=0 && view.y1>=0){
+		double px=round(view.px_y(0))+0.5;
+		cairo_move_to(cr,0,px);
+		cairo_line_to(cr,view.width,px);
+	}
+	cairo_stroke(cr);
+}
+
+void draw_curve(cairo_t* cr, const Viewport& view, const Curve& sampled, const PlotStyle& style){
+	//stroking every sample costs far more than the few per pixel that show
+	stroke_curve(cr,view,decimate(sampled,view),style);
+}
+
+void stroke_curve(cairo_t* cr, const Viewport& view, const Curve& curve, const PlotStyle& style){
+	//far off-screen points are pulled in, as cairo loses precision with huge coordinates
+	double limit=view.height*16.0;
+	cairo_set_source_rgba(cr,style.red,style.green,style.blue,style.alpha);
+	cairo_set_line_width(cr,style.line_width);
+	cairo_set_line_join(cr,CAIRO_LINE_JOIN_ROUND);
+	cairo_set_line_cap(cr,CAIRO_LINE_CAP_ROUND);
+	bool drawing=false;
+	for(size_t n=0;n<curve.size();n++){
+		if(std::isnan(curve.ys[n])){
+			drawing=false;
+			continue;
+		}
+		double px=view.px_x(curve.xs[n]);
+		double py=std::clamp(view.px_y(curve.ys[n]),-limit,limit+view.height);
+		if(drawing){
+			cairo_line_to(cr,px,py);
+		}else{
+			cairo_move_to(cr,px,py);
+			drawing=true;
+		}
+	}
+	cairo_stroke(cr);
+}
+
+void draw_markers(cairo_t* cr, const Viewport& view, const vector<double>& xs, const vector<double>& ys, const PlotStyle& style){
+	double radius=style.line_width+2;
+	cairo_set_line_width(cr,1.5);
+	for(size_t n=0;n<xs.size();n++){
+		double px=view.px_x(xs[n]);
+		double py=view.px_y(ys[n]);
+		if(!(px>=-radius && px<=view.width+radius && py>=-radius && py<=view.height+radius)){
+			continue;
+		}
+		cairo_new_sub_path(cr);
+		cairo_arc(cr,px,py,radius,0,2*M_PI);
+	}
+	cairo_set_source_rgb(cr,1,1,1);
+	cairo_fill_preserve(cr);
+	cairo_set_source_rgba(cr,style.red,style.green,style.blue,style.alpha);
+	cairo_stroke(cr);
+}
+
+//marks surface's pixels changed and paints it over the view scaled up by block, then destroys it
+static void paint_blocks(cairo_t* cr, cairo_surface_t* surface, int block){
+	cairo_surface_mark_dirty(surface);
+	cairo_save(cr);
+	cairo_scale(cr,block,block);
+	cairo_set_source_surface(cr,surface,0,0);
+	cairo_pattern_set_filter(cairo_get_source(cr),CAIRO_FILTER_NEAREST);
+	cairo_paint(cr);
+	cairo_restore(cr);
+	cairo_surface_destroy(surface);
+}
+
+//density is shaded by log2 of a square's count, reaching the top of the map at 2^16 points; the same for every view,
+//so neighbouring tiles match
+static constexpr double MAX_DENSITY_SCALE=255/16.0;
+
+//cool to warm through light gray, as premultiplied ARGB at the given opacity
+static std::array<uint32_t,256> colormap(double alpha){
+	static constexpr double stops[3][3]={{0.23,0.30,0.75},{0.87,0.87,0.87},{0.71,0.02,0.15}};
+	std::array<uint32_t,256> ret;
+	for(int n=0;n<256;n++){
+		double t=n/255.0*2;
+		int from=std::min(1,(int)t);
+		double f=t-from;
+		uint32_t pixel=std::lround(alpha*255)<<24;
+		for(int c=0;c<3;c++){
+			double value=stops[from][c]+(stops[from+1][c]-stops[from][c])*f;
+			pixel|=(uint32_t)std::lround(value*alpha*255)<<(16-8*c);
+		}
+		ret[n]=pixel;
+	}
+	return ret;
+}
+
+void draw_field(cairo_t* cr, const Viewport& view, const CompiledExpr& fn, const PlotStyle& style, int block){
+	vector<float> values;
+	evaluate_field(fn,view,block,values);
+	int cols=(view.width+block-1)/block;
+	int rows=(view.height+block-1)/block;
+	std::array<uint32_t,256> lut=colormap(style.alpha*0.75);
+
+	cairo_surface_t* surface=cairo_image_surface_create(CAIRO_FORMAT_ARGB32,cols,rows);
+	cairo_surface_flush(surface);
+	unsigned char* data=cairo_image_surface_get_data(surface);
+	int stride=cairo_image_surface_get_stride(surface);
+	size_t bands=std::min<size_t>(rows,(thread_pool.worker_count()+1)*4);
+	thread_pool.parallel_for(bands,[&](size_t band){
+		for(size_t j=rows*band/bands;j<rows*(band+1)/bands;j++){
+			uint32_t* row=(uint32_t*)(data+j*stride);
+			const float* from=values.data()+j*cols;
+			for(int i=0;i<cols;i++){
+				float v=from[i];
+				if(std::isnan(v)){
+					row[i]=0;
+					continue;
+				}
+				float t=0.5f+0.5f*v/(1+std::abs(v));
+				row[i]=lut[std::clamp((int)(t*255+0.5f),0,255)];
+			}
+		}
+	});
+	paint_blocks(cr,surface,block);
+}
+
+//the style's color from faint to full and darkening toward the top, premultiplied
+static std::array<uint32_t,256> density_colormap(const PlotStyle& style){
+	std::array<uint32_t,256> ret;
+	double color[3]={style.red,style.green,style.blue};
+	for(int n=0;n<256;n++){
+		double t=n/255.0;
+		double alpha=style.alpha*(0.3+0.7*t);
+		double shade=1-0.5*t*t;
+		uint32_t pixel=std::lround(alpha*255)<<24;
+		for(int c=0;c<3;c++){
+			pixel|=(uint32_t)std::lround(color[c]*shade*alpha*255)<<(16-8*c);
+		}
+		ret[n]=pixel;
+	}
+	return ret;
+}
+
+void draw_points(cairo_t* cr, const Viewport& view, const PointSet& points, const PlotStyle& style, int block){
+	vector<uint32_t> counts;
+	bin_points(points,view,block,counts);
+	int cols=(view.width+block-1)/block;
+	int rows=(view.height+block-1)/block;
+	std::array<uint32_t,256> lut=density_colormap(style);
+
+	cairo_surface_t* surface=cairo_image_surface_create(CAIRO_FORMAT_ARGB32,cols,rows);
+	cairo_surface_flush(surface);
+	unsigned char* data=cairo_image_surface_get_data(surface);
+	int stride=cairo_image_surface_get_stride(surface);
+	size_t bands=std::min<size_t>(rows,(thread_pool.worker_count()+1)*4);
+	thread_pool.parallel_for(bands,[&](size_t band){
+		for(size_t j=rows*band/bands;j<rows*(band+1)/bands;j++){
+			uint32_t* row=(uint32_t*)(data+j*stride);
+			const uint32_t* from=counts.data()+j*cols;
+			for(int i=0;i<cols;i++){
+				row[i]=from[i] ? lut[std::min(255,(int)(std::log2(from[i]+1.0)*MAX_DENSITY_SCALE))] : 0;
+			}
+		}
+	});
+	paint_blocks(cr,surface,block);
+}
+
+void draw_background(cairo_t* cr, const Viewport& view){
+	cairo_save(cr);
+	cairo_set_source_rgb(cr,1,1,1);
+	cairo_paint(cr);
+	draw_grid(cr,view);
+	cairo_restore(cr);
+}
+
+void draw_plots(cairo_t* cr, const Viewport& view, const vector<Plot>& plots){
+	cairo_save(cr);
+	draw_background(cr,view);
+	for(const Plot& plot : plots){
+		draw_curve(cr,view,plot.curve,plot.style);
+	}
+	cairo_restore(cr);
+}
+
+cairo_surface_t* render_offscreen(const Viewport& view, const vector<Plot>& plots){
+	cairo_surface_t* surface=cairo_image_surface_create(CAIRO_FORMAT_ARGB32,view.width,view.height);
+	cairo_t* cr=cairo_create(surface);
+	draw_plots(cr,view,plots);
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	return surface;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cairo.h>
+#include "plot.hpp"
+
+//grid, axes and curves, filling the view's pixel size
+void draw_plots(cairo_t* cr, const Viewport& view, const vector<Plot>& plots);
+
+//white, with the grid and axes over it
+void draw_background(cairo_t* cr, const Viewport& view);
+void draw_grid(cairo_t* cr, const Viewport& view);
+//strokes the curve decimated to view's pixels
+void draw_curve(cairo_t* cr, const Viewport& view, const Curve& curve, const PlotStyle& style);
+//strokes a curve as it is, as when it was decimated to view's scale already
+void stroke_curve(cairo_t* cr, const Viewport& view, const Curve& curve, const PlotStyle& style);
+
+//rings at the points (xs[n],ys[n]) that are in view, outlined in style's color, as for a curve's zeros
+void draw_markers(cairo_t* cr, const Viewport& view, const vector<double>& xs, const vector<double>& ys, const PlotStyle& style);
+
+//colors fn (of x and y) across the view through a colormap, one value per block pixels square
+//values are squashed by v/(1+|v|), so 0 is the middle of the map whatever the scale; undefined values are clear
+void draw_field(cairo_t* cr, const Viewport& view, const CompiledExpr& fn, const PlotStyle& style, int block=1);
+
+//shades how many of points fall in each block pixels square across the view, through a map of style's color
+//from faint for one point to dark for tens of thousands; squares without any are clear
+void draw_points(cairo_t* cr, const Viewport& view, const PointSet& points, const PlotStyle& style, int block=1);
+
+//draws into a new ARGB32 image surface the size of the view, without needing a display; the caller destroys it
+cairo_surface_t* render_offscreen(const Viewport& view, const vector<Plot>& plots);
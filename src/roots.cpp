@@ -0,0 +1,248 @@
+#include "roots.hpp"
+#include "metrics.hpp"
+#include <cfloat>
+
+//the range is scanned as ROOT_CELLS cells of CELL_SAMPLES spaces each, a stripe of cells per task
+static constexpr size_t ROOT_CELLS=1<<10;
+static constexpr size_t CELL_SAMPLES=64;
+static constexpr size_t ROOT_STRIPES=64;
+static constexpr int MAX_BRENT_ITERATIONS=100;
+
+namespace{
+
+//f, or f less g
+struct Difference{
+	const CompiledExpr& f;
+	const CompiledExpr* g;
+
+	double at(double x) const {
+		double value=f.evaluate(&x);
+		return g ? value-g->evaluate(&x) : value;
+	}
+
+	void batch(const double* xs, double* out, double* scratch, size_t count) const {
+		f.evaluate_batch(&xs,out,count);
+		if(g){
+			g->evaluate_batch(&xs,scratch,count);
+			for(size_t n=0;n<count;n++){
+				out[n]-=scratch[n];
+			}
+		}
+	}
+
+	//false only if the bounds show it's nonzero throughout [x0,x1]
+	bool may_vanish(double x0, double x1) const {
+		Interval at{x0,x1};
+		Interval value=f.evaluate_interval(&at);
+		if(g){
+			Interval other=g->evaluate_interval(&at);
+			value={value.lo-other.hi,value.hi-other.lo};
+		}
+		return !(value.lo>0 || value.hi<0);
+	}
+};
+
+//narrows [a,b], where fn changes sign, to a root by Brent's method: inverse quadratic interpolation or secant steps
+//while they shrink the bracket fast enough, bisection otherwise; NaN if fn isn't a number somewhere along the way
+double brent(const Difference& fn, double a, double b, double fa, double fb, double step, double& value){
+	double c=a,fc=fa;
+	double d=b-a,e=d;
+	for(int iteration=0;iteration<MAX_BRENT_ITERATIONS;iteration++){
+		if((fb>0)==(fc>0)){
+			c=a;
+			fc=fa;
+			d=e=b-a;
+		}
+		//b is the best so far, and [b,c] brackets the root
+		if(fabs(fc)<fabs(fb)){
+			a=b;
+			b=c;
+			c=a;
+			fa=fb;
+			fb=fc;
+			fc=fa;
+		}
+		double tolerance=2*DBL_EPSILON*fabs(b)+step;
+		double half=(c-b)/2;
+		if(fabs(half)<=tolerance || fb==0){
+			break;
+		}
+		if(fabs(e)>=tolerance && fabs(fa)>fabs(fb)){
+			double s=fb/fa;
+			double p,q;
+			if(a==c){
+				p=2*half*s;
+				q=1-s;
+			}else{
+				double r=fb/fc;
+				q=fa/fc;
+				p=s*(2*half*q*(q-r)-(b-a)*(r-1));
+				q=(q-1)*(r-1)*(s-1);
+			}
+			if(p>0){
+				q=-q;
+			}
+			p=fabs(p);
+			if(2*p<std::min(3*half*q-fabs(tolerance*q),fabs(e*q))){
+				e=d;
+				d=p/q;
+			}else{
+				d=e=half;
+			}
+		}else{
+			d=e=half;
+		}
+		a=b;
+		fa=fb;
+		b+=fabs(d)>tolerance ? d : copysign(tolerance,half);
+		fb=fn.at(b);
+		if(std::isnan(fb)){
+			return NAN;
+		}
+	}
+	value=fb;
+	return b;
+}
+
+vector<double> scan(const Difference& fn, double lo, double hi, ThreadPool& pool){
+	if(!(lo<hi) || !std::isfinite(lo) || !std::isfinite(hi) || fn.f.inputs().size()!=1
+		|| (fn.g && fn.g->inputs().size()!=1)){
+		return {};
+	}
+	static constexpr size_t SAMPLES=ROOT_CELLS*CELL_SAMPLES;
+	double spacing=(hi-lo)/SAMPLES;
+	auto sample_x=[&](size_t n){ return n==SAMPLES ? hi : lo+spacing*n; };
+
+	vector<vector<double>> found(ROOT_STRIPES);
+	pool.parallel_for(ROOT_STRIPES,[&](size_t stripe){
+		double xs[CELL_SAMPLES+1],values[CELL_SAMPLES+1],scratch[CELL_SAMPLES+1];
+		for(size_t cell=ROOT_CELLS*stripe/ROOT_STRIPES;cell<ROOT_CELLS*(stripe+1)/ROOT_STRIPES;cell++){
+			size_t first=cell*CELL_SAMPLES;
+			if(!fn.may_vanish(sample_x(first),sample_x(first+CELL_SAMPLES))){
+				continue;
+			}
+			for(size_t n=0;n<=CELL_SAMPLES;n++){
+				xs[n]=sample_x(first+n);
+			}
+			fn.batch(xs,values,scratch,CELL_SAMPLES+1);
+			//a sample on the cell's far end belongs to the next cell, unless this is the last
+			size_t zeros_to=cell+1==ROOT_CELLS ? CELL_SAMPLES+1 : CELL_SAMPLES;
+			for(size_t n=0;n<=CELL_SAMPLES;n++){
+				if(values[n]==0){
+					if(n<zeros_to){
+						found[stripe].push_back(xs[n]);
+					}
+					continue;
+				}
+				if(n==CELL_SAMPLES || values[n+1]==0 || (values[n]>0)==(values[n+1]>0)
+					|| !std::isfinite(values[n]) || !std::isfinite(values[n+1])){
+					continue;
+				}
+				double value;
+				double root=brent(fn,xs[n],xs[n+1],values[n],values[n+1],DBL_EPSILON*spacing,value);
+				//across a pole the bracket narrows onto ever larger values rather than onto zero
+				if(!std::isnan(root) && fabs(value)<=std::min(fabs(values[n]),fabs(values[n+1]))){
+					found[stripe].push_back(root);
+				}
+			}
+		}
+	});
+
+	vector<double> ret;
+	for(const vector<double>& roots : found){
+		ret.insert(ret.end(),roots.begin(),roots.end());
+	}
+	return ret;
+}
+
+}
+
+vector<double> find_roots(const CompiledExpr& f, double lo, double hi, ThreadPool& pool){
+	return scan(Difference{f,nullptr},lo,hi,pool);
+}
+
+vector<double> find_intersections(const CompiledExpr& f, const CompiledExpr& g, double lo, double hi, ThreadPool& pool){
+	return scan(Difference{f,&g},lo,hi,pool);
+}
+
+//a search spans this many view widths either side of the view, and is redone once the view is this many times
+//narrower than it, so zooming in a long way still finds roots too close together for the last search's samples
+static constexpr double SEARCH_MARGIN=4;
+static constexpr double MAX_ZOOM_IN=64;
+
+RootCache::~RootCache(){
+	std::unique_lock lock(mutex);
+	idle.wait(lock,[this](){ return running==0; });
+}
+
+std::shared_ptr<const RootCache::Points> RootCache::find(const RootQuery& query, double x0, double x1){
+	std::lock_guard lock(mutex);
+	Entry& entry=entries[query.layer][query.other];
+	double width=x1-x0;
+	bool current=entry.points && entry.revision==query.revision && entry.other_revision==query.other_revision;
+	bool covers=current && entry.points->lo<=x0 && x1<=entry.points->hi
+		&& entry.points->hi-entry.points->lo<=width*MAX_ZOOM_IN;
+	if(!covers && !entry.pending && query.fn && (!query.other || query.other_fn)){
+		entry.pending=true;
+		running++;
+		double lo=x0-width*SEARCH_MARGIN;
+		double hi=x1+width*SEARCH_MARGIN;
+		thread_pool.submit([this,query,lo,hi](){ search(query,lo,hi); });
+	}
+	return entry.points;
+}
+
+void RootCache::search(RootQuery query, double lo, double hi){
+	metric_entry=query.layer;
+	std::shared_ptr<Points> points=std::make_shared<Points>();
+	{
+		StageTimer timer(STAGE_ROOTS);
+		points->lo=lo;
+		points->hi=hi;
+		if(query.other_fn){
+			points->xs=find_intersections(*query.fn,*query.other_fn,lo,hi);
+			for(double x : points->xs){
+				points->ys.push_back(query.fn->evaluate(&x));
+			}
+		}else{
+			points->xs=find_roots(*query.fn,lo,hi);
+			points->ys.assign(points->xs.size(),0);
+		}
+	}
+
+	{
+		std::lock_guard lock(mutex);
+		//unless it was forgotten meanwhile
+		auto layer=entries.find(query.layer);
+		if(layer!=entries.end()){
+			auto found=layer->second.find(query.other);
+			if(found!=layer->second.end()){
+				Entry& entry=found->second;
+				entry.revision=query.revision;
+				entry.other_revision=query.other_revision;
+				entry.points=points;
+				entry.pending=false;
+			}
+		}
+	}
+	if(on_ready){
+		on_ready();
+	}
+	//the destructor waits on running, so this is the last the job touches the cache
+	std::lock_guard lock(mutex);
+	running--;
+	idle.notify_all();
+}
+
+void RootCache::forget(uint64_t layer){
+	std::lock_guard lock(mutex);
+	entries.erase(layer);
+	for(auto& [id,others] : entries){
+		others.erase(layer);
+	}
+}
+
+void RootCache::clear(){
+	std::lock_guard lock(mutex);
+	entries.clear();
+}
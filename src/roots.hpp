@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "compiled.hpp"
+
+//where a function of one input crosses zero within [lo,hi], in increasing order
+//the range is split into cells scanned in parallel over the pool: a cell whose interval bound excludes zero is
+//skipped, the rest are sampled as one batch, and every sign change between neighboring samples is a bracket,
+//narrowed by Brent's method; a bracket across a pole, where the function grows as it narrows, isn't a root,
+//and a zero the function only touches without crossing is found only if a sample lands on it exactly
+vector<double> find_roots(const CompiledExpr& f, double lo, double hi, ThreadPool& pool=thread_pool);
+//where f and g take the same value within [lo,hi], as the roots of their difference
+vector<double> find_intersections(const CompiledExpr& f, const CompiledExpr& g, double lo, double hi, ThreadPool& pool=thread_pool);
+
+//what to mark on one curve: its zeros, or where it meets another
+struct RootQuery{
+	//the curve, as a TileLayer names it
+	uint64_t layer=0;
+	uint64_t revision=0;
+	std::shared_ptr<const CompiledExpr> fn;
+	//the other curve, or 0 for zeros
+	uint64_t other=0;
+	uint64_t other_revision=0;
+	std::shared_ptr<const CompiledExpr> other_fn;
+};
+
+//the points found for each query, kept per revision of the curves involved, so markers follow the view around
+//without searching again; a search covers a few views' width around the view it was asked for, and is redone on
+//the pool only when a view leaves that range or zooms in well past it, while the last points found stand in
+class RootCache{
+public:
+	struct Points{
+		//the range searched
+		double lo=0,hi=0;
+		vector<double> xs,ys;
+	};
+
+	//called from a worker whenever a requested search is done
+	std::function<void()> on_ready;
+
+	RootCache(){}
+	RootCache(const RootCache&)=delete;
+	//waits for searches still running
+	~RootCache();
+
+	//the points found for query, requesting a search if there are none for its revisions covering [x0,x1];
+	//until that's done, the last found for the same curves, or null
+	std::shared_ptr<const Points> find(const RootQuery& query, double x0, double x1);
+	//drops everything found on or against the layer, as when its definition is removed
+	void forget(uint64_t layer);
+	void clear();
+
+private:
+	struct Entry{
+		uint64_t revision=0,other_revision=0;
+		std::shared_ptr<const Points> points;
+		bool pending=false;
+	};
+
+	std::mutex mutex;
+	std::condition_variable idle;
+	size_t running=0;
+	//by layer and other
+	std::unordered_map<uint64_t,std::unordered_map<uint64_t,Entry>> entries;
+
+	void search(RootQuery query, double lo, double hi);
+};
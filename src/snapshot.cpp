@@ -0,0 +1,367 @@
+#include "snapshot.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//the layout is native: numbers are stored as they sit in memory, so a snapshot only loads where long double matches
+static constexpr char MAGIC[8]={'M','a','t','h','V','i','s','S'};
+static constexpr uint32_t VERSION=1;
+static constexpr uint8_t NO_EXPR=0xFF;
+
+enum EntryFlags : uint32_t{
+	SHOWN=1,
+	CURRENT=2,
+};
+
+struct Writer{
+	string out;
+
+	template<typename T>
+	void put(T value){
+		out.append((const char*)&value,sizeof(T));
+	}
+	void put_string(std::string_view str){
+		put<uint32_t>(str.size());
+		out.append(str);
+	}
+	//preorder: kind, whatever the node holds beyond its children, then the children
+	void put_expr(const Expr& ex){
+		if(!ex.defined()){
+			put<uint8_t>(NO_EXPR);
+			return;
+		}
+		const ExprNode* node=ex.node.get();
+		int kind=node_kinds.find(node->type.view());
+		//imported data would make a snapshot as large as the data, so what uses it is computed again instead
+		if(kind<0 || kind==NumericArray::kind){
+			throw SnapshotError("can't save a "+string(node->type));
+		}
+		put<uint8_t>(kind);
+		switch(kind){
+			case Number::kind:
+				put(((const Number*)node)->value.value);
+				break;
+			case Boolean::kind:
+				put<uint8_t>(((const Boolean*)node)->value);
+				break;
+			case Variable::kind:
+				put_string(((const Variable*)node)->name.view());
+				break;
+			case Function::kind:
+				put<uint32_t>(((const Function*)node)->inputs.size());
+				for(ID input : ((const Function*)node)->inputs){
+					put_string(input.view());
+				}
+				break;
+			case Sum::kind:
+				put_string(((const Sum*)node)->variable.view());
+				break;
+			case Product::kind:
+				put_string(((const Product*)node)->variable.view());
+				break;
+			case DefiniteIntegral::kind:
+				put_string(((const DefiniteIntegral*)node)->variable.view());
+				break;
+		}
+		put<uint32_t>(node->subexprs.size());
+		for(const Expr& child : node->subexprs){
+			put_expr(child);
+		}
+	}
+	void put_results(const DefsModel::Definition& def){
+		//parameters aren't saved, so neither is anything compiled over them
+		if(!def.params.empty()){
+			throw SnapshotError("can't save results depending on parameters");
+		}
+		if(def.parse){
+			put_expr(*def.parse);
+		}else{
+			put<uint8_t>(NO_EXPR);
+		}
+		put_expr(def.value);
+		const CompiledExpr* fn=def.plot_fn.get();
+		put<uint8_t>(fn && fn->is_compiled());
+		if(!fn || !fn->is_compiled()){
+			return;
+		}
+		put<uint8_t>(def.plot_kind);
+		put<uint32_t>(fn->inputs().size());
+		for(ID input : fn->inputs()){
+			put_string(input.view());
+		}
+		put<uint32_t>(fn->outputs());
+		put<uint32_t>(fn->program().size());
+		for(const CompiledExpr::Instr& instr : fn->program()){
+			put<uint8_t>(instr.op);
+			put<uint32_t>(instr.input);
+			put<double>(instr.value);
+		}
+	}
+};
+
+void save_snapshot(const string& path, const DefsModel& model){
+	Writer writer;
+	writer.out.append(MAGIC,sizeof(MAGIC));
+	writer.put<uint32_t>(VERSION);
+	writer.put<uint32_t>(sizeof(long double));
+	writer.put<uint64_t>(model.size());
+	model.for_each([&](const DefsModel::Definition& def){
+		//results that can't be saved leave the entry to be computed again
+		Writer results;
+		bool current=def.current();
+		if(current){
+			try{
+				results.put_results(def);
+			}catch(SnapshotError&){
+				current=false;
+			}
+		}
+		writer.put<uint32_t>((def.shown ? SHOWN : 0) | (current ? CURRENT : 0));
+		writer.put_string(def.text);
+		writer.put_string(def.message);
+		writer.put<double>(def.style.red);
+		writer.put<double>(def.style.green);
+		writer.put<double>(def.style.blue);
+		writer.put<double>(def.style.alpha);
+		writer.put<double>(def.style.line_width);
+		if(current){
+			//sized, so opening can step over it
+			writer.put<uint64_t>(results.out.size());
+			writer.out+=results.out;
+		}
+	});
+
+	string temp=path+".tmp";
+	FILE* file=fopen(temp.c_str(),"wb");
+	if(!file){
+		throw SnapshotError("can't write "+temp+": "+strerror(errno));
+	}
+	bool written=fwrite(writer.out.data(),1,writer.out.size(),file)==writer.out.size();
+	written=fclose(file)==0 && written;
+	if(!written || rename(temp.c_str(),path.c_str())!=0){
+		string reason=strerror(errno);
+		remove(temp.c_str());
+		throw SnapshotError("can't write "+path+": "+reason);
+	}
+}
+
+struct Reader{
+	const char* at;
+	const char* end;
+
+	template<typename T>
+	T get(){
+		if(end-at<(ptrdiff_t)sizeof(T)){
+			throw SnapshotError("snapshot is cut short");
+		}
+		T ret;
+		memcpy(&ret,at,sizeof(T));
+		at+=sizeof(T);
+		return ret;
+	}
+	std::string_view get_bytes(size_t length){
+		if((size_t)(end-at)<length){
+			throw SnapshotError("snapshot is cut short");
+		}
+		std::string_view ret(at,length);
+		at+=length;
+		return ret;
+	}
+	std::string_view get_string(){
+		return get_bytes(get<uint32_t>());
+	}
+
+	static ID reduction_variable(std::string_view name){
+		return name.empty() ? ID() : ID(name);
+	}
+	//evaluating a reduction takes its shape as given: one child, and for a range, the tuple (k, lo, hi, term)
+	static void check_reduction(const Expr& ex, ID variable){
+		const deque<Expr>& subs=ex.node->subexprs;
+		if(subs.size()!=1 || !subs.front().defined()){
+			throw SnapshotError("snapshot has a damaged reduction");
+		}
+		if(!variable){
+			return;
+		}
+		const deque<Expr>& range=subs.front().node->subexprs;
+		if(subs.front().type()!=Tuple::type || range.size()!=4 || range.front().type()!=Variable::type ||
+				((const Variable*)range.front().node.get())->name!=variable){
+			throw SnapshotError("snapshot has a damaged reduction");
+		}
+	}
+
+	Expr get_expr(){
+		uint8_t kind=get<uint8_t>();
+		if(kind==NO_EXPR){
+			return Expr();
+		}
+		//only what the parser builds; the rest of the kinds have no nodes yet
+		ExprNode* node;
+		switch(kind){
+			case Add::kind: node=new Add(); break;
+			case Sub::kind: node=new Sub(); break;
+			case Mul::kind: node=new Mul(); break;
+			case Div::kind: node=new Div(); break;
+			case Exponent::kind: node=new Exponent(); break;
+			case Parenthetical::kind: node=new Parenthetical(); break;
+			case Equal::kind: node=new Equal(); break;
+			case Number::kind: node=new Number(); break;
+			case Boolean::kind: node=new Boolean(); break;
+			case Variable::kind: node=new Variable(); break;
+			case Array::kind: node=new Array(); break;
+			case Tuple::kind: node=new Tuple(); break;
+			case Index::kind: node=new Index(); break;
+			case Call::kind: node=new Call(); break;
+			case Function::kind: node=new Function(); break;
+			case Sum::kind: node=new Sum(); break;
+			case Product::kind: node=new Product(); break;
+			case DefiniteIntegral::kind: node=new DefiniteIntegral(); break;
+			default: throw SnapshotError("snapshot has an unknown node kind");
+		}
+		//owned from here, so a throw below frees it
+		Expr ret(node);
+		switch(kind){
+			case Number::kind:
+				((Number*)node)->value=get<long double>();
+				break;
+			case Boolean::kind:
+				((Boolean*)node)->value=get<uint8_t>();
+				break;
+			case Variable::kind:
+				((Variable*)node)->name=ID(get_string());
+				break;
+			case Function::kind:
+				for(uint32_t n=get<uint32_t>();n>0;n--){
+					((Function*)node)->inputs.push_back(ID(get_string()));
+				}
+				break;
+			case Sum::kind:
+				((Sum*)node)->variable=reduction_variable(get_string());
+				break;
+			case Product::kind:
+				((Product*)node)->variable=reduction_variable(get_string());
+				break;
+			case DefiniteIntegral::kind:
+				((DefiniteIntegral*)node)->variable=reduction_variable(get_string());
+				if(!((DefiniteIntegral*)node)->variable){
+					throw SnapshotError("snapshot has a damaged integral");
+				}
+				break;
+		}
+		for(uint32_t n=get<uint32_t>();n>0;n--){
+			node->subexprs.push_back(get_expr());
+		}
+		switch(kind){
+			case Sum::kind: check_reduction(ret,((Sum*)node)->variable); break;
+			case Product::kind: check_reduction(ret,((Product*)node)->variable); break;
+			case DefiniteIntegral::kind: check_reduction(ret,((DefiniteIntegral*)node)->variable); break;
+			case Function::kind:
+				if(node->subexprs.size()!=1){
+					throw SnapshotError("snapshot has a damaged function");
+				}
+				((Function*)node)->bind_inputs();
+				break;
+		}
+		return ret;
+	}
+};
+
+std::shared_ptr<const Snapshot> Snapshot::open(const string& path){
+	int fd=::open(path.c_str(),O_RDONLY);
+	if(fd<0){
+		throw SnapshotError("can't open "+path+": "+strerror(errno));
+	}
+	struct stat info;
+	if(fstat(fd,&info)!=0 || info.st_size==0){
+		close(fd);
+		throw SnapshotError(path+" is empty");
+	}
+	void* mapped=mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(mapped==MAP_FAILED){
+		throw SnapshotError("can't map "+path+": "+strerror(errno));
+	}
+	std::shared_ptr<Snapshot> ret(new Snapshot());
+	ret->data=(const char*)mapped;
+	ret->size=info.st_size;
+
+	Reader in{ret->data,ret->data+ret->size};
+	try{
+		if(in.get_bytes(sizeof(MAGIC))!=std::string_view(MAGIC,sizeof(MAGIC))){
+			throw SnapshotError(path+" isn't a MathVis snapshot");
+		}
+		if(in.get<uint32_t>()!=VERSION || in.get<uint32_t>()!=sizeof(long double)){
+			throw SnapshotError(path+" was saved by an incompatible version");
+		}
+		uint64_t count=in.get<uint64_t>();
+		for(uint64_t n=0;n<count;n++){
+			Entry entry;
+			uint32_t flags=in.get<uint32_t>();
+			entry.shown=flags&SHOWN;
+			entry.current=flags&CURRENT;
+			entry.text=in.get_string();
+			entry.message=in.get_string();
+			entry.style.red=in.get<double>();
+			entry.style.green=in.get<double>();
+			entry.style.blue=in.get<double>();
+			entry.style.alpha=in.get<double>();
+			entry.style.line_width=in.get<double>();
+			ret->results.emplace_back();
+			if(entry.current){
+				ret->results.back()=in.get_bytes(in.get<uint64_t>());
+			}
+			ret->index.push_back(entry);
+		}
+	}catch(SnapshotError& err){
+		err.what=path+": "+err.what;
+		throw;
+	}
+	return ret;
+}
+
+Snapshot::~Snapshot(){
+	if(data){
+		munmap((void*)data,size);
+	}
+}
+
+EvalWorker::Saved Snapshot::load(size_t n) const {
+	std::string_view bytes=results.at(n);
+	if(!index.at(n).current){
+		throw SnapshotError("entry wasn't saved with its results");
+	}
+	Reader in{bytes.data(),bytes.data()+bytes.size()};
+	EvalWorker::Saved ret;
+	ret.parse=in.get_expr();
+	ret.value=in.get_expr();
+	ret.message=string(index[n].message);
+	if(in.get<uint8_t>()){
+		uint8_t kind=in.get<uint8_t>();
+		if(kind>PLOT_HEATMAP){
+			throw SnapshotError("snapshot has an unknown plot kind");
+		}
+		vector<ID> inputs;
+		for(uint32_t count=in.get<uint32_t>();count>0;count--){
+			inputs.push_back(ID(in.get_string()));
+		}
+		size_t outputs=in.get<uint32_t>();
+		uint32_t count=in.get<uint32_t>();
+		//each takes 13 bytes; checked first, so a damaged count can't ask for a huge program
+		if((size_t)(in.end-in.at)<count*size_t(13)){
+			throw SnapshotError("snapshot is cut short");
+		}
+		vector<CompiledExpr::Instr> program(count);
+		for(CompiledExpr::Instr& instr : program){
+			instr.op=(CompiledExpr::Op)in.get<uint8_t>();
+			instr.input=in.get<uint32_t>();
+			instr.value=in.get<double>();
+		}
+		//a program that doesn't check out is compiled again from the value
+		ret.plot_fn=CompiledExpr::load(inputs,std::move(program),outputs);
+		ret.plot_kind=(PlotKind)kind;
+	}
+	return ret;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string_view>
+#include "defs_model.hpp"
+#include "eval_worker.hpp"
+
+struct SnapshotError{
+	string what;
+	SnapshotError(string what):what(what){}
+};
+
+//writes the model as a workspace snapshot: each definition's text, color and visibility, and for those up to date,
+//their message, parse, value and compiled plot function, so a load can show and plot them without parsing or evaluating
+//goes through a temporary file, so a failed save leaves what was there; throws SnapshotError
+void save_snapshot(const string& path, const DefsModel& model);
+
+//a snapshot file mapped into memory; what a definition shows is indexed up front, its trees are read only when asked for
+class Snapshot{
+public:
+	struct Entry{
+		//into the mapping
+		std::string_view text;
+		std::string_view message;
+		PlotStyle style;
+		bool shown=true;
+		//saved with its results; if not, it has to be computed again
+		bool current=false;
+	};
+
+	//throws SnapshotError if path can't be read or isn't a snapshot
+	static std::shared_ptr<const Snapshot> open(const string& path);
+	Snapshot(const Snapshot&)=delete;
+	~Snapshot();
+
+	const vector<Entry>& entries() const { return index; }
+	//the saved parse, value and plot function of a current entry; throws SnapshotError if they're damaged
+	EvalWorker::Saved load(size_t n) const;
+
+private:
+	const char* data=nullptr;
+	size_t size=0;
+	vector<Entry> index;
+	//where each current entry's results are in the mapping
+	vector<std::string_view> results;
+
+	Snapshot(){}
+};
@@ -2,8 +2,16 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <memory>
+#include <vector>
 #include <cassert>
+#include <algorithm>
 
 constexpr uint64_t str_hash(const char* cstr,ulong len){
   uint64_t hash=0;
@@ -26,68 +34,225 @@ inline uint64_t str_hash(const std::string& str){
 
 class ID{
 
-  struct CStr{
-    const char* ptr=nullptr;
-    uint64_t len=0;
+  //an interned string; freed by a sweep of its shard once no ID refers to it, unless it's permanent
+  struct Entry{
+    std::atomic<uint32_t> refs{1};
+    //never freed, so its references aren't counted; once set, it stays set
+    std::atomic<bool> permanent{false};
+    uint32_t len=0;
+    uint64_t id=0;
+    //strings probing past this id, so it has to stay to keep them findable: one for each entry probed past it,
+    //and one while an intern is still probing
+    std::atomic<uint32_t> passing{0};
+    //the entries this one's probe passed, each holding one of its passing counts for as long as this lives
+    uint32_t passed_count=0;
+    Entry** passed=nullptr;
 
-    void set(const char* p,uint64_t l){
-      if(ptr) delete [] ptr;
-      char* pt=new char[l+1]{0};
-      memcpy(pt,p,l);
-      ptr=pt;
-      len=l;
-    }
+    char* str(){ return (char*)(this+1); }
+    std::string_view view(){ return std::string_view(str(),len); }
+  };
 
-    CStr(){}
-    CStr(const char* p){
-      set(p,strlen(p));
-    }
-    CStr(const char* p,uint64_t l){
-      set(p,l);
-    }
-    CStr(const CStr& b){*this=b;}
-    CStr(CStr&& b){*this=std::move(b);}
+  static constexpr uint64_t BLOCK_SIZE=1<<14;
+  static constexpr int SIZE_CLASSES=6;
+  static constexpr uint64_t MIN_CHUNK=32;
+  static constexpr uint64_t MAX_CHUNK=MIN_CHUNK<<(SIZE_CLASSES-1);
+
+  //ids are spread over shards so that lookups only ever contend within one shard,
+  //and readers of a shard share its lock
+  //entries are carved from blocks in a few size classes, and freed chunks are reused for new entries
+  struct Shard{
+    std::shared_mutex mutex;
+    std::unordered_map<uint64_t,Entry*> entries;
+    //releases to no references since the last sweep; counts an entry again if it was revived
+    std::atomic<uint64_t> dead{0};
 
-    CStr& operator=(const CStr& b){
-      set(b.ptr,b.len);
-      return *this;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* current=nullptr;
+    uint64_t used=BLOCK_SIZE;
+    void* free_chunks[SIZE_CLASSES]{};
+    uint64_t reserved_bytes=0;
+    uint64_t live_bytes=0;
+
+    static int size_class(uint64_t bytes){
+      int cls=0;
+      while((MIN_CHUNK<<cls)<bytes){
+        cls++;
+      }
+      return cls;
     }
-    CStr& operator=(CStr&& b){
-      ptr=b.ptr;
-      len=b.len;
-      b.ptr=nullptr;
-      b.len=0;
-      return *this;
+
+    Entry* allocate(uint64_t id, std::string_view str){
+      uint64_t bytes=sizeof(Entry)+str.size()+1;
+      char* mem;
+      if(bytes>MAX_CHUNK){
+        mem=new char[bytes];
+        reserved_bytes+=bytes;
+      }else{
+        int cls=size_class(bytes);
+        bytes=MIN_CHUNK<<cls;
+        if(free_chunks[cls]){
+          mem=(char*)free_chunks[cls];
+          free_chunks[cls]=*(void**)mem;
+        }else{
+          if(used+bytes>BLOCK_SIZE){
+            blocks.emplace_back(new char[BLOCK_SIZE]);
+            current=blocks.back().get();
+            used=0;
+            reserved_bytes+=BLOCK_SIZE;
+          }
+          mem=current+used;
+          used+=bytes;
+        }
+      }
+      live_bytes+=bytes;
+      Entry* entry=new(mem) Entry();
+      entry->len=str.size();
+      entry->id=id;
+      memcpy(entry->str(),str.data(),str.size());
+      entry->str()[str.size()]=0;
+      return entry;
     }
 
-    bool operator==(const CStr& b) const {
-      return len==b.len && !strcmp(ptr,b.ptr);
+    void free(Entry* entry){
+      for(uint32_t n=0;n<entry->passed_count;n++){
+        unpass(entry->passed[n]);
+      }
+      delete [] entry->passed;
+      uint64_t bytes=sizeof(Entry)+entry->len+1;
+      entry->~Entry();
+      if(bytes>MAX_CHUNK){
+        delete [] (char*)entry;
+        reserved_bytes-=bytes;
+        live_bytes-=bytes;
+        return;
+      }
+      int cls=size_class(bytes);
+      live_bytes-=MIN_CHUNK<<cls;
+      *(void**)entry=free_chunks[cls];
+      free_chunks[cls]=entry;
     }
 
-    ~CStr(){
-      if(ptr) delete [] ptr;
+    //needs the exclusive lock; true if it freed an entry that had probed past others, which may be free now too
+    bool sweep(){
+      bool unpinned=false;
+      for(auto it=entries.begin(); it!=entries.end();){
+        Entry* entry=it->second;
+        if(entry->refs.load(std::memory_order_acquire)==0 && entry->passing.load(std::memory_order_acquire)==0
+          && !entry->permanent.load(std::memory_order_relaxed)){
+          unpinned=unpinned || entry->passed_count>0;
+          free(entry);
+          it=entries.erase(it);
+        }else{
+          it++;
+        }
+      }
+      dead=0;
+      return unpinned;
     }
   };
 
-  inline static std::unordered_map<uint64_t,CStr> seen_map{};
+  static constexpr uint64_t SHARD_COUNT=64;
 
-  static uint64_t get_or_insert(const CStr& str, uint64_t hash){
-    if(seen_map.contains(hash)){
-      if(seen_map.at(hash)==str){
-        return hash;
-      }else{
-        return get_or_insert(str,hash^rand());
+  static Shard& shard_of(uint64_t id){
+    //never destroyed, since IDs in other statics may outlive it
+    static Shard* shards=new Shard[SHARD_COUNT];
+    return shards[(id^(id>>29))%SHARD_COUNT];
+  }
+
+  //drops a string's claim on an entry it probed past; the entry may be swept once nothing else keeps it,
+  //so it isn't touched after that
+  static void unpass(Entry* entry){
+    uint64_t id=entry->id;
+    if(entry->passing.fetch_sub(1,std::memory_order_acq_rel)==1){
+      shard_of(id).dead.fetch_add(1,std::memory_order_relaxed);
+    }
+  }
+
+  //where to try next when an id is taken by another string; the same for every run
+  static constexpr uint64_t next_probe(uint64_t id){
+    return id*0x9E3779B97F4A7C15ull+0x632BE59BD9B4E019ull;
+  }
+
+  //returns the entry for str with a reference taken
+  //entries probed past are pinned as they're passed, while their shard's lock is held; a new entry keeps those pins,
+  //and finding an existing one gives them back (its own pins on the same entries were taken when it was added)
+  static Entry* intern(std::string_view str){
+    if(str.empty()){
+      return nullptr;
+    }
+    uint64_t id=str_hash(str.data(),str.size());
+    std::vector<Entry*> passed;
+    auto found_existing=[&](Entry* entry){
+      for(Entry* pinned : passed){
+        unpass(pinned);
       }
-    }else{
-      seen_map.emplace(hash,str);
-      return hash;
+      return entry;
+    };
+    while(true){
+      if(id==0){
+        id=next_probe(id);
+        continue;
+      }
+      Shard& shard=shard_of(id);
+      {
+        std::shared_lock lock(shard.mutex);
+        auto found=shard.entries.find(id);
+        if(found!=shard.entries.end()){
+          Entry* entry=found->second;
+          if(entry->view()==str){
+            //may bring an unreferenced entry back; sweeps can't run while the lock is shared
+            retain(entry);
+            return found_existing(entry);
+          }
+          entry->passing.fetch_add(1,std::memory_order_relaxed);
+          passed.push_back(entry);
+          id=next_probe(id);
+          continue;
+        }
+      }
+      std::unique_lock lock(shard.mutex);
+      auto found=shard.entries.find(id);
+      if(found==shard.entries.end()){
+        //sweep once enough names went unused to be worth the pass
+        if(shard.dead>shard.entries.size()/2+64){
+          shard.sweep();
+        }
+        Entry* entry=shard.allocate(id,str);
+        if(!passed.empty()){
+          entry->passed_count=passed.size();
+          entry->passed=new Entry*[passed.size()];
+          std::copy(passed.begin(),passed.end(),entry->passed);
+        }
+        shard.entries.emplace(id,entry);
+        return entry;
+      }
+      if(found->second->view()==str){
+        retain(found->second);
+        return found_existing(found->second);
+      }
+      found->second->passing.fetch_add(1,std::memory_order_relaxed);
+      passed.push_back(found->second);
+      id=next_probe(id);
+    }
+  }
+
+  //a permanent entry is only read, so threads copying the same name don't contend on a count
+  //a count taken before the entry was made permanent and never given back is harmless, as it's never freed
+  static void retain(Entry* entry){
+    if(entry && !entry->permanent.load(std::memory_order_relaxed)){
+      entry->refs.fetch_add(1,std::memory_order_relaxed);
     }
   }
 
-  static uint64_t hash(const char* ptr,uint64_t len) {
-    uint64_t hash=str_hash(ptr,len);
-    CStr str(ptr,len);
-    return get_or_insert(str,hash);
+  //as with unpass, the entry may be swept as soon as the last reference is gone
+  static void release(Entry* entry){
+    if(!entry || entry->permanent.load(std::memory_order_relaxed)){
+      return;
+    }
+    uint64_t id=entry->id;
+    if(entry->refs.fetch_sub(1,std::memory_order_acq_rel)==1){
+      shard_of(id).dead.fetch_add(1,std::memory_order_relaxed);
+    }
   }
 
   constexpr static uint64_t cstrlen(const char* ptr){
@@ -98,33 +263,121 @@ class ID{
     return len;
   }
 
+  Entry* entry=nullptr;
+
+  void set(Entry* to){
+    release(entry);
+    entry=to;
+    id=entry ? entry->id : 0;
+  }
+
 public:
   uint64_t id=0;
 
   ID():id(0){}
-  ID(const char* ptr):id(hash(ptr,cstrlen(ptr))){}
-  ID(const char* ptr, uint64_t len):id(hash(ptr,len)){}
-  ID(const std::string& str):id(hash(str.c_str(),str.length())){}
+  ID(const char* ptr){ set(intern(std::string_view(ptr,cstrlen(ptr)))); }
+  ID(const char* ptr, uint64_t len){ set(intern(std::string_view(ptr,len))); }
+  ID(const std::string& str){ set(intern(str)); }
+  ID(std::string_view str){ set(intern(str)); }
 
-  operator const char*() const {
-    if(id==0){
-      return "";
+  ID(const ID& b):entry(b.entry),id(b.id){
+    retain(entry);
+  }
+  ID(ID&& b):entry(b.entry),id(b.id){
+    b.entry=nullptr;
+    b.id=0;
+  }
+  ID& operator=(const ID& b){
+    retain(b.entry);
+    set(b.entry);
+    return *this;
+  }
+  ID& operator=(ID&& b){
+    if(this!=&b){
+      set(b.entry);
+      b.entry=nullptr;
+      b.id=0;
     }
-    return seen_map.at(id).ptr;
+    return *this;
+  }
+  ~ID(){
+    release(entry);
+  }
+
+  //an ID for a name in constant use, as node types are, whose string is kept for good, so copies of it anywhere
+  //only read its entry
+  static ID permanent(std::string_view str){
+    ID ret(str);
+    if(ret.entry){
+      ret.entry->permanent.store(true,std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  std::string_view view() const {
+    return entry ? entry->view() : std::string_view();
+  }
+
+  operator const char*() const {
+    return entry ? entry->str() : "";
   }
   operator bool () const {
     return id;
   }
 
+  struct Stats{
+    uint64_t entries=0;
+    //unreferenced, but not swept yet
+    uint64_t unreferenced=0;
+    uint64_t reserved_bytes=0;
+    uint64_t live_bytes=0;
+  };
+
+  static Stats stats(){
+    Stats ret;
+    for(uint64_t n=0;n<SHARD_COUNT;n++){
+      Shard& shard=shard_of(n);
+      std::shared_lock lock(shard.mutex);
+      ret.entries+=shard.entries.size();
+      for(auto& [id,entry] : shard.entries){
+        ret.unreferenced+=entry->refs.load(std::memory_order_relaxed)==0 && !entry->permanent.load(std::memory_order_relaxed);
+      }
+      ret.reserved_bytes+=shard.reserved_bytes+shard.blocks.capacity()*sizeof(void*)+shard.entries.size()*(sizeof(uint64_t)+2*sizeof(void*));
+      ret.live_bytes+=shard.live_bytes;
+    }
+    return ret;
+  }
+
+  //frees every name nothing refers to anymore; otherwise this happens a shard at a time as names are added
+  static void reclaim(){
+    bool again=true;
+    while(again){
+      again=false;
+      for(uint64_t n=0;n<SHARD_COUNT;n++){
+        Shard& shard=shard_of(n);
+        std::unique_lock lock(shard.mutex);
+        again=shard.sweep() || again;
+      }
+    }
+  }
+
+  //by id alone, without touching either entry's references
+  bool operator>(const ID& b) const{ return id>b.id; }
+  bool operator<(const ID& b) const{ return id<b.id; }
+  bool operator>=(const ID& b) const{ return id>=b.id; }
+  bool operator<=(const ID& b) const{ return id<=b.id; }
+  bool operator==(const ID& b) const{ return id==b.id; }
+  bool operator!=(const ID& b) const{ return id!=b.id; }
+
 #define OPER(OP,TYPE)\
   bool operator OP (const TYPE& b) const{\
     return id OP ID(b).id;\
   }
+#define CMP(TYPE) OPER(>,TYPE) OPER(<,TYPE) OPER(>=,TYPE) OPER(<=,TYPE)\
+  bool operator==(const TYPE& b) const{ return view()==std::string_view(b); }\
+  bool operator!=(const TYPE& b) const{ return view()!=std::string_view(b); }
 
-#define CMP(TYPE) OPER(>,TYPE) OPER(<,TYPE) OPER(>=,TYPE) \
-OPER(<=,TYPE) OPER(==,TYPE) OPER(!=,TYPE)
-
-  CMP(ID)
+  //equality with text compares the text, so it doesn't intern it
   CMP(std::string)
   CMP(char*)
 #undef OPER
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//a fixed set of worker threads taking tasks from one queue; the workers start on first use
+class ThreadPool{
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::function<void()>> queue;
+	std::vector<std::thread> workers;
+	unsigned size;
+	bool stopping=false;
+
+	void start(){
+		for(unsigned n=0;n<size;n++){
+			workers.emplace_back([this](){ work(); });
+		}
+	}
+
+	void work(){
+		while(true){
+			std::function<void()> task;
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock,[this](){ return stopping || !queue.empty(); });
+				if(queue.empty()){
+					return;
+				}
+				task=std::move(queue.front());
+				queue.pop_front();
+			}
+			task();
+		}
+	}
+
+public:
+	//0 means one less than the hardware threads, leaving one for the caller
+	ThreadPool(unsigned size=0):size(size){
+		if(this->size==0){
+			//hardware_concurrency may not know, and say 0
+			unsigned hardware=std::thread::hardware_concurrency();
+			this->size=hardware>1 ? hardware-1 : 1;
+		}
+	}
+	ThreadPool(const ThreadPool&)=delete;
+
+	~ThreadPool(){
+		{
+			std::lock_guard lock(mutex);
+			stopping=true;
+		}
+		wake.notify_all();
+		for(std::thread& worker : workers){
+			worker.join();
+		}
+	}
+
+	unsigned worker_count() const { return size; }
+
+	void submit(std::function<void()> task){
+		{
+			std::lock_guard lock(mutex);
+			if(workers.empty()){
+				start();
+			}
+			queue.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+
+	//runs fn(n) for every n in [0,count) on the workers and the calling thread, returning once all are done
+	//the caller takes indices too, so this may be nested inside a task without starving the pool
+	//the first exception thrown by fn is rethrown here
+	template<typename F>
+	void parallel_for(size_t count, F&& fn){
+		if(count==0){
+			return;
+		}
+		if(count==1){
+			fn(0);
+			return;
+		}
+		struct State{
+			std::atomic<size_t> next{0};
+			std::atomic<size_t> finished{0};
+			size_t count;
+			std::mutex mutex;
+			std::condition_variable done;
+			std::exception_ptr error;
+		};
+		std::shared_ptr<State> state=std::make_shared<State>();
+		state->count=count;
+		std::function<void(size_t)> body=fn;
+		auto run=[state,&body](){
+			size_t n;
+			while((n=state->next++)<state->count){
+				try{
+					body(n);
+				}catch(...){
+					std::lock_guard lock(state->mutex);
+					if(!state->error){
+						state->error=std::current_exception();
+					}
+				}
+				if(++state->finished==state->count){
+					std::lock_guard lock(state->mutex);
+					state->done.notify_all();
+				}
+			}
+		};
+		size_t helpers=std::min<size_t>(size,count-1);
+		for(size_t n=0;n<helpers;n++){
+			submit(run);
+		}
+		run();
+		std::unique_lock lock(state->mutex);
+		state->done.wait(lock,[&](){ return state->finished==state->count; });
+		if(state->error){
+			std::rethrow_exception(state->error);
+		}
+	}
+};
+
+inline ThreadPool thread_pool;
@@ -0,0 +1,325 @@
+#include "tile_cache.hpp"
+#include "metrics.hpp"
+#include <cmath>
+
+TileCache::Tile::~Tile(){
+	if(surface){
+		cairo_surface_destroy(surface);
+	}
+}
+
+TileCache::~TileCache(){
+	std::unique_lock lock(mutex);
+	idle.wait(lock,[this](){ return pending.empty(); });
+}
+
+int TileCache::zoom_for(const Viewport& view){
+	double units_per_px=(view.x1-view.x0)/view.width;
+	return (int)ceil(-log2(units_per_px));
+}
+
+void TileCache::tile_range(const Viewport& view, int zoom, long& tx0, long& tx1, long& ty0, long& ty1){
+	double units=ldexp(TILE_SIZE,-zoom);
+	tx0=floor(view.x0/units);
+	tx1=floor(view.x1/units);
+	ty0=floor(view.y0/units);
+	ty1=floor(view.y1/units);
+}
+
+//paints tile (key's zoom, tx, ty) where it falls in view, only within the clip rectangle
+static void paint_tile(cairo_t* cr, const Viewport& view, const TileKey& key, cairo_surface_t* surface,
+		double clip_x, double clip_y, double clip_w, double clip_h){
+	double units=ldexp(TileCache::TILE_SIZE,-key.zoom);
+	double left=view.px_x(key.tx*units);
+	double top=view.px_y((key.ty+1)*units);
+	double scale=(view.px_x((key.tx+1)*units)-left)/TileCache::TILE_SIZE;
+	cairo_save(cr);
+	cairo_rectangle(cr,clip_x,clip_y,clip_w,clip_h);
+	cairo_clip(cr);
+	cairo_translate(cr,left,top);
+	cairo_scale(cr,scale,scale);
+	cairo_set_source_surface(cr,surface,0,0);
+	cairo_paint(cr);
+	cairo_restore(cr);
+}
+
+bool TileCache::draw(cairo_t* cr, const Viewport& view, const TileLayer& layer){
+	drop_revisions_before(layer.id,layer.revision);
+	int zoom=zoom_for(view);
+	long tx0,tx1,ty0,ty1;
+	tile_range(view,zoom,tx0,tx1,ty0,ty1);
+	double units=ldexp(TILE_SIZE,-zoom);
+
+	bool complete=true;
+	for(long ty=ty0;ty<=ty1;ty++){
+		for(long tx=tx0;tx<=tx1;tx++){
+			TileKey key{layer.id,layer.revision,zoom,tx,ty};
+			double left=view.px_x(tx*units);
+			double top=view.px_y((ty+1)*units);
+			double width=view.px_x((tx+1)*units)-left;
+			double height=view.px_y(ty*units)-top;
+
+			std::shared_ptr<Tile> tile=find(key);
+			if(tile){
+				paint_tile(cr,view,key,tile->surface,left,top,width,height);
+				continue;
+			}
+			complete=false;
+			request(key,layer);
+			//until it arrives, show what was there before the layer changed, or stretch the nearest coarser tile over its place
+			std::shared_ptr<Tile> before=find_stale(key);
+			if(before){
+				paint_tile(cr,view,key,before->surface,left,top,width,height);
+				continue;
+			}
+			TileKey parent=key;
+			for(int up=0;up<4;up++){
+				parent.zoom--;
+				parent.tx>>=1;
+				parent.ty>>=1;
+				std::shared_ptr<Tile> coarse=find(parent);
+				if(coarse){
+					paint_tile(cr,view,parent,coarse->surface,left,top,width,height);
+					break;
+				}
+			}
+		}
+	}
+	return complete;
+}
+
+void TileCache::prefetch(const Viewport& view, const TileLayer& layer){
+	drop_revisions_before(layer.id,layer.revision);
+	int zoom=zoom_for(view);
+	long tx0,tx1,ty0,ty1;
+	tile_range(view,zoom,tx0,tx1,ty0,ty1);
+	for(long ty=ty0;ty<=ty1;ty++){
+		for(long tx=tx0;tx<=tx1;tx++){
+			request(TileKey{layer.id,layer.revision,zoom,tx,ty},layer);
+		}
+	}
+}
+
+std::shared_ptr<TileCache::Tile> TileCache::find(const TileKey& key){
+	std::lock_guard lock(mutex);
+	auto found=tiles.find(key);
+	if(found==tiles.end()){
+		counts.misses++;
+		return nullptr;
+	}
+	counts.hits++;
+	lru.splice(lru.begin(),lru,found->second);
+	return *found->second;
+}
+
+std::shared_ptr<TileCache::Tile> TileCache::find_stale(TileKey key){
+	key.revision=0;
+	std::lock_guard lock(mutex);
+	auto found=stale.find(key);
+	return found==stale.end() ? nullptr : found->second;
+}
+
+std::shared_ptr<const Curve> TileCache::find_line(TileKey key, const TileLayer& layer){
+	std::shared_ptr<Tile> before=find_stale(key);
+	if(!before || before->fn!=layer.fn || before->kind!=layer.kind || before->line_width!=layer.style.line_width){
+		return nullptr;
+	}
+	return before->line;
+}
+
+void TileCache::request(const TileKey& key, const TileLayer& layer){
+	{
+		std::lock_guard lock(mutex);
+		if(tiles.count(key) || !pending.insert(key).second){
+			return;
+		}
+	}
+	thread_pool.submit([this,key,layer](){ render(key,layer); });
+}
+
+void TileCache::render(TileKey key, TileLayer layer){
+	bool current;
+	{
+		std::lock_guard lock(mutex);
+		auto found=revisions.find(key.layer);
+		current=found!=revisions.end() && found->second==key.revision;
+	}
+	std::shared_ptr<Tile> tile;
+	if(current){
+		metric_entry=key.layer;
+		StageTimer timer(STAGE_TILE);
+		double units=ldexp(TILE_SIZE,-key.zoom);
+		Viewport view;
+		view.x0=key.tx*units;
+		view.x1=view.x0+units;
+		view.y0=key.ty*units;
+		view.y1=view.y0+units;
+		view.width=view.height=TILE_SIZE;
+
+		tile=std::make_shared<Tile>();
+		tile->key=key;
+		tile->surface=cairo_image_surface_create(CAIRO_FORMAT_ARGB32,TILE_SIZE,TILE_SIZE);
+		tile->bytes=cairo_image_surface_get_stride(tile->surface)*TILE_SIZE;
+		cairo_t* cr=cairo_create(tile->surface);
+		if(layer.kind==PLOT_SCATTER){
+			//each tile bins only the points inside it, through the set's index
+			draw_points(cr,view,*layer.points,layer.style);
+		}else if(layer.kind==PLOT_HEATMAP){
+			draw_field(cr,view,*layer.fn,layer.style);
+		}else{
+			std::shared_ptr<const Curve> line=find_line(key,layer);
+			if(!line){
+				//sampled a little past the edges, so lines crossing them join up with the neighbors
+				int pad=ceil(layer.style.line_width)+1;
+				double pad_units=pad*units/TILE_SIZE;
+				Viewport sampled=view;
+				sampled.x0-=pad_units;
+				sampled.x1+=pad_units;
+				sampled.y0-=pad_units;
+				sampled.y1+=pad_units;
+				sampled.width=sampled.height=TILE_SIZE+2*pad;
+				Curve curve;
+				if(layer.kind==PLOT_IMPLICIT){
+					curve=trace_implicit(*layer.fn,sampled);
+				}else if(layer.kind==PLOT_PARAMETRIC){
+					curve=sample_parametric(*layer.fn,sampled);
+				}else{
+					curve=sample_function(*layer.fn,sampled);
+				}
+				line=std::make_shared<const Curve>(decimate(curve,view));
+			}
+			stroke_curve(cr,view,*line,layer.style);
+			tile->line=line;
+			tile->fn=layer.fn;
+			tile->kind=layer.kind;
+			tile->line_width=layer.style.line_width;
+			tile->bytes+=line->size()*2*sizeof(double);
+		}
+		cairo_destroy(cr);
+		cairo_surface_flush(tile->surface);
+	}
+
+	if(tile){
+		{
+			std::lock_guard lock(mutex);
+			counts.renders++;
+			insert(tile);
+		}
+		if(on_tile_ready){
+			on_tile_ready();
+		}
+	}
+	//the destructor waits on pending, so this is the last the job touches the cache
+	std::lock_guard lock(mutex);
+	pending.erase(key);
+	idle.notify_all();
+}
+
+//needs the lock
+void TileCache::insert(std::shared_ptr<Tile> tile){
+	auto found=revisions.find(tile->key.layer);
+	if(found==revisions.end() || found->second!=tile->key.revision){
+		return;
+	}
+	TileKey position=tile->key;
+	position.revision=0;
+	auto replaced=stale.find(position);
+	if(replaced!=stale.end()){
+		counts.bytes-=replaced->second->bytes;
+		stale.erase(replaced);
+	}
+	counts.bytes+=tile->bytes;
+	lru.push_front(tile);
+	tiles[tile->key]=lru.begin();
+	trim();
+}
+
+//needs the lock
+//stand-ins count toward the budget too, and go first: they only cover for tiles on their way
+void TileCache::trim(){
+	while(counts.bytes>max_bytes && !stale.empty()){
+		auto it=stale.begin();
+		counts.bytes-=it->second->bytes;
+		stale.erase(it);
+		counts.evictions++;
+	}
+	while(counts.bytes>max_bytes && !lru.empty()){
+		counts.bytes-=lru.back()->bytes;
+		tiles.erase(lru.back()->key);
+		lru.pop_back();
+		counts.evictions++;
+	}
+}
+
+void TileCache::drop_revisions_before(uint64_t layer, uint64_t revision){
+	std::lock_guard lock(mutex);
+	auto found=revisions.find(layer);
+	if(found!=revisions.end() && found->second>=revision){
+		return;
+	}
+	revisions[layer]=revision;
+	//the older tiles become the stand-ins, unless there are none, as when the last revision never got drawn
+	bool replacing=true;
+	for(auto it=lru.begin();it!=lru.end();){
+		if((*it)->key.layer==layer && (*it)->key.revision<revision){
+			if(replacing){
+				drop_stale(layer);
+				replacing=false;
+			}
+			TileKey position=(*it)->key;
+			position.revision=0;
+			stale[position]=*it;
+			tiles.erase((*it)->key);
+			it=lru.erase(it);
+		}else{
+			it++;
+		}
+	}
+}
+
+void TileCache::drop_stale(uint64_t layer){
+	for(auto it=stale.begin();it!=stale.end();){
+		if(it->first.layer==layer){
+			counts.bytes-=it->second->bytes;
+			it=stale.erase(it);
+		}else{
+			it++;
+		}
+	}
+}
+
+void TileCache::forget(uint64_t layer){
+	std::lock_guard lock(mutex);
+	revisions.erase(layer);
+	drop_stale(layer);
+	for(auto it=lru.begin();it!=lru.end();){
+		if((*it)->key.layer==layer){
+			counts.bytes-=(*it)->bytes;
+			tiles.erase((*it)->key);
+			it=lru.erase(it);
+		}else{
+			it++;
+		}
+	}
+}
+
+void TileCache::set_max_bytes(size_t bytes){
+	std::lock_guard lock(mutex);
+	max_bytes=bytes;
+	trim();
+}
+
+TileCache::Stats TileCache::stats(){
+	std::lock_guard lock(mutex);
+	Stats ret=counts;
+	ret.tiles=lru.size();
+	return ret;
+}
+
+void TileCache::clear(){
+	std::lock_guard lock(mutex);
+	lru.clear();
+	tiles.clear();
+	stale.clear();
+	counts.bytes=0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include "plot_render.hpp"
+
+//one definition's curve, drawn over the graph as transparent tiles
+struct TileLayer{
+	//unique to the definition
+	uint64_t id=0;
+	//changes whenever what the layer draws does
+	uint64_t revision=0;
+	//of x for a curve, of t to a pair for a parametric curve, or of x and y for an implicit curve or heatmap
+	std::shared_ptr<const CompiledExpr> fn;
+	//or the points of a scatter plot
+	std::shared_ptr<const PointSet> points;
+	PlotKind kind=PLOT_CURVE;
+	PlotStyle style;
+};
+
+struct TileKey{
+	uint64_t layer=0;
+	uint64_t revision=0;
+	//tiles at zoom z are TILE_SIZE pixels of 2^-z units each
+	int zoom=0;
+	long tx=0,ty=0;
+
+	bool operator==(const TileKey& b) const {
+		return layer==b.layer && revision==b.revision && zoom==b.zoom && tx==b.tx && ty==b.ty;
+	}
+};
+
+template<>
+struct std::hash<TileKey>{
+	size_t operator()(const TileKey& key) const {
+		uint64_t hash=key.layer*0x9E3779B97F4A7C15ull;
+		hash=(hash^key.revision)*0xBF58476D1CE4E5B9ull;
+		hash=(hash^(uint64_t)key.zoom)*0x94D049BB133111EBull;
+		hash=(hash^(uint64_t)key.tx)*0x9E3779B97F4A7C15ull;
+		hash=(hash^(uint64_t)key.ty)*0xBF58476D1CE4E5B9ull;
+		return hash^(hash>>31);
+	}
+};
+
+//rasterized curve tiles in a quadtree over the plane, so panning and zooming only render what's newly exposed
+//missing tiles are rendered on the thread pool and drawn from a coarser ancestor until they arrive;
+//tiles are kept in a memory-bounded LRU, and a layer's tiles are dropped when its revision changes, except that
+//the last revision's stand in for the new one's until they arrive, so a layer changing every frame doesn't flicker;
+//stand-ins share the memory bound, and are evicted before any current tile
+class TileCache{
+public:
+	static constexpr int TILE_SIZE=256;
+
+	struct Stats{
+		uint64_t hits=0;
+		uint64_t misses=0;
+		uint64_t renders=0;
+		uint64_t evictions=0;
+		uint64_t bytes=0;
+		uint64_t tiles=0;
+	};
+
+	//called from a worker whenever a requested tile is ready
+	std::function<void()> on_tile_ready;
+
+	TileCache(){}
+	TileCache(const TileCache&)=delete;
+	//waits for tiles still being rendered
+	~TileCache();
+
+	//draws the layer's tiles covering view, requesting any it doesn't have; false if some were missing
+	bool draw(cairo_t* cr, const Viewport& view, const TileLayer& layer);
+	//requests the layer's tiles covering view, without drawing them
+	void prefetch(const Viewport& view, const TileLayer& layer);
+	//drops the layer's tiles, as when its definition is removed
+	void forget(uint64_t layer);
+
+	void set_max_bytes(size_t bytes);
+	Stats stats();
+	void clear();
+
+	//the zoom level whose tiles are at least as fine as the view
+	static int zoom_for(const Viewport& view);
+
+private:
+	struct Tile{
+		TileKey key;
+		cairo_surface_t* surface=nullptr;
+		size_t bytes=0;
+		//for a line, what it was stroked from: the samples decimated to the tile's zoom, and what they came from,
+		//so a revision that only restyles the layer strokes them again without sampling or decimating
+		std::shared_ptr<const Curve> line;
+		std::shared_ptr<const CompiledExpr> fn;
+		PlotKind kind=PLOT_CURVE;
+		double line_width=0;
+		~Tile();
+	};
+
+	std::mutex mutex;
+	std::condition_variable idle;
+	size_t max_bytes=64<<20;
+	Stats counts;
+	list<std::shared_ptr<Tile>> lru;
+	std::unordered_map<TileKey,list<std::shared_ptr<Tile>>::iterator> tiles;
+	std::unordered_set<TileKey> pending;
+	//the newest revision seen of each layer; requests for older ones are skipped
+	std::unordered_map<uint64_t,uint64_t> revisions;
+	//tiles of the last revision of each layer that had any, by their key with revision 0
+	std::unordered_map<TileKey,std::shared_ptr<Tile>> stale;
+
+	std::shared_ptr<Tile> find(const TileKey& key);
+	std::shared_ptr<Tile> find_stale(TileKey key);
+	//the decimated line of the tile last at key's place, if it was sampled the same way as layer's would be
+	std::shared_ptr<const Curve> find_line(TileKey key, const TileLayer& layer);
+	//needs the lock
+	void drop_stale(uint64_t layer);
+	void request(const TileKey& key, const TileLayer& layer);
+	void render(TileKey key, TileLayer layer);
+	void insert(std::shared_ptr<Tile> tile);
+	void drop_revisions_before(uint64_t layer, uint64_t revision);
+	void trim();
+	//tile range covering view at the given zoom
+	static void tile_range(const Viewport& view, int zoom, long& tx0, long& tx1, long& ty0, long& ty1);
+};
@@ -1,11 +1,17 @@
 #pragma once
 #include <gtk/gtk.h>
 #include <vector>
-
-class DefsEntry{
-	int idx;
+#include <memory>
+#include "parser.hpp"
+#include "eval_worker.hpp"
+#include <atomic>
+#include "defs_model.hpp"
+#include "tile_cache.hpp"
+#include "roots.hpp"
+
+//the widgets showing one definition; the list recycles rows as it scrolls, so they keep nothing of their own
+class DefsRow{
 public:
-
 	GtkFrame* frame=nullptr;
 	GtkBox* hbox=nullptr;
 	GtkLabel* linenum=nullptr;
@@ -21,21 +27,64 @@ public:
 		GtkBox* vbox=nullptr;
 		GtkButton* remove_button=nullptr;
 		GtkCheckButton* display_toggle=nullptr;
-		GtkButton* menu_button=nullptr;
+		//lists the definition's free variables, to be made parameters with sliders, and for a curve, what to mark on it
+		GtkMenuButton* menu_button=nullptr;
 		GtkColorDialogButton* color_button=nullptr;
 	} options;
 
-	void init();
-	~DefsEntry();
+	//the definition shown, or 0 while unbound
+	uint64_t id=0;
+	//set while the widgets are filled in, so their change signals aren't taken for edits
+	bool binding=false;
 
-	void set_idx(int);
-	int get_idx() const{ return idx; }
-
-	static void _on_text_changed(GtkTextBuffer*,gpointer);
+	void init();
+	~DefsRow();
+
+	void bind(const DefsModel::Definition&, size_t position);
+	void unbind();
+	void set_position(size_t);
+	void set_message(const string&);
+
+	static void _on_insert_text(GtkTextBuffer*,GtkTextIter*,char*,int,gpointer);
+	static void _on_delete_range(GtkTextBuffer*,GtkTextIter*,GtkTextIter*,gpointer);
+	static void _on_display_changed(GtkWidget*,gpointer);
+	static void _on_color_changed(GtkWidget*,GParamSpec*,gpointer);
+	static void _on_remove_clicked(GtkWidget*,gpointer);
+	static void _on_menu_popup(GtkMenuButton*,gpointer);
+	static void _on_parameter_toggled(GtkCheckButton*,gpointer);
+	static void _on_zeros_toggled(GtkCheckButton*,gpointer);
+	static void _on_crossing_toggled(GtkCheckButton*,gpointer);
 
 	operator GtkWidget*() const {return GTK_WIDGET(frame);}
 };
 
+//a parameter's slider, which can also sweep back and forth across its range by itself
+class ParamSlider{
+public:
+	GtkBox* hbox=nullptr;
+	GtkLabel* name_label=nullptr;
+	GtkScale* scale=nullptr;
+	GtkToggleButton* play_button=nullptr;
+	GtkButton* remove_button=nullptr;
+
+	ID name;
+	//while playing: the tick callback, the time of the last frame it saw, and which way it's moving
+	guint tick=0;
+	gint64 last_frame=0;
+	double direction=1;
+
+	void init(ID name, double value);
+	void stop();
+
+	static void _on_value_changed(GtkRange*,gpointer);
+	static void _on_play_toggled(GtkToggleButton*,gpointer);
+	static gboolean _on_tick(GtkWidget*,GdkFrameClock*,gpointer);
+	static void _on_remove_clicked(GtkWidget*,gpointer);
+
+	operator GtkWidget*() const {return GTK_WIDGET(hbox);}
+};
+
+//the definitions, shown in a list view that only builds rows for what's on screen
 struct DefsPanel{
 	GtkFrame* frame=nullptr;
 	GtkBox* vbox=nullptr;
@@ -43,31 +92,102 @@ struct DefsPanel{
 	struct{
 		GtkBox* hbox=nullptr;
 		GtkButton* add_button=nullptr;
+		GtkButton* open_button=nullptr;
+		GtkButton* save_button=nullptr;
+		GtkButton* import_button=nullptr;
 	} header;
 
 	GtkSeparator* separator=nullptr;
 
 	struct{
 		GtkScrolledWindow* scroller=nullptr;
-		GtkBox* vbox=nullptr;
-
-		std::vector<DefsEntry*> entries;
+		GtkListView* list_view=nullptr;
+		//one item per definition, holding just its id, in the model's order
+		GListStore* store=nullptr;
 	} defs;
 
+	//sliders for the parameters, below the list; hidden while there are none
+	GtkBox* sliders_box=nullptr;
+	vector<unique<ParamSlider>> sliders;
+
+	DefsModel model;
+	//rows showing a definition, by its id
+	std::unordered_map<uint64_t,DefsRow*> bound;
+
 	void init();
 
+	//appends definitions as one change to the list, and submits them for evaluation
+	void add_definitions(const vector<string>& texts);
+	void remove_definition(uint64_t id);
+	//takes an edit of a definition's text, 'removed' characters at pos replaced by 'inserted'
+	void edit_text(uint64_t id, size_t pos, size_t removed, const string& inserted);
+	TileLayer tile_layer(const DefsModel::Definition&) const;
+	//the zeros and intersections marked on a definition's curve, if it's shown as one
+	vector<RootQuery> root_queries(const DefsModel::Definition&) const;
+
+	//writes the workspace as a snapshot, with the results of whatever is up to date
+	void save(const string& path);
+	//replaces the workspace with a snapshot's; up to date entries take their saved results, the rest are evaluated
+	void load(const string& path);
+	//reads a data file's columns on the pool, then recomputes what uses them
+	void import_data(const string& path);
+	//makes name a parameter with a slider, or stops it being one, and recomputes what uses it
+	void add_slider(ID name);
+	void remove_slider(ID name);
+	//binds a parameter's new value into the plots of whatever uses it, without evaluating anything
+	void set_parameter(ID name, double value);
+
 	static void _on_add_button_press(GtkWidget*,gpointer);
-	void add_entry(DefsEntry*);
-	void remove_entry(DefsEntry*);
+	static void _on_open_button_press(GtkWidget*,gpointer);
+	static void _on_save_button_press(GtkWidget*,gpointer);
+	static void _on_open_chosen(GObject*,GAsyncResult*,gpointer);
+	static void _on_save_chosen(GObject*,GAsyncResult*,gpointer);
+	static void _on_import_button_press(GtkWidget*,gpointer);
+	static void _on_import_chosen(GObject*,GAsyncResult*,gpointer);
+	static gboolean _on_evaluated(gpointer);
+	static void _on_setup_row(GtkSignalListItemFactory*,GtkListItem*,gpointer);
+	static void _on_bind_row(GtkSignalListItemFactory*,GtkListItem*,gpointer);
+	static void _on_unbind_row(GtkSignalListItemFactory*,GtkListItem*,gpointer);
+	static void _on_position_changed(GtkListItem*,GParamSpec*,gpointer);
 
 	operator GtkWidget*() const {return GTK_WIDGET(frame);}
 };
 
 struct OutputPanel{
 	GtkNotebook* tab_pane=nullptr;
+	GtkOverlay* graph_overlay=nullptr;
 	GtkDrawingArea* graph_area=nullptr;
+	//per-stage timings over the graph; F12 shows and hides it
+	GtkLabel* metrics_label=nullptr;
+	guint metrics_timer=0;
+
+	//the graph's center, and its scale in units per pixel
+	double center_x=0,center_y=0;
+	double scale=1.0/40;
+
+	TileCache tiles;
+	RootCache roots;
+	std::atomic<bool> redraw_queued{false};
+
+	//pointer position over the graph
+	double pointer_x=0,pointer_y=0;
+	//drag offset so far, and recent drag motion per update (in pixels), to prefetch ahead of
+	double drag_x=0,drag_y=0;
+	double motion_x=0,motion_y=0;
 
 	void init();
+	void redraw();
+	void toggle_metrics();
+
+	static void _on_draw(GtkDrawingArea*,cairo_t*,int,int,gpointer);
+	static void _on_drag_begin(GtkGestureDrag*,double,double,gpointer);
+	static void _on_drag_update(GtkGestureDrag*,double,double,gpointer);
+	static void _on_drag_end(GtkGestureDrag*,double,double,gpointer);
+	static gboolean _on_scroll(GtkEventControllerScroll*,double,double,gpointer);
+	static void _on_motion(GtkEventControllerMotion*,double,double,gpointer);
+	static gboolean _on_tiles_ready(gpointer);
+	static gboolean _on_metrics_key(GtkWidget*,GVariant*,gpointer);
+	static gboolean _on_metrics_tick(gpointer);
 
 	operator GtkWidget*() const {return GTK_WIDGET(tab_pane);}
 };
@@ -82,6 +202,9 @@ struct MainUI{
 	DefsPanel defs_panel;
 	OutputPanel output_panel;
 
+	//parses and evaluates definitions off the main loop, which only applies the results
+	EvalWorker evaluator;
+
 	void init();
 };
 
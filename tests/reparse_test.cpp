@@ -0,0 +1,69 @@
+#include "parser.hpp"
+#include <cstdio>
+#include <random>
+
+//an incremental reparse must come out the same as parsing the text from scratch
+//compared printed, since same_as never matches an empty operand
+
+static int failures=0;
+
+//the incremental parse, or the parse error, as printed
+static string reparsed(IncrementalParse& source){
+	try{
+		return source.reparse().to_string();
+	}catch(ParseFail){
+		return "parse error";
+	}
+}
+
+static string parsed(const string& text){
+	try{
+		return parse(text).to_string();
+	}catch(ParseFail){
+		return "parse error";
+	}
+}
+
+static void check(IncrementalParse& source){
+	string incremental=reparsed(source);
+	string full=parsed(source.text);
+	if(incremental!=full){
+		failures++;
+		printf("'%s': reparsed as %s, parsed as %s\n",source.text.c_str(),incremental.c_str(),full.c_str());
+	}
+}
+
+int main(){
+	//a subtree taken into the new text, then its old parent
+	IncrementalParse source;
+	source.set_text("(x+a*b)");
+	check(source);
+	source.edit(0,0,"a*b-");
+	check(source);
+	//and again, reusing what the last edit moved
+	source.edit(0,0,"c+");
+	check(source);
+	source.edit(2,4,"");
+	check(source);
+
+	const char* pieces[]={"a","b","x","1","2","+","-","*","/","^","(",")","a*b","(x+a*b)","[1,2]",",","#","@","  "};
+	std::mt19937 rng(1);
+	for(int round=0;round<500;round++){
+		IncrementalParse random;
+		random.set_text("(x+a*b)*(a*b-c)");
+		check(random);
+		for(int n=0;n<20;n++){
+			size_t pos=rng()%(random.text.size()+1);
+			size_t removed=std::min<size_t>(rng()%3,random.text.size()-pos);
+			string inserted=rng()%3 ? pieces[rng()%std::size(pieces)] : "";
+			random.edit(pos,removed,inserted);
+			check(random);
+		}
+	}
+
+	if(failures){
+		printf("%d reparses differ from a full parse\n",failures);
+		return 1;
+	}
+	return 0;
+}